@@ -3,7 +3,7 @@
  * Author: Joshua Dahl
  * Email: joshuadahl@nevada.unr.edu
  * Created: 2/7/22
- * Modified: 5/4/22
+ * Modified: 10/16/26
  * Description: Provides several data structs which hold database, tables, columns, tuples, etc...,
  * 				also provides actions the the parser creates as well as serialization for these things.
  *------------------------------------------------------------*/
@@ -309,10 +309,21 @@ namespace sql {
 	}
 
 
+	// Struct identifying where a tuple is stored on disk (the page it is stored in and the slot within that page)
+	struct RecordID {
+		uint32_t page = -1;
+		uint16_t slot = -1;
+
+		// Check if the tuple has a location on disk
+		bool valid() const { return page != uint32_t(-1); }
+	};
+
 	// Struct representing a row in the table (this class is a thin wrapper around std::vector)
 	struct Tuple: public std::vector<Data> {
 		// Pointer to the table this tuple belongs to
 		Table* table = nullptr;
+		// Where the tuple is stored on disk (only valid for tuples loaded directly from a table file)
+		RecordID rid;
 
 		using std::vector<Data>::vector;
 	};
@@ -349,6 +360,14 @@ namespace sql {
 
 	// Struct representing a table
 	struct Table {
+		// How a table's tuples are laid out on disk
+		enum Layout {
+			// Tuples are stored together, row by row
+			Row,
+			// Each column is stored in its own segment (so queries only need to read the columns they reference)
+			Columnar,
+		};
+
 		// Pointer to the database this table belongs to
 		Database* database;
 
@@ -358,6 +377,8 @@ namespace sql {
 		std::filesystem::path path;
 		// The columns of this table
 		std::vector<Column> columns;
+		// How this table is stored on disk
+		Layout layout = Row;
 
 		// The tuples this table is storing
 		std::vector<Tuple> tuples;
@@ -445,10 +466,11 @@ namespace sql {
 					Database,
 					Table,
 					Column,
+					Index,
 
 					MAX
 				};
-				static const std::array<std::string, Type::MAX> TypeNames; //= {"Invalid", "Database", "Table", "Column"};
+				static const std::array<std::string, Type::MAX> TypeNames; //= {"Invalid", "Database", "Table", "Column", "Index"};
 
 				// Type of target
 				Type type;
@@ -480,6 +502,14 @@ namespace sql {
 		struct CreateTableAction: public Action {
 			// The column metadata to create the table with
 			std::vector<Column> columns;
+			// How the table should be stored on disk
+			Table::Layout layout = Table::Row;
+		};
+
+		// Struct representing an index creation action (the index's name is the target's name)
+		struct CreateIndexAction: public Action {
+			// The table and column to be indexed
+			std::string table, column;
 		};
 
 		// Struct representing a table alteration action
@@ -569,6 +599,50 @@ namespace sql {
 
 			// The columns (or wildcard) to query
 			Wildcard<std::vector<std::string>> columns;
+
+			// Struct representing an aggregate function applied to a column
+			struct Aggregate {
+				enum Function {
+					Count,
+					Sum,
+					Avg,
+					Min,
+					Max,
+					MAX
+				};
+				static const std::array<std::string, Function::MAX> FunctionNames;
+				Function function;
+
+				// The aggregated column (or wildcard when counting every tuple)
+				Wildcard<std::string> column;
+				// The index of the aggregate amongst the queried columns (or -1 if it is only referenced by HAVING conditions)
+				size_t position = -1;
+
+				// Function which returns the name of the aggregate (the name it is printed with, and referenced by in HAVING conditions)
+				std::string name() const { return FunctionNames[function] + "(" + (column.has_value() ? *column : "*") + ")"; }
+			};
+			// The aggregates to compute (the queried columns fill in the positions the aggregates don't occupy)
+			std::vector<Aggregate> aggregates;
+			// The columns tuples are grouped by
+			std::vector<std::string> groupBy;
+			// Conditions which groups must satisfy (aggregates are referenced by name)
+			std::vector<Condition> having;
+
+			// Struct representing a column (or aggregate, referenced by name) the queried tuples are ordered by
+			struct OrderBy {
+				std::string column;
+				bool descending = false;
+			};
+			// The columns the queried tuples are ordered by (in order of precedence)
+			std::vector<OrderBy> orderBy;
+			// The most tuples the query outputs (-1 if there is no limit), and how many of the queried tuples are skipped before any are output
+			size_t limit = -1;
+			size_t offset = 0;
+
+			// Function which returns true if the query groups its tuples
+			bool isAggregate() const { return !aggregates.empty() || !groupBy.empty(); }
+			// Function which returns how many of the queried tuples are needed to output the limited tuples (-1 if there is no limit)
+			size_t limitEnd() const { return limit == size_t(-1) ? limit : offset + limit; }
 		};
 
 		// Struct representing a action that updates some values in the table
@@ -584,7 +658,8 @@ namespace sql {
 
 		// Memory backing for the enum name arrays
 		inline const std::array<std::string, Action::Action::MAX> Action::ActionNames = {"Invalid", "Use", "Create", "Drop", "Alter", "Insert", "Update", "Delete", "Query", "Add", "Remove"};
-		inline const std::array<std::string, Action::Target::MAX> Action::Target::TypeNames = {"Invalid", "Database", "Table", "Column"};
+		inline const std::array<std::string, Action::Target::MAX> Action::Target::TypeNames = {"Invalid", "Database", "Table", "Column", "Index"};
+		inline const std::array<std::string, QueryTableAction::Aggregate::MAX> QueryTableAction::Aggregate::FunctionNames = {"count", "sum", "avg", "min", "max"};
 	} // ast
 
 } // sql
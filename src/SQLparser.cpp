@@ -3,7 +3,7 @@
  * Author: Joshua Dahl
  * Email: joshuadahl@nevada.unr.edu
  * Created: 2/7/22
- * Modified: 5/4/22
+ * Modified: 10/16/26
  * Description: File which implements the grammar for parsing SQL (implemented as a Lexy DSL)
  *------------------------------------------------------------*/
 
@@ -453,6 +453,14 @@ namespace sql::grammar {
 		// The COLUMN keyword
 		static constexpr auto column = dsl::peek(UL::c) >> dsl::p<Column>;
 
+		// Rule that matches the INDEX keyword
+		struct Index: lexy::token_production {
+			static constexpr auto rule = UL::i + UL::n + UL::d + UL::e + UL::x + wsc;
+			static constexpr auto value = lexy::constant(ast::Action::Target::Index);
+		};
+		// The INDEX keyword
+		static constexpr auto index = dsl::peek(UL::i) >> dsl::p<Index>;
+
 
 		// --- Join Type Keywords ---
 
@@ -474,6 +482,39 @@ namespace sql::grammar {
 		static constexpr auto leftOuterJoin = dsl::peek(UL::l) >> dsl::p<LeftOuterJoin>;
 
 
+		// --- Aggregate Function Keywords ---
+
+
+		// Rule that matches the COUNT keyword
+		struct Count: lexy::token_production {
+			static constexpr auto rule = UL::c + UL::o + UL::u + UL::n + UL::t;
+			static constexpr auto value = lexy::constant(ast::QueryTableAction::Aggregate::Count);
+		};
+		// Rule that matches the SUM keyword
+		struct Sum: lexy::token_production {
+			static constexpr auto rule = UL::s + UL::u + UL::m;
+			static constexpr auto value = lexy::constant(ast::QueryTableAction::Aggregate::Sum);
+		};
+		// Rule that matches the AVG keyword
+		struct Avg: lexy::token_production {
+			static constexpr auto rule = UL::a + UL::v + UL::g;
+			static constexpr auto value = lexy::constant(ast::QueryTableAction::Aggregate::Avg);
+		};
+		// Rule that matches the MIN keyword
+		struct Min: lexy::token_production {
+			static constexpr auto rule = UL::m + UL::i + UL::n;
+			static constexpr auto value = lexy::constant(ast::QueryTableAction::Aggregate::Min);
+		};
+		// Rule that matches the MAX keyword
+		struct Max: lexy::token_production {
+			static constexpr auto rule = UL::m + UL::a + UL::x;
+			static constexpr auto value = lexy::constant(ast::QueryTableAction::Aggregate::Max);
+		};
+		// The COUNT, SUM, AVG, MIN, or MAX keywords
+		static constexpr auto aggregateFunction = dsl::peek(UL::c) >> dsl::p<Count> | dsl::peek(UL::s) >> dsl::p<Sum> | dsl::peek(UL::a) >> dsl::p<Avg>
+			| dsl::peek(UL::m + UL::i) >> dsl::p<Min> | dsl::peek(UL::m + UL::a) >> dsl::p<Max>;
+
+
 		// --- Transaction Keywords ---
 
 
@@ -521,6 +562,62 @@ namespace sql::grammar {
 		// The WHERE keyword
 		static constexpr auto where = dsl::peek(UL::w) >> dsl::p<Where>;
 
+		// Rule that matches the GROUP BY keyword
+		struct GroupBy: lexy::token_production {
+			static constexpr auto rule = UL::g + UL::r + UL::o + UL::u + UL::p + wsp + UL::b + UL::y + wsc;
+			static constexpr auto value = lexy::noop;
+		};
+		// The GROUP BY keyword
+		static constexpr auto groupBy = dsl::peek(UL::g) >> dsl::p<GroupBy>;
+
+		// Rule that matches the HAVING keyword
+		struct Having: lexy::token_production {
+			static constexpr auto rule = UL::h + UL::a + UL::v + UL::i + UL::n + UL::g + wsc;
+			static constexpr auto value = lexy::noop;
+		};
+		// The HAVING keyword
+		static constexpr auto having = dsl::peek(UL::h) >> dsl::p<Having>;
+
+		// Rule that matches the ORDER BY keyword
+		struct OrderBy: lexy::token_production {
+			static constexpr auto rule = UL::o + UL::r + UL::d + UL::e + UL::r + wsp + UL::b + UL::y + wsc;
+			static constexpr auto value = lexy::noop;
+		};
+		// The ORDER BY keyword
+		static constexpr auto orderBy = dsl::peek(UL::o + UL::r) >> dsl::p<OrderBy>;
+
+		// Rule that matches the ASC keyword
+		struct Ascending: lexy::token_production {
+			static constexpr auto rule = UL::a + UL::s + UL::c;
+			static constexpr auto value = lexy::constant(false);
+		};
+		// Rule that matches the DESC keyword
+		struct Descending: lexy::token_production {
+			static constexpr auto rule = UL::d + UL::e + UL::s + UL::c;
+			static constexpr auto value = lexy::constant(true);
+		};
+		// The ASC or DESC keywords (the value is true if the order is descending)
+		static constexpr auto direction = dsl::peek(UL::a) >> dsl::p<Ascending> | dsl::peek(UL::d) >> dsl::p<Descending>;
+
+		// Rule that matches the LIMIT keyword
+		struct Limit: lexy::token_production {
+			static constexpr auto rule = UL::l + UL::i + UL::m + UL::i + UL::t + wsc;
+			static constexpr auto value = lexy::noop;
+		};
+		// The LIMIT keyword
+		static constexpr auto limit = dsl::peek(UL::l + UL::i + UL::m) >> dsl::p<Limit>;
+
+		// Rule that matches the OFFSET keyword
+		struct Offset: lexy::token_production {
+			static constexpr auto rule = UL::o + UL::f + UL::f + UL::s + UL::e + UL::t + wsc;
+			static constexpr auto value = lexy::noop;
+		};
+		// The OFFSET keyword
+		static constexpr auto offset = dsl::peek(UL::o + UL::f) >> dsl::p<Offset>;
+
+		// The keywords which start the clauses following a query's tables (and thus can't be table aliases)
+		static constexpr auto queryClause = where | groupBy | having | orderBy | limit;
+
 		// Rule that matches the AND keyword
 		struct And_: lexy::token_production {
 			static constexpr auto rule = ((UL::a >> UL::n + UL::d) | dsl::lit_c<'&'>) + wsc;
@@ -560,6 +657,31 @@ namespace sql::grammar {
 		};
 		// The ON keyword
 		static constexpr auto on = dsl::peek(UL::o) >> dsl::p<On>;
+
+		// Rule that matches the USING keyword
+		struct Using: lexy::token_production {
+			static constexpr auto rule = UL::u + UL::s + UL::i + UL::n + UL::g + wsc;
+			static constexpr auto value = lexy::noop;
+		};
+		// The USING keyword
+		static constexpr auto using_ = dsl::peek(UL::u) >> dsl::p<Using>;
+
+
+		// --- Table Layout Keywords ---
+
+
+		// Rule that matches the ROW keyword
+		struct Row: lexy::token_production {
+			static constexpr auto rule = UL::r + UL::o + UL::w + dsl::opt(UL::s);
+			static constexpr auto value = lexy::constant(sql::Table::Row);
+		};
+		// Rule that matches the COLUMNAR keyword
+		struct Columnar: lexy::token_production {
+			static constexpr auto rule = UL::c + UL::o + UL::l + UL::u + UL::m + UL::n + UL::a + UL::r;
+			static constexpr auto value = lexy::constant(sql::Table::Columnar);
+		};
+		// The ROW or COLUMNAR keywords
+		static constexpr auto layout = dsl::peek(UL::r) >> dsl::p<Row> | dsl::peek(UL::c) >> dsl::p<Columnar>;
 	} // Keyword
 	namespace KW = Keyword;
 
@@ -687,8 +809,11 @@ namespace sql::grammar {
 			std::variant<Column, Data::Variant> value;
 		};
 
+		// Rule that matches any comparison operator
+		static constexpr auto comparison = dsl::p<EqualComparison> | dsl::p<NotEqualComparison> | dsl::p<LessComparison> | dsl::p<GreaterComparison> | dsl::p<LessEqualComparison> | dsl::p<GreaterEqualComparison>;
+
 		// <id> (= | != | < | > | <= | >=) (<string> | <number> | <bool> | <null> | <id>)
-		static constexpr auto rule = identifier + (dsl::p<EqualComparison> | dsl::p<NotEqualComparison> | dsl::p<LessComparison> | dsl::p<GreaterComparison> | dsl::p<LessEqualComparison> | dsl::p<GreaterEqualComparison>) + (literalVariant | dsl::p<ColumnIdentifier>);
+		static constexpr auto rule = identifier + comparison + (literalVariant | dsl::p<ColumnIdentifier>);
 		static constexpr auto value = lexy::construct<Intermediate> | lexy::callback<WhereAction::Condition>([](Intermediate&& in){
 			WhereAction::Condition out;
 			out.column = in.column;
@@ -708,6 +833,104 @@ namespace sql::grammar {
 	static constexpr auto whereConditions = KW::where >> whereConditionList;
 
 
+	// A rule that matches an aggregate function applied to a column (or to every tuple)
+	struct Aggregate {
+		// <function>(* | <id>)
+		static constexpr auto rule = KW::aggregateFunction + dsl::lit_c<'('> + (wildcard | identifier) + dsl::lit_c<')'>;
+		static constexpr auto value = lexy::construct<ast::QueryTableAction::Aggregate>;
+	};
+	// An aggregate (the function name must be followed by a parenthesis so that columns sharing its name are still identifiers)
+	static constexpr auto aggregate = dsl::peek(KW::aggregateFunction + wss + dsl::lit_c<'('>) >> dsl::p<Aggregate>;
+
+
+	// A rule that matches a having condition (a where condition whose column may instead be an aggregate)
+	struct HavingCondition {
+		// Intermediate struct holding parsed results before they are transformed into a condition
+		struct Intermediate {
+			std::variant<std::string, ast::QueryTableAction::Aggregate> subject;
+			WhereAction::Comparison comparison;
+			std::variant<Column, Data::Variant> value;
+		};
+
+		// (<aggregate> | <id>) (= | != | < | > | <= | >=) (<string> | <number> | <bool> | <null> | <id>)
+		static constexpr auto rule = (aggregate | identifier) + WhereCondition::comparison + (literalVariant | dsl::p<WhereCondition::ColumnIdentifier>);
+		// Aggregates are referenced by name, and are returned alongside the condition so they can be calculated
+		static constexpr auto value = lexy::construct<Intermediate> | lexy::callback<std::pair<WhereAction::Condition, std::optional<ast::QueryTableAction::Aggregate>>>([](Intermediate&& in){
+			std::pair<WhereAction::Condition, std::optional<ast::QueryTableAction::Aggregate>> out;
+			if(in.subject.index() == 0)
+				out.first.column = std::get<std::string>(in.subject);
+			else {
+				out.second = std::get<ast::QueryTableAction::Aggregate>(in.subject);
+				out.first.column = out.second->name();
+			}
+			out.first.comp = in.comparison;
+			out.first.value = flatten(in.value);
+			return out;
+		});
+
+		// A AND separated list of conditions
+		struct List {
+			static constexpr auto rule = dsl::list(dsl::p<HavingCondition>, dsl::sep(KW::And));
+			static constexpr auto value = lexy::as_list<std::vector<std::pair<WhereAction::Condition, std::optional<ast::QueryTableAction::Aggregate>>>>;
+		};
+	};
+	static constexpr auto havingConditions = KW::having >> dsl::p<HavingCondition::List>;
+
+
+	// A rule that matches a column (or aggregate) query results are ordered by, followed by an optional direction
+	struct OrderTerm {
+		// Intermediate struct holding parsed results before they are transformed into an order
+		struct Intermediate {
+			std::variant<std::string, ast::QueryTableAction::Aggregate> subject;
+			std::optional<bool> descending;
+		};
+
+		// (<aggregate> | <id>) (asc | desc)?
+		static constexpr auto rule = (aggregate | identifier) + dsl::opt(KW::direction);
+		// Aggregates are referenced by name, and are returned alongside the order so they can be calculated
+		static constexpr auto value = lexy::construct<Intermediate> | lexy::callback<std::pair<ast::QueryTableAction::OrderBy, std::optional<ast::QueryTableAction::Aggregate>>>([](Intermediate&& in){
+			std::pair<ast::QueryTableAction::OrderBy, std::optional<ast::QueryTableAction::Aggregate>> out;
+			if(in.subject.index() == 0)
+				out.first.column = std::get<std::string>(in.subject);
+			else {
+				out.second = std::get<ast::QueryTableAction::Aggregate>(in.subject);
+				out.first.column = out.second->name();
+			}
+			out.first.descending = in.descending.value_or(false);
+			return out;
+		});
+
+		// A comma separated list of orders
+		struct List {
+			static constexpr auto rule = dsl::list(dsl::p<OrderTerm>, dsl::sep(dsl::comma));
+			static constexpr auto value = lexy::as_list<std::vector<std::pair<ast::QueryTableAction::OrderBy, std::optional<ast::QueryTableAction::Aggregate>>>>;
+		};
+	};
+	static constexpr auto orderBy = KW::orderBy >> dsl::p<OrderTerm::List>;
+
+	// Rule that matches the number of tuples a query is limited to, and the optional number of tuples skipped
+	struct Limit {
+		// A number of tuples, only plain (decimal) unsigned integers are allowed and values too large for a size_t are reported as an overflow
+		struct Count : lexy::token_production {
+			static constexpr auto rule = dsl::integer<size_t>(dsl::digits<>);
+			static constexpr auto value = lexy::forward<size_t>;
+		};
+
+		struct Intermediate {
+			size_t limit;
+			std::optional<size_t> offset;
+		};
+
+		// limit <count> (offset <count>)?
+		static constexpr auto rule = dsl::p<Count> + dsl::opt(KW::offset >> dsl::p<Count>);
+		static constexpr auto value = lexy::construct<Intermediate> | lexy::callback<std::pair<size_t, size_t>>([](Intermediate&& in){
+			return std::pair<size_t, size_t>{in.limit, in.offset.value_or(0)};
+		});
+	};
+	// Limit clause
+	static constexpr auto limit = KW::limit >> dsl::p<Limit>;
+
+
 	// --- Actions ---
 
 
@@ -744,7 +967,7 @@ namespace sql::grammar {
 		});
 	};
 
-	// Rule that matches a table drop
+	// Rule that matches a table or index drop
 	struct DropTableAction {
 		// Data acquired from the parse which needs to be rearranged to fit our data structures
 		struct Intermediate {
@@ -753,8 +976,8 @@ namespace sql::grammar {
 			std::string ident;
 		};
 
-		// drop table <id>;
-		static constexpr auto rule = KW::drop + KW::table + identifier + stop;
+		// drop table/index <id>;
+		static constexpr auto rule = KW::drop + (KW::table | KW::index) + identifier + stop;
 		// Convert the parsed result into a Transcation smart pointer (unified type for all actions)
 		static constexpr auto value = lexy::construct<Intermediate> | lexy::callback<ast::Action::ptr>([](Intermediate&& i) {
 			return std::make_unique<ast::Action>(ast::Action{i.action, ast::Action::Target{i.type, i.ident}});
@@ -769,13 +992,32 @@ namespace sql::grammar {
 			ast::Action::Target::Type type;
 			std::string ident;
 			std::optional<std::vector<Column>> columns;
+			std::optional<sql::Table::Layout> layout;
+		};
+
+		// create table <id> [opt](<id> <type>, ...) [opt]using row/columnar;
+		static constexpr auto rule = KW::create + KW::table + identifier + dsl::opt(dsl::lit_c<'('> >> columnDeclarationList + dsl::lit_c<')'>)
+			+ dsl::opt(KW::using_ >> KW::layout) + stop;
+		// Convert the parsed result into a Transcation smart pointer (unified type for all actions)
+		static constexpr auto value = lexy::construct<Intermediate> | lexy::callback<ast::Action::ptr>([](Intermediate&& i) {
+			return std::make_unique<ast::CreateTableAction>(ast::CreateTableAction{i.action, ast::Action::Target{i.type, i.ident}, i.columns.value_or(std::vector<Column>{}), i.layout.value_or(sql::Table::Row)});
+		});
+	};
+
+	// Rule that matches an index create
+	struct CreateIndexAction {
+		// Data acquired from the parse which needs to be rearranged to fit our data structures
+		struct Intermediate {
+			ast::Action::ActionPerformed action;
+			ast::Action::Target::Type type;
+			std::string ident, table, column;
 		};
 
-		// create table <id> [opt](<id> <type>, ...);
-		static constexpr auto rule = KW::create + KW::table + identifier + dsl::opt(dsl::lit_c<'('> >> columnDeclarationList + dsl::lit_c<')'>) + stop;
+		// create index <id> on <id>(<id>);
+		static constexpr auto rule = KW::create + KW::index + identifier + KW::on + identifier + dsl::lit_c<'('> + identifier + dsl::lit_c<')'> + stop;
 		// Convert the parsed result into a Transcation smart pointer (unified type for all actions)
 		static constexpr auto value = lexy::construct<Intermediate> | lexy::callback<ast::Action::ptr>([](Intermediate&& i) {
-			return std::make_unique<ast::CreateTableAction>(ast::CreateTableAction{i.action, ast::Action::Target{i.type, i.ident}, i.columns.value_or(std::vector<Column>{})});
+			return std::make_unique<ast::CreateIndexAction>(ast::CreateIndexAction{i.action, ast::Action::Target{i.type, i.ident}, i.table, i.column});
 		});
 	};
 
@@ -783,8 +1025,8 @@ namespace sql::grammar {
 	struct QueryTableAction {
 		// Rule that matches a table name with optional alias
 		struct TableAlias {
-			//id id?
-			static constexpr auto rule = identifier + dsl::opt(identifier);
+			//id id? (the keywords starting the query's clauses are never aliases)
+			static constexpr auto rule = identifier + dsl::opt(dsl::peek_not(KW::queryClause) >> dsl::opt(identifier));
 			static constexpr auto value = lexy::callback<sql::ast::QueryTableAction::TableAlias>([](auto&& table, std::optional<std::string>&& alias){
 				return sql::ast::QueryTableAction::TableAlias{table, (alias.has_value() ? *alias : table)};
 			});
@@ -822,21 +1064,70 @@ namespace sql::grammar {
 			static constexpr auto value = lexy::construct<Intermediate>;
 		};
 
+		// Rule that matches a queried column or aggregate
+		struct Selection {
+			static constexpr auto rule = aggregate | identifier;
+			static constexpr auto value = lexy::construct<std::variant<std::string, ast::QueryTableAction::Aggregate>>;
+
+			// A comma separated list of selections
+			struct List {
+				static constexpr auto rule = dsl::list(dsl::p<Selection>, dsl::sep(dsl::comma));
+				static constexpr auto value = lexy::as_list<std::vector<std::variant<std::string, ast::QueryTableAction::Aggregate>>>;
+			};
+		};
+
 		// Data acquired from the parse which needs to be rearranged to fit our data structures
 		struct Intermediate {
 			ast::Action::ActionPerformed action;
-			std::optional<std::vector<std::string>> columns;
+			std::optional<std::vector<std::variant<std::string, ast::QueryTableAction::Aggregate>>> selections;
 			std::variant<Joins::Intermediate, std::vector<sql::ast::QueryTableAction::TableAlias>> variant;
 			std::optional<std::vector<WhereAction::Condition>> conditions;
+			std::optional<std::vector<std::string>> groupBy;
+			std::optional<std::vector<std::pair<WhereAction::Condition, std::optional<ast::QueryTableAction::Aggregate>>>> having;
+			std::optional<std::vector<std::pair<ast::QueryTableAction::OrderBy, std::optional<ast::QueryTableAction::Aggregate>>>> orderBy;
+			std::optional<std::pair<size_t, size_t>> limit;
 		};
 
-		// select */<id>,... from <joins>/<aliasList> (where <conditions>)?;
-		static constexpr auto rule = KW::select + (wildcard | identifierList) + KW::from
-			+ (dsl::lookahead(UL::j, stop) >> dsl::p<Joins> | dsl::else_ >> dsl::p<TableAlias::List>) + dsl::opt(whereConditions) + stop;
+		// select */(<id>/<aggregate>),... from <joins>/<aliasList> (where <conditions>)? (group by <id>,...)? (having <conditions>)? (order by <id>/<aggregate> (asc/desc)?,...)? (limit <number> (offset <number>)?)?;
+		static constexpr auto rule = KW::select + (wildcard | dsl::p<Selection::List>) + KW::from
+			+ (dsl::lookahead(UL::j, stop) >> dsl::p<Joins> | dsl::else_ >> dsl::p<TableAlias::List>) + dsl::opt(whereConditions)
+			+ dsl::opt(KW::groupBy >> identifierList) + dsl::opt(havingConditions) + dsl::opt(orderBy) + dsl::opt(limit) + stop;
 		// Convert the parsed result into a Transcation smart pointer (unified type for all actions)
 		static constexpr auto value = lexy::construct<Intermediate> | lexy::callback<ast::Action::ptr>([](Intermediate&& i) -> ast::Action::ptr {
+			// Split the selections into the queried columns and the aggregates (which remember their position)
 			using wc = sql::Wildcard<std::vector<std::string>>;
-			wc columns = i.columns.has_value() ? (wc)i.columns.value() : (wc)std::nullopt;
+			wc columns = std::nullopt;
+			std::vector<ast::QueryTableAction::Aggregate> aggregates;
+			if(i.selections.has_value()) {
+				columns = std::vector<std::string>{};
+				for(size_t position = 0; position < i.selections->size(); position++) {
+					auto& selection = (*i.selections)[position];
+					if(selection.index() == 0)
+						columns->push_back(std::get<std::string>(selection));
+					else {
+						aggregates.push_back(std::get<ast::QueryTableAction::Aggregate>(selection));
+						aggregates.back().position = position;
+					}
+				}
+			}
+			// Aggregates only referenced by having conditions (or orders) still need to be calculated
+			std::vector<WhereAction::Condition> having;
+			if(i.having.has_value())
+				for(auto& [condition, aggregate]: *i.having) {
+					having.emplace_back(std::move(condition));
+					if(aggregate.has_value())
+						aggregates.emplace_back(std::move(*aggregate));
+				}
+			std::vector<ast::QueryTableAction::OrderBy> orderBy;
+			if(i.orderBy.has_value())
+				for(auto& [order, aggregate]: *i.orderBy) {
+					orderBy.emplace_back(std::move(order));
+					if(aggregate.has_value())
+						aggregates.emplace_back(std::move(*aggregate));
+				}
+
+			auto limit = i.limit.value_or(std::pair<size_t, size_t>{-1, 0});
+
 			std::vector<sql::ast::QueryTableAction::TableAlias> tableAliases;
 			auto conditions = i.conditions.has_value() ? *i.conditions : std::vector<WhereAction::Condition>{};
 			if(i.variant.index() == 0) {
@@ -847,7 +1138,8 @@ namespace sql::grammar {
 					conditions.emplace_back(std::move(con));
 			} else
 				tableAliases = std::move(std::get<1>(i.variant));
-			return std::make_unique<ast::QueryTableAction>(ast::QueryTableAction{i.action, ast::Action::Target{ast::Action::Target::Table, tableAliases.front().table}, conditions, tableAliases, columns});
+			return std::make_unique<ast::QueryTableAction>(ast::QueryTableAction{i.action, ast::Action::Target{ast::Action::Target::Table, tableAliases.front().table}, conditions, tableAliases, columns,
+				aggregates, i.groupBy.value_or(std::vector<std::string>{}), having, orderBy, limit.first, limit.second});
 		});
 	};
 
@@ -943,8 +1235,10 @@ namespace sql::grammar {
 		static constexpr auto whitespace = wsc; // Automatic whitespace
 		static constexpr auto rule = wss + (dsl::peek(KW::create + KW::database) >> dsl::p<DatabaseAction>
 			| dsl::peek(KW::create + KW::table) >> dsl::p<CreateTableAction>
+			| dsl::peek(KW::create + KW::index) >> dsl::p<CreateIndexAction>
 			| dsl::peek(KW::drop + KW::database) >> dsl::p<DatabaseAction>
 			| dsl::peek(KW::drop + KW::table) >> dsl::p<DropTableAction>
+			| dsl::peek(KW::drop + KW::index) >> dsl::p<DropTableAction>
 			| dsl::peek(KW::use) >> dsl::p<UseDatabaseAction>
 			| dsl::peek(KW::select) >> dsl::p<QueryTableAction>
 			| dsl::peek(KW::alter) >> dsl::p<AlterTableAction>
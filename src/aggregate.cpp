@@ -0,0 +1,87 @@
+/*------------------------------------------------------------
+ * Filename: aggregate.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the merging of hash aggregations and the conversion of their running states into result tuples.
+ *------------------------------------------------------------*/
+
+#include "aggregate.hpp"
+
+#include <stdexcept>
+
+namespace sql {
+
+	void HashAggregation::merge(HashAggregation&& other) {
+		// Order the other aggregation's groups by when they were first seen
+		std::vector<const Key*> keys(other.states.size());
+		for(auto& [groupKey, index]: other.groups)
+			keys[index] = &groupKey;
+
+		for(size_t g = 0; g < other.states.size(); g++) {
+			auto [group, inserted] = groups.try_emplace(*keys[g], states.size());
+			if(inserted) {
+				states.emplace_back(std::move(other.states[g]));
+				continue;
+			}
+
+			auto& groupStates = states[group->second];
+			for(size_t i = 0; i < aggregates.size(); i++) {
+				State& state = groupStates[i];
+				State& merged = other.states[g][i];
+				// The extremes are compared before the counts are combined, since an extreme is only valid if a value has been seen
+				if(aggregates[i].function == Function::Min || aggregates[i].function == Function::Max)
+					if(merged.count > 0 && (state.count == 0 || (aggregates[i].function == Function::Min ? merged.extreme < state.extreme : state.extreme < merged.extreme)))
+						state.extreme = std::move(merged.extreme);
+				state.count += merged.count;
+				state.intSum += merged.intSum;
+				state.floatSum += merged.floatSum;
+			}
+		}
+		other.groups.clear();
+		other.states.clear();
+	}
+
+	void HashAggregation::finish(Table& result) {
+		// Aggregating nothing still produces a single group (counts are zero and everything else is null)
+		if(groupColumns.empty() && states.empty()) {
+			groups.try_emplace(Key{}, 0);
+			states.emplace_back(aggregates.size());
+		}
+
+		// Order the groups by when they were first seen
+		std::vector<const Key*> keys(states.size());
+		for(auto& [groupKey, index]: groups)
+			keys[index] = &groupKey;
+
+		for(size_t g = 0; g < states.size(); g++) {
+			Tuple& tuple = result.createEmptyTuple();
+			for(size_t i = 0; i < groupColumns.size(); i++)
+				tuple[i].data = (*keys[g])[i];
+
+			for(size_t i = 0; i < aggregates.size(); i++) {
+				const State& state = states[g][i];
+				Data::Variant& data = tuple[groupColumns.size() + i].data;
+				switch(aggregates[i].function){
+				break; case Function::Count:
+					data = state.count;
+				// Besides counts, aggregates of nothing are null
+				break; case Function::Sum:
+					if(state.count == 0) break;
+					if(aggregates[i].type == DataType::INT) data = state.intSum;
+					else data = state.floatSum + state.intSum;
+				break; case Function::Avg:
+					if(state.count == 0) break;
+					data = (state.floatSum + state.intSum) / state.count;
+				break; case Function::Min:
+				case Function::Max:
+					data = state.extreme;
+				break; default:
+					throw std::runtime_error("Unexpected aggregate");
+				}
+			}
+		}
+	}
+
+} // sql
@@ -0,0 +1,135 @@
+/*------------------------------------------------------------
+ * Filename: aggregate.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides hash aggregation. Rows are streamed through a hash table mapping the values of the grouped columns to the
+ * 				running state of each of the group's aggregates, so only one row per group is ever held in memory.
+ *------------------------------------------------------------*/
+
+#ifndef AGGREGATE_HPP
+#define AGGREGATE_HPP
+
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "SQL.hpp"
+#include "predicate.hpp"
+#include "storage.hpp"
+
+namespace sql {
+
+	// Class which groups rows by the values of some of their columns and computes aggregates over each group
+	class HashAggregation {
+	public:
+		using Function = QueryTableAction::Aggregate::Function;
+
+		// Struct describing one of the aggregates to compute
+		struct Aggregate {
+			Function function;
+			// The aggregated column (or -1 when counting every row)
+			size_t column;
+			// The type of the aggregated column
+			DataType::Type type;
+		};
+
+	private:
+		// Struct holding the running state of an aggregate within a group
+		struct State {
+			// The number of (non-null) values seen
+			int64_t count = 0;
+			// The running sum (integer columns are summed as integers so that their sums are exact)
+			int64_t intSum = 0;
+			double floatSum = 0;
+			// The smallest or largest value seen
+			Data::Variant extreme;
+		};
+
+		// The values of the grouped columns which identify a group
+		using Key = std::vector<Data::Variant>;
+		struct KeyHash {
+			size_t operator()(const Key& key) const {
+				size_t hash = 0;
+				for(auto& data: key)
+					hash = hash * 31 + std::hash<Data::Variant>{}(data);
+				return hash;
+			}
+		};
+
+		std::vector<size_t> groupColumns;
+		std::vector<Aggregate> aggregates;
+		// Map from each group's key to the index of its states (groups are kept in the order they were first seen)
+		std::unordered_map<Key, size_t, KeyHash> groups;
+		std::vector<std::vector<State>> states;
+		// Buffer the current row's key is built in
+		Key key;
+
+		// Function which adds a (non-null) value to an aggregate's state
+		template<typename Variant>
+		static void update(State& state, const Aggregate& aggregate, const Variant& value) {
+			state.count++;
+			switch(aggregate.function){
+			break; case Function::Sum:
+			case Function::Avg:
+				if(auto i = std::get_if<int64_t>(&value)) state.intSum += *i;
+				else if(auto d = std::get_if<double>(&value)) state.floatSum += *d;
+			break; case Function::Min:
+			case Function::Max: {
+				// NOTE: Views are compared against a view of the current extreme, so strings are only copied when they become the new extreme
+				bool better;
+				if constexpr(std::is_same_v<Variant, Data::Variant>)
+					better = aggregate.function == Function::Min ? value < state.extreme : state.extreme < value;
+				else {
+					auto extreme = storage::view(state.extreme);
+					better = aggregate.function == Function::Min ? value < extreme : extreme < value;
+				}
+				if(state.count == 1 || better)
+					state.extreme = own(value);
+			}
+			break; default: break;
+			}
+		}
+
+	public:
+		HashAggregation(std::vector<size_t> groupColumns, std::vector<Aggregate> aggregates)
+			: groupColumns(std::move(groupColumns)), aggregates(std::move(aggregates)), key(this->groupColumns.size()) {}
+
+		// Add a row (either a tuple, or the views of a mapped table's current tuple) to its group
+		template<typename Row>
+		void add(const Row& row) {
+			for(size_t i = 0; i < groupColumns.size(); i++)
+				key[i] = own(cell(row, groupColumns[i]));
+
+			auto [group, inserted] = groups.try_emplace(key, states.size());
+			if(inserted) states.emplace_back(aggregates.size());
+			auto& groupStates = states[group->second];
+
+			for(size_t i = 0; i < aggregates.size(); i++) {
+				auto& aggregate = aggregates[i];
+				// Counting every row doesn't look at the row's data
+				if(aggregate.column == size_t(-1)) {
+					groupStates[i].count++;
+					continue;
+				}
+
+				auto& value = cell(row, aggregate.column);
+				if(value.index() != 0) // Nulls are ignored
+					update(groupStates[i], aggregate, value);
+			}
+		}
+
+		// Merge the groups of another aggregation (computing the same aggregates over the same columns) into this one
+		// NOTE: Groups only the other aggregation has seen are ordered after this aggregation's groups (so merging the aggregations of consecutive morsels in order keeps groups in the order they were first seen)
+		void merge(HashAggregation&& other);
+
+		// Add a tuple to <result> for every group, holding the values of the grouped columns followed by the aggregates
+		// NOTE: The result's columns must already be set, if nothing is grouped a single tuple is always added (even if no rows were added)
+		void finish(Table& result);
+	};
+
+} // sql
+
+#endif // AGGREGATE_HPP
@@ -0,0 +1,373 @@
+/*------------------------------------------------------------
+ * Filename: bufferpool.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the buffer pool's clock eviction, pinning, and dirty page tracking (and the paged files built on it).
+ *------------------------------------------------------------*/
+
+#include "bufferpool.hpp"
+#include "wal.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace sql::storage {
+
+	BufferPool& BufferPool::global() {
+		static BufferPool pool;
+		return pool;
+	}
+
+	BufferPool::FileKey BufferPool::key(const std::filesystem::path& path) {
+		struct stat info;
+		if(stat(path.c_str(), &info) != 0)
+			throw std::runtime_error("Failed to find file " + path.string());
+		return {uint64_t(info.st_dev), uint64_t(info.st_ino)};
+	}
+
+	void BufferPool::writeBack(Frame& frame) {
+		auto file = files.find(frame.file);
+		if(file == files.end() || file->second.fd < 0)
+			throw std::runtime_error("Dirty page belongs to a file which is no longer attached");
+		if(pwrite(file->second.fd, frame.data.get(), pageSize, off_t(frame.page) * pageSize) != pageSize)
+			throw std::runtime_error("Failed to write page");
+		frame.dirty = false;
+		stats.writes++;
+	}
+
+	void BufferPool::evict(Frame& frame) {
+		if(!frame.valid) return;
+		if(frame.dirty)
+			writeBack(frame);
+		lookup.erase({frame.file, frame.page});
+		frame.valid = frame.dirty = frame.referenced = false;
+		stats.evictions++;
+	}
+
+	BufferPool::Frame* BufferPool::addFrame() {
+		frames.emplace_back(std::make_unique<Frame>());
+		frames.back()->data = std::make_unique<char[]>(pageSize);
+		return frames.back().get();
+	}
+
+	BufferPool::Frame* BufferPool::victim() {
+		// If the pool isn't full, simply add a new frame
+		if(frames.size() < capacity)
+			return addFrame();
+
+		// Sweep the clock hand around the frames (twice, so referenced frames get a second chance), evicting the first unreferenced, unpinned frame
+		for(size_t i = 0; i < frames.size() * 2; i++) {
+			Frame& frame = *frames[hand];
+			hand = (hand + 1) % frames.size();
+			if(frame.pins > 0) continue;
+			if(frame.valid && frame.referenced) {
+				frame.referenced = false;
+				continue;
+			}
+
+			evict(frame);
+			return &frame;
+		}
+
+		// If every page is pinned, temporarily grow past the pool's capacity
+		return addFrame();
+	}
+
+	void BufferPool::unpin(Frame* frame) {
+		std::scoped_lock lock(mutex);
+		if(--frame->pins == 0)
+			frame->modifying = false;
+	}
+
+	void BufferPool::discard(const FileKey& file) {
+		// NOTE: Pinned frames keep their data until they are unpinned, but can no longer be looked up
+		for(auto& frame: frames)
+			if(frame->valid && frame->file == file) {
+				lookup.erase({frame->file, frame->page});
+				frame->valid = frame->dirty = frame->referenced = false;
+			}
+	}
+
+	void BufferPool::attach(const FileKey& file, int fd, uint64_t version) {
+		std::scoped_lock lock(mutex);
+		auto& state = files[file];
+		if(state.version != version)
+			discard(file);
+		state.fd = fd;
+		state.version = version;
+	}
+
+	void BufferPool::detach(const FileKey& file) {
+		std::scoped_lock lock(mutex);
+		auto state = files.find(file);
+		if(state == files.end()) return;
+
+		// Any pages that are still dirty were never flushed, so they no longer match the file
+		for(auto& frame: frames)
+			if(frame->valid && frame->file == file && frame->dirty) {
+				discard(file);
+				state->second.version = 0;
+				break;
+			}
+		state->second.fd = -1;
+	}
+
+	void BufferPool::invalidate(const FileKey& file) {
+		std::scoped_lock lock(mutex);
+		discard(file);
+		files.erase(file);
+	}
+
+	BufferPool::Page BufferPool::pin(const FileKey& file, uint32_t page, Snapshot* snapshot) {
+		auto found = lookup.find({file, page});
+		// NOTE: Snapshots can't use a cached page which has unflushed changes (or is being changed), or which has been overwritten since the snapshot was taken
+		if(found != lookup.end() && !(snapshot && (found->second->dirty || found->second->modifying || snapshot->overwritten(page)))) {
+			stats.hits++;
+			found->second->pins++;
+			found->second->referenced = true;
+			return {this, found->second};
+		}
+
+		stats.misses++;
+		auto state = files.find(file);
+		if(state == files.end() || state->second.fd < 0)
+			throw std::runtime_error("Page requested from a file which isn't attached");
+
+		Frame* frame = victim();
+		if(snapshot) {
+			bool restored = snapshot->read(page, frame->data.get());
+			// The cached copy of the page stays cached (as does the current page if the snapshot read an older version), the snapshot's copy is only pinned until it is released
+			if(restored || found != lookup.end()) {
+				frame->pins = 1;
+				return {this, frame};
+			}
+		} else if(pread(state->second.fd, frame->data.get(), pageSize, off_t(page) * pageSize) != pageSize)
+			throw std::runtime_error("Premature end of file");
+		frame->file = file;
+		frame->page = page;
+		frame->pins = 1;
+		frame->valid = frame->referenced = true;
+		lookup[{file, page}] = frame;
+		return {this, frame};
+	}
+
+	BufferPool::Page BufferPool::fetch(const FileKey& file, uint32_t page, Snapshot* snapshot /*= nullptr*/) {
+		std::scoped_lock lock(mutex);
+		return pin(file, page, snapshot);
+	}
+
+	BufferPool::Page BufferPool::modify(const FileKey& file, uint32_t page) {
+		std::scoped_lock lock(mutex);
+		auto found = lookup.find({file, page});
+		// NOTE: A dirty page is only ever pinned by the writer which changed it (writers of a file exclude each other), so only clean pages are copied
+		if(found != lookup.end() && found->second->pins > 0 && !found->second->dirty) {
+			Frame* old = found->second;
+			Frame* frame = victim();
+			std::memcpy(frame->data.get(), old->data.get(), pageSize);
+			// The old frame keeps its data until whoever has it pinned unpins it, but can no longer be looked up
+			old->valid = old->referenced = false;
+			frame->file = file;
+			frame->page = page;
+			frame->pins = 1;
+			frame->valid = frame->referenced = frame->modifying = true;
+			lookup[{file, page}] = frame;
+			stats.hits++;
+			return {this, frame};
+		}
+
+		auto pinned = pin(file, page, nullptr);
+		pinned.frame->modifying = true;
+		return pinned;
+	}
+
+	BufferPool::Page BufferPool::create(const FileKey& file, uint32_t page) {
+		std::scoped_lock lock(mutex);
+		Frame* frame;
+		if(auto found = lookup.find({file, page}); found != lookup.end() && (found->second->pins == 0 || found->second->dirty))
+			frame = found->second;
+		else {
+			// A cached copy someone else has pinned is no longer looked up, but keeps its data until they unpin it
+			if(found != lookup.end())
+				found->second->valid = found->second->referenced = false;
+			frame = victim();
+			frame->file = file;
+			frame->page = page;
+			lookup[{file, page}] = frame;
+		}
+
+		std::memset(frame->data.get(), 0, pageSize);
+		frame->pins++;
+		frame->valid = frame->referenced = frame->dirty = frame->modifying = true;
+		return {this, frame};
+	}
+
+	void BufferPool::flush(const FileKey& file, uint64_t version) {
+		std::scoped_lock lock(mutex);
+		for(auto& frame: frames)
+			if(frame->valid && frame->file == file && frame->dirty)
+				writeBack(*frame);
+		files[file].version = version;
+	}
+
+	void BufferPool::resize(size_t capacity) {
+		std::scoped_lock lock(mutex);
+		this->capacity = std::max<size_t>(capacity, 1);
+
+		// Evict (and remove) unpinned frames until the pool fits in its new capacity
+		for(size_t i = 0; i < frames.size() && frames.size() > this->capacity; )
+			if(frames[i]->pins == 0) {
+				evict(*frames[i]);
+				frames.erase(frames.begin() + i);
+			} else i++;
+		hand = 0;
+	}
+
+	size_t BufferPool::size() {
+		std::scoped_lock lock(mutex);
+		return lookup.size();
+	}
+
+	size_t BufferPool::getCapacity() {
+		std::scoped_lock lock(mutex);
+		return capacity;
+	}
+
+	BufferPool::Statistics BufferPool::statistics() {
+		std::scoped_lock lock(mutex);
+		return stats;
+	}
+
+
+	// --- Paged Files ---
+
+
+	PagedFile::PagedFile(const std::filesystem::path& path, bool writable, bool logged /*= true*/): path(path), logged(logged), header(std::make_unique<char[]>(BufferPool::pageSize)) {
+		// Readers use the file the snapshot has open (which may have since been replaced)
+		if(!writable) {
+			snapshot = takeSnapshot(path);
+			fd = dup(snapshot->descriptor());
+		} else fd = open(path.c_str(), O_RDWR);
+		if(fd < 0)
+			throw std::runtime_error("Failed to open " + path.string());
+
+		struct stat info;
+		fstat(fd, &info);
+		key = {uint64_t(info.st_dev), uint64_t(info.st_ino)};
+
+		try {
+			if(snapshot) snapshot->read(0, header.get());
+			else if(pread(fd, header.get(), BufferPool::pageSize, 0) != BufferPool::pageSize)
+				throw std::runtime_error("Premature end of file");
+		} catch(std::runtime_error&) {
+			close(fd);
+			throw;
+		}
+	}
+
+	PagedFile::~PagedFile() {
+		if(versions) versions->publish();
+		pinned.clear();
+		pool.detach(key);
+		if(fd >= 0) close(fd);
+	}
+
+	void PagedFile::attach(uint64_t version) { pool.attach(key, fd, version); }
+
+	char* PagedFile::page(uint32_t number) {
+		if(number == 0) return header.get();
+
+		auto& page = pinned[number];
+		if(!page) page = snapshot ? pool.fetch(key, number, snapshot.get()) : pool.modify(key, number);
+		return page.data();
+	}
+
+	BufferPool::Page PagedFile::fetch(uint32_t number) { return pool.fetch(key, number, snapshot.get()); }
+
+	char* PagedFile::create(uint32_t number) {
+		auto& page = pinned[number] = pool.create(key, number);
+		return page.data();
+	}
+
+	void PagedFile::markDirty(uint32_t number) {
+		if(number != 0)
+			pinned.at(number).markDirty();
+	}
+
+	void PagedFile::flush(uint64_t version) {
+		// NOTE: Only pinned pages are ever modified and they can't be evicted, so nothing reaches the file before it has been logged
+		// NOTE: The log stays open until the pages have been written, so it can't be checkpointed in between
+		std::optional<WriteAheadLog> log;
+		if(logged) {
+			std::vector<LoggedPage> pages = {{0, header.get()}};
+			for(auto& [number, page]: pinned)
+				if(page.dirty())
+					pages.push_back({number, page.data()});
+			log.emplace(path.parent_path());
+			log->append(WriteAheadLog::Pages, path, pages);
+
+			// Snapshots still need to read what the pages held before (the version is only published once the file is closed, so readers never see part of a statement)
+			if(!versions) versions.emplace(path);
+			std::vector<uint32_t> numbers;
+			for(auto& page: pages)
+				numbers.push_back(page.number);
+			versions->preserve(numbers);
+		}
+
+		pool.flush(key, version);
+		if(pwrite(fd, header.get(), BufferPool::pageSize, 0) != BufferPool::pageSize)
+			throw std::runtime_error("Failed to write file header");
+		pinned.clear();
+	}
+
+	void PagedFile::replace(const std::filesystem::path& path, const char* header, bool logged /*= true*/) {
+		std::optional<WriteAheadLog> log;
+		if(logged) {
+			log.emplace(path.parent_path());
+			log->append(WriteAheadLog::Replace, path, {{0, header}});
+		}
+
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0)
+			throw std::runtime_error("Failed to create " + path.string());
+		bool written = pwrite(fd, header, BufferPool::pageSize, 0) == BufferPool::pageSize;
+		close(fd);
+		if(!written)
+			throw std::runtime_error("Failed to write file header");
+	}
+
+	void PagedFile::remove(const std::filesystem::path& path) {
+		WriteAheadLog log(path.parent_path());
+		log.append(WriteAheadLog::Remove, path);
+		std::filesystem::remove(path);
+		VersionStore::remove(path);
+	}
+
+	std::filesystem::path PagedFile::temporary(const std::filesystem::path& path) {
+		return path.string() + "." + std::to_string(getpid()) + ".tmp";
+	}
+
+	void PagedFile::rename(const std::filesystem::path& from, const std::filesystem::path& to) {
+		// NOTE: The new file must be durable before the rename is, otherwise a crash could leave the renamed file incomplete
+		int fd = open(from.c_str(), O_RDONLY);
+		bool synced = fd >= 0 && fsync(fd) == 0;
+		if(fd >= 0) close(fd);
+		if(!synced)
+			throw std::runtime_error("Failed to sync " + from.string());
+
+		WriteAheadLog log(to.parent_path());
+		log.rename(from, to);
+		// Any of the old file's cached pages will never be used again
+		if(exists(to)) BufferPool::global().invalidate(BufferPool::key(to));
+		std::filesystem::rename(from, to);
+		WriteAheadLog::syncDirectory(to.parent_path());
+	}
+
+} // sql::storage
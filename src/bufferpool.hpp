@@ -0,0 +1,230 @@
+/*------------------------------------------------------------
+ * Filename: bufferpool.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides a process wide cache of file pages (with clock eviction) that is shared across statements, along
+ * 				with page level access to the table and index files whose pages it caches. Every change to a paged file is
+ * 				recorded in its database's write-ahead log before it is written, and files opened for reading are read
+ * 				through a snapshot (so they never see part of a concurrent writer's changes).
+ *------------------------------------------------------------*/
+
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "versions.hpp"
+
+namespace sql::storage {
+
+	// Class which caches pages of files in memory, pages are evicted using the clock algorithm once the pool reaches its capacity
+	class BufferPool {
+	public:
+		// Struct identifying a file (by device and inode, so that the same file is recognized no matter how it is referenced)
+		struct FileKey {
+			uint64_t device = 0, inode = 0;
+
+			bool operator<(const FileKey& o) const { return device < o.device || (device == o.device && inode < o.inode); }
+			bool operator==(const FileKey& o) const { return device == o.device && inode == o.inode; }
+		};
+
+		// Counters describing how effective the pool has been
+		struct Statistics {
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t evictions = 0;
+			uint64_t writes = 0;
+		};
+
+	private:
+		// Struct representing a slot in the pool which can hold a single page
+		struct Frame {
+			FileKey file;
+			uint32_t page = 0;
+			size_t pins = 0;
+			// Set while the frame holds a page that can be looked up (cleared when the page is evicted or discarded)
+			bool valid = false;
+			// Set whenever the frame is used, cleared as the clock hand passes
+			bool referenced = false;
+			// Set if the page has been modified since it was read
+			bool dirty = false;
+			// Set while a writer has the page pinned (it may be partway through changing it), cleared once the frame is unpinned
+			bool modifying = false;
+			std::unique_ptr<char[]> data;
+		};
+
+		// Struct holding the state of a file with pages in the pool
+		struct File {
+			// Descriptor used to write back dirty pages (only valid while the file is attached)
+			int fd = -1;
+			// Version of the file the cached pages came from
+			uint64_t version = 0;
+		};
+
+		// Struct identifying a page in a file
+		struct PageKey {
+			FileKey file;
+			uint32_t page;
+
+			bool operator==(const PageKey& o) const { return file == o.file && page == o.page; }
+			struct Hash { size_t operator()(const PageKey& k) const { return std::hash<uint64_t>{}(k.file.inode * 31 + k.file.device) ^ (std::hash<uint32_t>{}(k.page) << 1); } };
+		};
+
+		std::mutex mutex;
+		std::vector<std::unique_ptr<Frame>> frames;
+		std::unordered_map<PageKey, Frame*, PageKey::Hash> lookup;
+		std::map<FileKey, File> files;
+		// Position of the clock hand in the frames
+		size_t hand = 0;
+		// Maximum number of frames the pool should hold
+		size_t capacity;
+		Statistics stats;
+
+		// Find a frame which can hold a new page (evicting a page if nessicary)
+		Frame* victim();
+		// Add a new empty frame to the pool
+		Frame* addFrame();
+		// Remove a frame's page from the pool, writing it back if it is dirty
+		void evict(Frame& frame);
+		// Write a frame's page back to its file
+		void writeBack(Frame& frame);
+		// Remove all of the cached pages of a file
+		void discard(const FileKey& file);
+		void unpin(Frame* frame);
+
+	public:
+		// The default capacity of the pool (64 MiB worth of 8 KiB pages)
+		constexpr static size_t defaultCapacity = 8192;
+		// Size of the pages held in the pool
+		constexpr static size_t pageSize = 8192;
+
+		// Handle to a page pinned in the pool, the page is unpinned (and may be evicted) once the handle is destroyed
+		class Page {
+			friend class BufferPool;
+			BufferPool* pool = nullptr;
+			Frame* frame = nullptr;
+
+			Page(BufferPool* pool, Frame* frame): pool(pool), frame(frame) {}
+		public:
+			Page() = default;
+			Page(const Page&) = delete;
+			Page(Page&& o): pool(o.pool), frame(o.frame) { o.frame = nullptr; }
+			Page& operator=(Page&& o) { std::swap(pool, o.pool); std::swap(frame, o.frame); return *this; }
+			~Page() { if(frame) pool->unpin(frame); }
+
+			// Check if the handle refers to a page
+			explicit operator bool() const { return frame; }
+			// Get the page's bytes
+			char* data() const { return frame->data.get(); }
+			// Mark the page as modified (it will be written back when its file is flushed or when it is evicted)
+			void markDirty() { frame->dirty = true; }
+			// Check if the page has been modified since it was last written back
+			bool dirty() const { return frame->dirty; }
+		};
+
+	private:
+		// Pin a page (the pool's mutex must be locked)
+		Page pin(const FileKey& file, uint32_t page, Snapshot* snapshot);
+
+	public:
+
+		BufferPool(size_t capacity = defaultCapacity): capacity(capacity) {}
+
+		// The pool shared by the whole process
+		static BufferPool& global();
+
+		// Get the key of the file at the provided path
+		static FileKey key(const std::filesystem::path& path);
+
+		// Attach an open file to the pool, any cached pages are discarded if they came from a different version of the file
+		void attach(const FileKey& file, int fd, uint64_t version);
+		// Detach a file from the pool (its descriptor is about to be closed), unflushed changes are discarded
+		void detach(const FileKey& file);
+		// Discard all of the cached pages of a file
+		void invalidate(const FileKey& file);
+
+		// Pin a page in the pool, reading it from the attached file (or through the provided snapshot) if it isn't cached
+		// NOTE: Pages read through a snapshot are never taken from a frame with unflushed changes (or changes newer than the snapshot), instead they are read into a frame which isn't cached
+		Page fetch(const FileKey& file, uint32_t page, Snapshot* snapshot = nullptr);
+		// Pin a page a writer may modify, if anyone else has the cached page pinned it is first copied into a new frame (so they never see it change)
+		Page modify(const FileKey& file, uint32_t page);
+		// Pin a new zeroed page in the pool (it is marked dirty so it will be written to the attached file), a cached copy pinned by anyone else is left untouched
+		Page create(const FileKey& file, uint32_t page);
+		// Write all of a file's dirty pages back to disk and record the version of the file they now represent
+		void flush(const FileKey& file, uint64_t version);
+
+		// Change the number of pages the pool can hold (evicting pages if nessicary)
+		void resize(size_t capacity);
+		size_t size();
+		size_t getCapacity();
+		Statistics statistics();
+	};
+
+	// Class which provides access to the pages of a file, page 0 (the file's header) is always read directly from disk (so that changes
+	// made by other processes are noticed) while the rest of the pages are pinned in the buffer pool until the file is flushed
+	class PagedFile {
+		int fd = -1;
+		std::filesystem::path path;
+		// Whether changes to the file are recorded in the write-ahead log (scratch files which don't need to survive a crash aren't logged)
+		// NOTE: Only logged files save the pages they overwrite for snapshots, the rest are never read by anyone but their writer
+		bool logged;
+		// The snapshot a file opened for reading is read through
+		std::shared_ptr<Snapshot> snapshot;
+		// The version store the pages a writer overwrites are saved in (opened by the first flush, the new version is published once the file is closed)
+		std::optional<VersionStore> versions;
+		BufferPool& pool = BufferPool::global();
+		BufferPool::FileKey key;
+		std::unique_ptr<char[]> header;
+		// Pages this file has pinned in the buffer pool
+		std::map<uint32_t, BufferPool::Page> pinned;
+
+	public:
+		// The number of pinned pages after which long running operations should flush
+		constexpr static size_t flushThreshold = 256;
+
+		// Open a file and read its header page (throws std::runtime_error if the file can't be opened)
+		// NOTE: Files opened for reading are read through the snapshot of them in the current thread's snapshot set (or a new snapshot if there isn't a set)
+		PagedFile(const std::filesystem::path& path, bool writable, bool logged = true);
+		PagedFile(const PagedFile&) = delete;
+		~PagedFile();
+
+		// Start caching the file's pages in the buffer pool, any pages cached from a different version of the file are discarded
+		void attach(uint64_t version);
+
+		// Get a page (pinning it in the buffer pool until the file is flushed)
+		// NOTE: Writable files pin the pages they may modify, so that readers in the same process never see them partway through a change
+		char* page(uint32_t number);
+		// Pin a page only until the returned handle is destroyed (used by scans so they don't pin the whole file)
+		BufferPool::Page fetch(uint32_t number);
+		// Pin a new zeroed page
+		char* create(uint32_t number);
+		// Mark a page as needing to be written back to disk
+		void markDirty(uint32_t number);
+		// The number of pages currently pinned by this file
+		size_t pinnedPages() { return pinned.size(); }
+
+		// Log all of the modified pages (and the header page) in the write-ahead log and save their old contents for snapshots, then write them back to disk (recording the version of the file they now represent) and unpin all of the pages
+		void flush(uint64_t version);
+
+		// Create (or replace) a file holding only the provided header page, the replacement is logged in the write-ahead log first (if <logged>)
+		static void replace(const std::filesystem::path& path, const char* header, bool logged = true);
+		// Remove a file, the removal is logged in the write-ahead log first
+		static void remove(const std::filesystem::path& path);
+		// Get the path of a temporary file (in the same directory) a replacement for a file can be built in
+		static std::filesystem::path temporary(const std::filesystem::path& path);
+		// Atomically replace a file with another (complete) file: the new file is synced, the rename is logged in the write-ahead log, then the file is renamed over the old one (and the directory synced)
+		static void rename(const std::filesystem::path& from, const std::filesystem::path& to);
+	};
+
+} // sql::storage
+
+#endif // BUFFER_POOL_HPP
@@ -0,0 +1,356 @@
+/*------------------------------------------------------------
+ * Filename: index.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the B+tree backing secondary indexes (bulk building, insertion, removal, and range scans).
+ *------------------------------------------------------------*/
+
+#include "index.hpp"
+
+#include <algorithm>
+
+namespace sql::storage {
+
+	// Helpers which access the pieces of a page
+	static IndexHeader& indexHeader(char* page) { return *reinterpret_cast<IndexHeader*>(page); }
+	static NodeHeader& nodeHeader(char* page) { return *reinterpret_cast<NodeHeader*>(page); }
+
+	// Helper which calculates the size of an encoded key
+	static size_t keySize(const Data::Variant& key) {
+		return 1 + std::visit([](const auto& value) -> size_t {
+			using T = std::decay_t<decltype(value)>;
+			if constexpr(std::is_same_v<T, std::monostate>) return 0;
+			else if constexpr(std::is_same_v<T, std::string>) return sizeof(uint32_t) + value.size();
+			else return sizeof(T);
+		}, key);
+	}
+	// The size of an encoded record ID
+	constexpr size_t ridSize = sizeof(uint32_t) + sizeof(uint16_t);
+
+	// Helpers which de/encode an entry (the key followed by the record ID)
+	static void encodeEntry(Writer& out, const IndexEntry& entry) {
+		encodeData(out, Data{entry.key});
+		out << entry.rid.page << entry.rid.slot;
+	}
+	static void decodeEntry(Reader& in, Column& keyColumn, IndexEntry& entry) {
+		Data key = Data::null(&keyColumn);
+		decodeData(in, key);
+		entry.key = std::move(key.data);
+		in >> entry.rid.page >> entry.rid.slot;
+	}
+
+	Data::Variant indexKey(const Data::Variant& value) {
+		if(auto str = std::get_if<std::string>(&value); str && str->size() > maxIndexedStringSize)
+			return str->substr(0, maxIndexedStringSize);
+		return value;
+	}
+
+
+	// --- Nodes ---
+
+
+	Index::Node Index::readNode(uint32_t number) {
+		if(number == noPage || number >= header.pageCount)
+			throw std::runtime_error("Page out of bounds");
+		// NOTE: The page is only pinned while it is decoded, so scans don't pin the whole index
+		auto page = file.fetch(number);
+		char* data = page.data();
+		auto& nodeHeader = sql::storage::nodeHeader(data);
+
+		Node node;
+		node.leaf = nodeHeader.leaf;
+		node.next = nodeHeader.next;
+		node.entries.resize(nodeHeader.entryCount);
+		if(!node.leaf) node.children.push_back(node.next);
+
+		Reader in(data + sizeof(NodeHeader), data + pageSize);
+		for(auto& entry: node.entries) {
+			decodeEntry(in, keyColumn, entry);
+			if(!node.leaf) {
+				uint32_t child;
+				in >> child;
+				node.children.push_back(child);
+			}
+		}
+		return node;
+	}
+
+	void Index::writeNode(uint32_t number, const Node& node) {
+		std::vector<char> buffer;
+		buffer.reserve(encodedSize(node));
+		Writer out(buffer);
+		out << NodeHeader{uint16_t(node.leaf), uint16_t(node.entries.size()), node.leaf ? node.next : node.children.front()};
+		for(size_t i = 0; i < node.entries.size(); i++) {
+			encodeEntry(out, node.entries[i]);
+			if(!node.leaf) out << node.children[i + 1];
+		}
+		if(buffer.size() > pageSize)
+			throw std::runtime_error("Index node is too large to fit in a page");
+
+		char* data = file.page(number);
+		std::memcpy(data, buffer.data(), buffer.size());
+		file.markDirty(number);
+	}
+
+	size_t Index::encodedSize(const Node& node) {
+		size_t size = sizeof(NodeHeader);
+		for(auto& entry: node.entries)
+			size += keySize(entry.key) + ridSize + (node.leaf ? 0 : sizeof(uint32_t));
+		return size;
+	}
+
+	uint32_t Index::allocatePage() {
+		uint32_t number = header.pageCount++;
+		file.create(number);
+		return number;
+	}
+
+
+	// --- Index ---
+
+
+	Index::Index(const std::filesystem::path& path, bool writable, bool logged /*= true*/): file(path, writable, logged) {
+		char* page = file.page(0);
+		header = indexHeader(page);
+		if(std::string_view(header.magic, sizeof(header.magic)) != indexMagic)
+			throw std::runtime_error("Not an index file");
+		if(header.version != indexFormatVersion || header.pageSize != pageSize)
+			throw std::runtime_error("Unsupported index file version");
+		if(sizeof(IndexHeader) + header.metadataSize > pageSize)
+			throw std::runtime_error("Index metadata is corrupted");
+
+		Reader in(page + sizeof(IndexHeader), page + sizeof(IndexHeader) + header.metadataSize);
+		in >> table >> column;
+		keyColumn = Column(column, {DataType::Type(header.keyType)});
+
+		// Any pages cached from an older version of the file (or the index a shadow is a copy of) will be discarded
+		char* original = file.originalHeader();
+		file.attach(header.modification, original ? indexHeader(original).modification : 0);
+	}
+
+	void Index::create(const std::filesystem::path& path, const std::string& table, const Column& column, std::vector<IndexEntry> entries) {
+		// Build the header page
+		std::vector<char> headerPage(pageSize, 0);
+		std::vector<char> metadata;
+		Writer out(metadata);
+		out << table << column.name;
+		if(sizeof(IndexHeader) + metadata.size() > pageSize)
+			throw std::runtime_error("Index metadata is too large to fit in a page");
+
+		IndexHeader& header = indexHeader(headerPage.data());
+		std::memcpy(header.magic, indexMagic.data(), sizeof(header.magic));
+		header.version = indexFormatVersion;
+		header.pageSize = pageSize;
+		header.pageCount = 1;
+		header.root = noPage;
+		header.keyType = column.type.type;
+		header.metadataSize = metadata.size();
+		header.modification = newModification();
+		std::memcpy(headerPage.data() + sizeof(IndexHeader), metadata.data(), metadata.size());
+
+		// A rewritten shadow is built in place, any other index is built in a temporary file which is then renamed over the file, so a crash leaves either the old index or the new one
+		bool shadow = isRewrittenShadow(path);
+		auto target = shadow ? path : PagedFile::temporary(path);
+		PagedFile::replace(target, headerPage.data(), /*logged*/ false);
+
+		try {
+			// Then build the tree from the bottom up: the sorted entries are packed into leaves left to right, then each level of internal nodes is packed from the level below it
+			Index index(target, /*writable*/ true, /*logged*/ false);
+			for(auto& entry: entries)
+				entry.key = indexKey(entry.key);
+			std::sort(entries.begin(), entries.end());
+			entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+			// The first entry of each node on the level being built (used as the separators of the level above) and the node's page
+			std::vector<std::pair<IndexEntry, uint32_t>> level;
+			Node node;
+			uint32_t number = index.allocatePage();
+			size_t size = sizeof(NodeHeader);
+			for(auto& entry: entries) {
+				size_t entrySize = keySize(entry.key) + ridSize;
+				// If the entry doesn't fit in the current leaf, start a new one
+				if(size + entrySize > pageSize) {
+					uint32_t next = index.allocatePage();
+					node.next = next;
+					index.writeNode(number, node);
+					level.emplace_back(node.entries.front(), number);
+					node = {};
+					number = next;
+					size = sizeof(NodeHeader);
+				}
+				node.entries.push_back(std::move(entry));
+				size += entrySize;
+
+				if(index.file.pinnedPages() > PagedFile::flushThreshold)
+					index.flush();
+			}
+			index.writeNode(number, node);
+			level.emplace_back(node.entries.empty() ? IndexEntry{} : node.entries.front(), number);
+
+			while(level.size() > 1) {
+				std::vector<std::pair<IndexEntry, uint32_t>> parents;
+				Node parent;
+				parent.leaf = false;
+				for(auto& [first, child]: level) {
+					size_t entrySize = keySize(first.key) + ridSize + sizeof(uint32_t);
+					if(parent.children.empty()) {
+						parent.children.push_back(child);
+						parents.emplace_back(first, noPage);
+					} else if(index.encodedSize(parent) + entrySize > pageSize) {
+						uint32_t parentNumber = index.allocatePage();
+						index.writeNode(parentNumber, parent);
+						parents.back().second = parentNumber;
+						parent = {};
+						parent.leaf = false;
+						parent.children.push_back(child);
+						parents.emplace_back(first, noPage);
+					} else {
+						parent.entries.push_back(first);
+						parent.children.push_back(child);
+					}
+				}
+				uint32_t parentNumber = index.allocatePage();
+				index.writeNode(parentNumber, parent);
+				parents.back().second = parentNumber;
+				level = std::move(parents);
+
+				if(index.file.pinnedPages() > PagedFile::flushThreshold)
+					index.flush();
+			}
+
+			index.header.root = level.front().second;
+			index.header.entryCount = entries.size();
+			index.flush();
+		} catch(...) {
+			if(!shadow) std::filesystem::remove(target);
+			throw;
+		}
+		if(!shadow) PagedFile::rename(target, path);
+	}
+
+	std::optional<std::pair<IndexEntry, uint32_t>> Index::insert(uint32_t number, const IndexEntry& entry) {
+		Node node = readNode(number);
+		auto position = std::upper_bound(node.entries.begin(), node.entries.end(), entry);
+		if(node.leaf) {
+			// The entry is already present
+			if(position != node.entries.begin() && *(position - 1) == entry)
+				return {};
+			node.entries.insert(position, entry);
+			header.entryCount++;
+		} else {
+			size_t child = position - node.entries.begin();
+			auto split = insert(node.children[child], entry);
+			if(!split) return {};
+			node.entries.insert(node.entries.begin() + child, split->first);
+			node.children.insert(node.children.begin() + child + 1, split->second);
+		}
+
+		// If the node still fits in its page we are done
+		if(encodedSize(node) <= pageSize) {
+			writeNode(number, node);
+			return {};
+		}
+
+		// Otherwise split the node in half, leaves copy their middle entry up to the parent while internal nodes move it up
+		Node right;
+		right.leaf = node.leaf;
+		size_t middle = node.entries.size() / 2;
+		IndexEntry separator = node.entries[middle];
+		uint32_t rightNumber = allocatePage();
+		if(node.leaf) {
+			right.entries.assign(node.entries.begin() + middle, node.entries.end());
+			right.next = node.next;
+			node.next = rightNumber;
+		} else {
+			right.entries.assign(node.entries.begin() + middle + 1, node.entries.end());
+			right.children.assign(node.children.begin() + middle + 1, node.children.end());
+			node.children.resize(middle + 1);
+		}
+		node.entries.resize(middle);
+
+		writeNode(number, node);
+		writeNode(rightNumber, right);
+		return std::make_pair(separator, rightNumber);
+	}
+
+	void Index::insert(IndexEntry entry) {
+		entry.key = indexKey(entry.key);
+		auto split = insert(header.root, entry);
+		// If the root was split, the tree grows a new root
+		if(split) {
+			Node root;
+			root.leaf = false;
+			root.entries.push_back(split->first);
+			root.children = {header.root, split->second};
+			header.root = allocatePage();
+			writeNode(header.root, root);
+		}
+	}
+
+	uint32_t Index::findLeaf(const IndexEntry& entry) {
+		uint32_t number = header.root;
+		for(size_t depth = 0; ; depth++) {
+			// A tree can't be deeper than the file has pages
+			if(depth > header.pageCount)
+				throw std::runtime_error("Index tree contains a cycle");
+
+			Node node = readNode(number);
+			if(node.leaf) return number;
+			number = node.children[std::upper_bound(node.entries.begin(), node.entries.end(), entry) - node.entries.begin()];
+		}
+	}
+
+	bool Index::erase(IndexEntry entry) {
+		entry.key = indexKey(entry.key);
+		uint32_t number = findLeaf(entry);
+		Node node = readNode(number);
+		auto position = std::lower_bound(node.entries.begin(), node.entries.end(), entry);
+		if(position == node.entries.end() || *position != entry)
+			return false;
+
+		node.entries.erase(position);
+		writeNode(number, node);
+		header.entryCount--;
+		return true;
+	}
+
+	std::vector<RecordID> Index::scan(const std::optional<Data::Variant>& lower, const std::optional<Data::Variant>& upper) {
+		std::optional<Data::Variant> upperKey;
+		if(upper) upperKey = indexKey(*upper);
+
+		// Start at the leaf holding the lower bound (the smallest record ID sorts before any real record), or the leftmost leaf if there isn't one
+		IndexEntry start{lower ? indexKey(*lower) : Data::Variant{}, RecordID{0, 0}};
+		uint32_t number = lower ? findLeaf(start) : noPage;
+		if(!lower) {
+			number = header.root;
+			for(Node node = readNode(number); !node.leaf; node = readNode(number))
+				number = node.children.front();
+		}
+
+		// Then walk the leaves until an entry passes the upper bound
+		std::vector<RecordID> rids;
+		for(size_t visited = 0; number != noPage; visited++) {
+			if(visited > header.pageCount)
+				throw std::runtime_error("Index leaves contain a cycle");
+
+			Node node = readNode(number);
+			auto position = lower ? std::lower_bound(node.entries.begin(), node.entries.end(), start) : node.entries.begin();
+			for(; position != node.entries.end(); position++) {
+				if(upperKey && *upperKey < position->key)
+					return rids;
+				rids.push_back(position->rid);
+			}
+			number = node.next;
+		}
+		return rids;
+	}
+
+	void Index::flush() {
+		header.modification = newModification();
+		indexHeader(file.page(0)) = header;
+		file.flush(header.modification);
+	}
+
+} // sql::storage
@@ -0,0 +1,137 @@
+/*------------------------------------------------------------
+ * Filename: index.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides the on disk B+tree used by secondary indexes. Index files are split into the same fixed size pages
+ * 				as table files: a header page (naming the indexed table and column) followed by the tree's nodes, whose
+ * 				leaves map the values of the indexed column to the record IDs of the tuples holding them.
+ *------------------------------------------------------------*/
+
+#ifndef INDEX_HPP
+#define INDEX_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SQL.hpp"
+#include "bufferpool.hpp"
+#include "storage.hpp"
+
+namespace sql::storage {
+
+	// Magic bytes identifying an index file
+	constexpr std::string_view indexMagic = "SQLINDEX";
+	// Version of the index file format
+	constexpr uint32_t indexFormatVersion = 1;
+	// The longest string key stored in an index, longer strings are truncated (so a node can always hold several keys)
+	constexpr size_t maxIndexedStringSize = 256;
+
+	// Header found at the very start of the header page (page 0) of every index file, the names of the indexed table and column immediately follow it
+	struct IndexHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t pageSize;
+		// The number of pages in the file
+		uint32_t pageCount;
+		// The root node of the tree
+		uint32_t root;
+		// The number of entries stored in the tree
+		uint64_t entryCount;
+		// Type of the indexed column (DataType::Type)
+		uint32_t keyType;
+		// Size of the names which immediately follow the header
+		uint32_t metadataSize;
+		// Random value regenerated every time the file is modified (used to detect when cached pages are out of date)
+		uint64_t modification;
+	};
+
+	// Header found at the start of every node page, the node's encoded entries follow it
+	struct NodeHeader {
+		// Non-zero if the node is a leaf
+		uint16_t leaf;
+		// The number of entries stored in the node
+		uint16_t entryCount;
+		// In leaves the next leaf (so ranges can be scanned without returning to the parent), in internal nodes the leftmost child
+		uint32_t next;
+	};
+
+	// Entry in an index, entries are ordered by their key and then by their record ID (so duplicate keys are still unique entries)
+	struct IndexEntry {
+		Data::Variant key;
+		RecordID rid;
+
+		bool operator<(const IndexEntry& o) const {
+			if(key != o.key) return key < o.key;
+			if(rid.page != o.rid.page) return rid.page < o.rid.page;
+			return rid.slot < o.rid.slot;
+		}
+		bool operator==(const IndexEntry& o) const { return key == o.key && rid.page == o.rid.page && rid.slot == o.rid.slot; }
+		bool operator!=(const IndexEntry& o) const { return !(*this == o); }
+	};
+
+	// Function which converts a value into the key that would be stored in an index (long strings are truncated)
+	// NOTE: Truncation preserves the ordering of keys, but different strings may share a key so lookups need to be rechecked
+	Data::Variant indexKey(const Data::Variant& value);
+
+	// Class which provides access to an index file's B+tree
+	// NOTE: Nodes are split when they overflow, but they are never merged (empty leaves are simply skipped while scanning)
+	class Index {
+		ShadowedFile file;
+		// Column describing the type of the keys (used to de/encode them)
+		Column keyColumn;
+
+		// Struct holding a decoded node, internal nodes have one more child than they have entries (child i holds the entries less than entry i)
+		struct Node {
+			bool leaf = true;
+			uint32_t next = noPage;
+			std::vector<IndexEntry> entries;
+			std::vector<uint32_t> children;
+		};
+
+		// De/encode a node to/from its page
+		Node readNode(uint32_t number);
+		void writeNode(uint32_t number, const Node& node);
+		// Calculate the size of a node once it has been encoded
+		size_t encodedSize(const Node& node);
+		// Add a new page to the end of the file
+		uint32_t allocatePage();
+
+		// Insert an entry into the subtree rooted at the provided node, returns the separator and new right sibling if the node was split
+		std::optional<std::pair<IndexEntry, uint32_t>> insert(uint32_t number, const IndexEntry& entry);
+		// Find the leaf which would hold the provided entry
+		uint32_t findLeaf(const IndexEntry& entry);
+
+	public:
+		// Copy of the header stored in page 0
+		IndexHeader header;
+		// The names of the indexed table and column
+		std::string table, column;
+
+		// Open an index file (throws std::runtime_error if the file is corrupted)
+		// NOTE: Changes to indices opened with <logged> false (and to shadows of indices) aren't recorded in the write-ahead log
+		Index(const std::filesystem::path& path, bool writable, bool logged = true);
+
+		// Create a new index file (replacing any existing file) holding the provided entries
+		// NOTE: A rewritten shadow (see createShadow) is built in place, so the new index is only written once the shadow is committed
+		static void create(const std::filesystem::path& path, const std::string& table, const Column& column, std::vector<IndexEntry> entries);
+
+		// Add an entry to the index
+		void insert(IndexEntry entry);
+		// Remove an entry from the index, returns false if it wasn't present
+		bool erase(IndexEntry entry);
+		// Find the record IDs of every entry whose key is within the (inclusive) bounds, a missing bound is unbounded
+		std::vector<RecordID> scan(const std::optional<Data::Variant>& lower, const std::optional<Data::Variant>& upper);
+
+		// Write all of the modified pages (and the header) back to disk
+		void flush();
+	};
+
+} // sql::storage
+
+#endif // INDEX_HPP
@@ -0,0 +1,281 @@
+/*------------------------------------------------------------
+ * Filename: locks.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the lock manager's lock table, wait queues, and deadlock detection.
+ *------------------------------------------------------------*/
+
+#include "locks.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+namespace sql::storage {
+
+	// Header found at the start of the lock table (the requests follow it)
+	struct TableHeader {
+		char magic[8];
+		// The ticket the next request will be given
+		uint64_t nextTicket;
+	};
+	constexpr std::string_view tableMagic = "SQLLOCKS";
+
+	std::mutex LockManager::mutex;
+	std::condition_variable LockManager::released;
+	std::vector<std::function<void()>> LockManager::listeners;
+
+	// Counter used to give each of the process's sessions a unique ID
+	static std::atomic<uint32_t> nextSession = 1;
+
+	// Function which hashes the name of a resource (FNV-1a), sessions only ever compare the hashes so a collision can only cause a request to wait unnessicarily
+	static uint64_t hashResource(const std::string& resource) {
+		uint64_t hash = 14695981039346656037ull;
+		for(char c: resource) {
+			hash ^= uint8_t(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Function which gets a single number identifying the session which made a request
+	static uint64_t owner(const LockManager::Request& request) { return (uint64_t(uint32_t(request.pid)) << 32) | request.session; }
+
+	// Class which flock's the lock table until it is destroyed
+	struct TableLock {
+		int fd;
+		TableLock(int fd): fd(fd) {
+			if(flock(fd, LOCK_EX) != 0)
+				throw std::runtime_error("Failed to lock the lock table");
+		}
+		~TableLock() { flock(fd, LOCK_UN); }
+	};
+
+
+	LockManager::LockManager(const std::filesystem::path& directory): path(directory / fileName), session(nextSession++) {
+		fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if(fd < 0)
+			throw std::runtime_error("Failed to open " + path.string());
+	}
+
+	LockManager::~LockManager() {
+		try {
+			releaseAll();
+		} catch(const std::runtime_error&) {}
+		close(fd);
+	}
+
+	uint64_t LockManager::load(std::vector<Request>& requests) {
+		requests.clear();
+		TableHeader header;
+		if(pread(fd, &header, sizeof(header), 0) != sizeof(header) || std::string_view(header.magic, sizeof(header.magic)) != tableMagic)
+			return 1;
+
+		struct stat info;
+		if(fstat(fd, &info) != 0)
+			throw std::runtime_error("Failed to read " + path.string());
+		size_t count = (info.st_size - sizeof(TableHeader)) / sizeof(Request);
+		requests.resize(count);
+		if(pread(fd, requests.data(), count * sizeof(Request), sizeof(TableHeader)) != ssize_t(count * sizeof(Request)))
+			throw std::runtime_error("Failed to read " + path.string());
+
+		// The locks of processes which have exited (or crashed) are no longer held
+		pid_t self = getpid();
+		requests.erase(std::remove_if(requests.begin(), requests.end(), [self](const Request& request) {
+			return request.pid != self && kill(request.pid, 0) != 0 && errno == ESRCH;
+		}), requests.end());
+		return header.nextTicket;
+	}
+
+	void LockManager::store(const std::vector<Request>& requests, uint64_t nextTicket) {
+		TableHeader header;
+		std::memcpy(header.magic, tableMagic.data(), sizeof(header.magic));
+		header.nextTicket = nextTicket;
+
+		std::vector<char> buffer(sizeof(TableHeader) + requests.size() * sizeof(Request));
+		std::memcpy(buffer.data(), &header, sizeof(header));
+		std::memcpy(buffer.data() + sizeof(TableHeader), requests.data(), requests.size() * sizeof(Request));
+		if(pwrite(fd, buffer.data(), buffer.size(), 0) != ssize_t(buffer.size()) || ftruncate(fd, buffer.size()) != 0)
+			throw std::runtime_error("Failed to write " + path.string());
+	}
+
+	bool LockManager::owns(const Request& request) const { return request.pid == getpid() && request.session == session; }
+
+	bool LockManager::blocks(const Request& other, const Request& request) {
+		if(other.resource != request.resource || owner(other) == owner(request)) return false;
+		if(compatible(other.mode, request.mode)) return false;
+		return other.granted || other.ticket < request.ticket;
+	}
+
+	bool LockManager::deadlocked(const std::vector<Request>& requests, const Request& request) const {
+		// Build the waits-for graph (an edge from every waiting session to each of the sessions whose requests block it)
+		std::map<uint64_t, std::set<uint64_t>> waitsFor;
+		for(auto& waiting: requests)
+			if(!waiting.granted)
+				for(auto& other: requests)
+					if(blocks(other, waiting))
+						waitsFor[owner(waiting)].insert(owner(other));
+
+		// Search for a path from the sessions the request waits for back to this session
+		std::vector<uint64_t> stack;
+		std::set<uint64_t> visited;
+		for(auto& other: requests)
+			if(blocks(other, request))
+				stack.push_back(owner(other));
+		while(!stack.empty()) {
+			uint64_t next = stack.back();
+			stack.pop_back();
+			if(next == owner(request)) return true;
+			if(!visited.insert(next).second) continue;
+			for(uint64_t waited: waitsFor[next])
+				stack.push_back(waited);
+		}
+		return false;
+	}
+
+	LockManager::Result LockManager::attempt(const std::string& resource, Mode mode, const std::string& parent, bool expired) {
+		Request request{hashResource(resource), parent.empty() ? 0 : hashResource(parent), getpid(), session, 0, mode, false, {}};
+		TableLock tableLock(fd);
+		std::vector<Request> requests;
+		uint64_t nextTicket = load(requests);
+
+		// Find this session's request (recording it if it hasn't been recorded yet)
+		auto waiting = std::find_if(requests.begin(), requests.end(), [&](const Request& r) { return owns(r) && r.resource == request.resource && !r.granted; });
+		if(waiting == requests.end()) {
+			// If the session already holds the lock (in a strong enough mode) there is nothing to wait for
+			bool upgrade = false;
+			for(auto& r: requests)
+				if(owns(r) && r.resource == request.resource && r.granted) {
+					if(covers(r.mode, mode)) return Granted;
+					upgrade = true;
+					// Neither of two incomparable modes covers the other, so the lock is upgraded to exclusive
+					if(!covers(mode, r.mode)) mode = Exclusive;
+				}
+			request.mode = mode;
+
+			// NOTE: Upgrades are queued ahead of every other request, the weaker lock they hold would block most requests made after them anyway
+			request.ticket = upgrade ? 0 : nextTicket++;
+			requests.push_back(request);
+			waiting = requests.end() - 1;
+		}
+		request = *waiting;
+
+		// Grant the request if nothing blocks it
+		if(std::none_of(requests.begin(), requests.end(), [&](const Request& other) { return blocks(other, request); })) {
+			waiting->granted = true;
+			// An upgraded lock replaces the weaker lock it was upgraded from
+			requests.erase(std::remove_if(requests.begin(), requests.end(), [&](const Request& r) {
+				return owns(r) && r.resource == request.resource && r.granted && r.mode != request.mode;
+			}), requests.end());
+			store(requests, nextTicket);
+			return Granted;
+		}
+
+		// Otherwise withdraw the request if waiting for it would deadlock (or it has waited too long)
+		Result result = Waiting;
+		if(deadlocked(requests, request)) result = Deadlock;
+		else if(expired) result = TimedOut;
+		if(result != Waiting) {
+			requests.erase(waiting);
+			store(requests, nextTicket);
+			// Requests queued behind the withdrawn request may now be grantable
+			notifyReleased();
+			return result;
+		}
+		store(requests, nextTicket);
+		return Waiting;
+	}
+
+	void LockManager::notifyReleased() {
+		released.notify_all();
+		for(auto& listener: listeners)
+			listener();
+		listeners.clear();
+	}
+
+	LockManager::Result LockManager::acquire(const std::string& resource, Mode mode, std::chrono::milliseconds timeout, const std::string& parent /*= {}*/) {
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		std::unique_lock lock(mutex);
+		while(true) {
+			Result result = attempt(resource, mode, parent, std::chrono::steady_clock::now() >= deadline);
+			if(result != Waiting) return result;
+
+			// Wait for a session in this process to release a lock (or for long enough that a session in another process could have)
+			released.wait_for(lock, std::chrono::milliseconds(pollInterval));
+		}
+	}
+
+	LockManager::Result LockManager::tryAcquire(const std::string& resource, Mode mode, bool expired /*= false*/, const std::string& parent /*= {}*/) {
+		std::scoped_lock lock(mutex);
+		return attempt(resource, mode, parent, expired);
+	}
+
+	void LockManager::whenReleased(std::function<void()> listener) {
+		std::scoped_lock lock(mutex);
+		listeners.push_back(std::move(listener));
+	}
+
+	void LockManager::release(const std::string& resource) {
+		uint64_t hash = hashResource(resource);
+		std::scoped_lock lock(mutex);
+		TableLock tableLock(fd);
+		std::vector<Request> requests;
+		uint64_t nextTicket = load(requests);
+
+		auto end = std::remove_if(requests.begin(), requests.end(), [&](const Request& r) { return owns(r) && r.resource == hash; });
+		if(end == requests.end()) return;
+		requests.erase(end, requests.end());
+		store(requests, nextTicket);
+		notifyReleased();
+	}
+
+	void LockManager::releaseChildren(const std::string& parent) {
+		uint64_t hash = hashResource(parent);
+		std::scoped_lock lock(mutex);
+		TableLock tableLock(fd);
+		std::vector<Request> requests;
+		uint64_t nextTicket = load(requests);
+
+		auto end = std::remove_if(requests.begin(), requests.end(), [&](const Request& r) { return owns(r) && r.parent == hash; });
+		if(end == requests.end()) return;
+		requests.erase(end, requests.end());
+		store(requests, nextTicket);
+		notifyReleased();
+	}
+
+	void LockManager::releaseAll() {
+		std::scoped_lock lock(mutex);
+		TableLock tableLock(fd);
+		std::vector<Request> requests;
+		uint64_t nextTicket = load(requests);
+
+		auto end = std::remove_if(requests.begin(), requests.end(), [&](const Request& r) { return owns(r); });
+		if(end == requests.end()) return;
+		requests.erase(end, requests.end());
+		store(requests, nextTicket);
+		notifyReleased();
+	}
+
+	bool LockManager::holds(const std::string& resource, Mode mode /*= Shared*/) {
+		uint64_t hash = hashResource(resource);
+		std::scoped_lock lock(mutex);
+		TableLock tableLock(fd);
+		std::vector<Request> requests;
+		load(requests);
+
+		return std::any_of(requests.begin(), requests.end(), [&](const Request& r) { return owns(r) && r.resource == hash && r.granted && covers(r.mode, mode); });
+	}
+
+} // sql::storage
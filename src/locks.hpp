@@ -0,0 +1,137 @@
+/*------------------------------------------------------------
+ * Filename: locks.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides the lock manager which coordinates writers (in any process) using a database. Every lock request
+ * 				is recorded in the database's lock table file (which is itself flock'ed while it is read or changed), requests
+ * 				are granted in the order they were made (shared requests can be granted together), and a request which can't
+ * 				be granted waits until it can, its timeout expires, or it would complete a cycle in the waits-for graph (in
+ * 				which case it is chosen as the deadlock's victim). Requests of processes which have exited are discarded.
+ * 				Locks can have a parent (such as the table a row belongs to), so a session which escalates to locking
+ * 				the parent can release all of its locks on the parent's children at once.
+ *------------------------------------------------------------*/
+
+#ifndef LOCKS_HPP
+#define LOCKS_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sql::storage {
+
+	// Class representing one session's view of a database's lock table, every lock the session holds is released once it is destroyed
+	// NOTE: Sessions in the same process each have their own manager, a session's locks are never shared with another session
+	class LockManager {
+	public:
+		// The modes a lock can be held in, shared locks are compatible with each other while exclusive locks are compatible with nothing
+		// NOTE: Intention exclusive locks are held on a parent while some of its children are locked exclusively, they are only compatible with each other
+		enum Mode : uint8_t {
+			Shared,
+			Exclusive,
+			IntentionExclusive,
+		};
+
+		// The outcome of a lock request
+		enum Result {
+			Granted,
+			// The request wasn't granted before its timeout expired
+			TimedOut,
+			// Waiting for the request would have deadlocked, so it was withdrawn
+			Deadlock,
+			// The request is queued but hasn't been granted yet (only returned by tryAcquire)
+			Waiting,
+		};
+
+		// Struct representing a request recorded in the lock table
+		struct Request {
+			// Hash of the name of the locked resource (and of its parent, or 0 if it doesn't have one)
+			uint64_t resource;
+			uint64_t parent;
+			// The session which made the request
+			int32_t pid;
+			uint32_t session;
+			// The order the request was made in
+			uint64_t ticket;
+			Mode mode;
+			bool granted;
+			uint8_t reserved[6];
+		};
+
+	private:
+		int fd = -1;
+		std::filesystem::path path;
+		uint32_t session;
+
+		// Mutex (and condition variable signaled whenever a lock is released) shared by all of the process's sessions, flock doesn't exclude threads which share a descriptor
+		static std::mutex mutex;
+		static std::condition_variable released;
+		// Functions waiting for the next time a session in this process releases a lock
+		static std::vector<std::function<void()>> listeners;
+
+		// Read every request in the lock table (discarding the requests of processes which have exited), returns the next ticket
+		// NOTE: The lock table must be flock'ed
+		uint64_t load(std::vector<Request>& requests);
+		// Replace the contents of the lock table
+		void store(const std::vector<Request>& requests, uint64_t nextTicket);
+		// Check if a request belongs to this session
+		bool owns(const Request& request) const;
+
+		// Check if two modes are compatible, and if a lock held in one mode covers a request in another
+		static bool compatible(Mode a, Mode b) { return a == b && a != Exclusive; }
+		static bool covers(Mode held, Mode requested) { return held == requested || held == Exclusive; }
+		// Check if a request must wait for another (a request waits for incompatible granted requests, and incompatible requests made before it)
+		static bool blocks(const Request& other, const Request& request);
+		// Check if a session's waiting request would complete a cycle in the waits-for graph
+		bool deadlocked(const std::vector<Request>& requests, const Request& request) const;
+		// Record a request in the lock table (unless it is already recorded) and grant it if nothing blocks it, a request which is still waiting is
+		// withdrawn if waiting for it would deadlock or it has <expired>
+		// NOTE: The mutex must be held
+		Result attempt(const std::string& resource, Mode mode, const std::string& parent, bool expired);
+		// Wake everything waiting for a lock to be released
+		// NOTE: The mutex must be held
+		static void notifyReleased();
+
+	public:
+		// Name of the lock table within the database's directory
+		static constexpr std::string_view fileName = "locks";
+		// How often (in milliseconds) a waiting request checks if it can be granted, releases in other processes aren't signaled
+		static constexpr size_t pollInterval = 5;
+		// How long (in milliseconds) requests wait before timing out by default
+		static constexpr size_t defaultTimeout = 5000;
+		// How many rows a statement can lock in a table before it locks the whole table instead (by default)
+		static constexpr size_t defaultEscalation = 1000;
+
+		// Open (creating if nessicary) the lock table of the database in <directory> (throws std::runtime_error if it can't be opened)
+		explicit LockManager(const std::filesystem::path& directory);
+		LockManager(const LockManager&) = delete;
+		~LockManager();
+
+		// Request a lock on a resource, waiting up to <timeout> for it to be granted (if the session already holds a weaker lock, the request upgrades it)
+		Result acquire(const std::string& resource, Mode mode, std::chrono::milliseconds timeout, const std::string& parent = {});
+		// Request a lock on a resource without waiting for it, returns Waiting if the request has been queued (requesting the lock again checks if it
+		// has since been granted). If the request has <expired> it is withdrawn rather than left waiting
+		Result tryAcquire(const std::string& resource, Mode mode, bool expired = false, const std::string& parent = {});
+		// Call a function (once) the next time a session in this process releases a lock (or withdraws a request), releases by other processes aren't signaled
+		static void whenReleased(std::function<void()> listener);
+		// Release this session's lock on a resource
+		void release(const std::string& resource);
+		// Release this session's locks on all of a resource's children
+		void releaseChildren(const std::string& parent);
+		// Release every lock held by this session
+		void releaseAll();
+		// Check if this session holds a lock on a resource which covers the provided mode
+		bool holds(const std::string& resource, Mode mode = Shared);
+	};
+
+} // sql::storage
+
+#endif // LOCKS_HPP
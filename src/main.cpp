@@ -3,7 +3,7 @@
  * Author: Joshua Dahl
  * Email: joshuadahl@nevada.unr.edu
  * Created: 2/7/22
- * Modified: 5/4/22
+ * Modified: 10/16/26
  * Description: Main driver of the program, responsible for collecting user input, executing the parse, and then executing the proper operations.
  *------------------------------------------------------------*/
 
@@ -21,19 +21,50 @@
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <variant>
 #include <vector>
 #include <thread>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <csignal>
+#include <unistd.h>
 
 #include "reader.hpp"
 #include "SQLparser.hpp"
 #include "SQL.hpp"
+#include "storage.hpp"
+#include "index.hpp"
+#include "predicate.hpp"
+#include "aggregate.hpp"
+#include "sort.hpp"
+#include "parallel.hpp"
+#include "wal.hpp"
+#include "versions.hpp"
+#include "locks.hpp"
+#include "server.hpp"
 #include "SimpleBinStream.h"
 
 // Constant representing the filename of database metadata files
 constexpr const char* metadataFileName = ".metadata";
 
+// Struct recording a change a transaction made to one of a table's rows, so the change can be replayed if another session modifies the table before the transaction commits
+// NOTE: The record IDs of the rows are where they were stored in the transaction's shadow of the table
+struct RowChange {
+	enum Type {
+		Insert,
+		Update,
+		Delete,
+	} type;
+	// The row as the transaction saw it before the change, and the row after the change
+	sql::Tuple before, after;
+};
+
+// Counter used to give each session its own number
+std::atomic<size_t> nextSession = 1;
+
 // Struct storing the state of the program
 struct ProgramState {
 	// Directory where our manages databases are stored
@@ -43,6 +74,36 @@ struct ProgramState {
 
 	// Pointer to the current transaction, if it is null that means there isn't currently a transaction
 	std::unique_ptr<sql::TransactionAction> transaction = nullptr;
+	// The snapshots of the tables (and indexes) the current transaction's queries read, taken when the transaction began
+	std::unique_ptr<sql::storage::SnapshotSet> snapshots = nullptr;
+	// This session's view of the current database's lock table, and how long statements wait for a lock before failing
+	std::unique_ptr<sql::storage::LockManager> locks = nullptr;
+	std::chrono::milliseconds lockTimeout{sql::storage::LockManager::defaultTimeout};
+	// How many rows a statement can lock in a table before it locks the whole table instead
+	size_t lockEscalation = sql::storage::LockManager::defaultEscalation;
+	// The changes the current transaction has made to the rows of each of the tables it only locked row by row
+	std::map<std::filesystem::path, std::vector<RowChange>> rowChanges;
+
+	// Struct describing the lock a server's session is waiting for (while its statement is suspended), and the outcome of the wait once it is over
+	struct LockWait {
+		std::string resource, parent;
+		sql::storage::LockManager::Mode mode;
+		std::chrono::steady_clock::time_point deadline;
+		std::optional<sql::storage::LockManager::Result> outcome;
+	};
+	std::optional<LockWait> lockWait;
+
+	// Set for the sessions of a server (whose output is sent to their client)
+	bool remote = false;
+
+	// The amount of memory (in bytes) ORDER BY can buffer tuples in before it spills them to disk
+	size_t sortMemory = sql::ExternalSort::defaultMemoryBudget;
+	// The number of threads large scans are split between, and the pool of worker threads they are split between (created once it is needed)
+	size_t parallelism = sql::WorkerPool::defaultParallelism();
+	std::shared_ptr<sql::WorkerPool> workers;
+
+	// Number uniquely identifying this session within the process
+	size_t session = nextSession++;
 };
 
 // Dispatcher function prototypes
@@ -59,13 +120,17 @@ void transaction(std::unique_ptr<sql::Action> action, ProgramState& state);
 void useDatabase(const sql::Action& action, ProgramState& state, bool quiet = false);
 void createDatabase(const sql::Action& action, ProgramState& state);
 void createTable(const sql::Action& action, ProgramState& state);
+void createIndex(const sql::Action& action, ProgramState& state);
 void dropDatabase(const sql::Action& action, ProgramState& state);
 void dropTable(const sql::Action& action, ProgramState& state);
+void dropIndex(const sql::Action& action, ProgramState& state);
 void alterTable(const sql::Action& action, ProgramState& state);
 void insertIntoTable(const sql::Action& action, ProgramState& state);
 void queryTable(const sql::Action& action, ProgramState& state);
 void updateTable(const sql::Action& action, ProgramState& state);
 void deleteFromTable(const sql::Action& action, ProgramState& state);
+void dotCommand(const std::string& command, ProgramState& state);
+std::ostream& abort(ProgramState& state);
 
 // Function which splits a string into a vector of substrings at the specified separators
 static std::vector<std::string> split(std::string s, const char* separators = " \t\v\f\r\n", size_t pos = 0, size_t max_splits = -1) {
@@ -114,48 +179,56 @@ inline std::string trim (const std::string& s, const char* delims = " \t\v\f\r\n
 }
 
 
-// Main function/entry point, runs a read-loop and dispatches to the proper execution function
-int main() {
-	// Create input reader
-	Reader r = Reader(/*enableHistory*/true)
-		.setPrompt("sql> ");
+// Function which reads input from the user until it ends with a semicolon (or is a dot command), comments (and newlines) are removed from the input
+std::string readInput(Reader& r) {
+	// Read some input from the user
+	std::string input = trim(r.read(false));
+	while(rtrim(input).back() != ';' && input.front() != '.' && tolower(input).find(".exit") == std::string::npos)
+		input += "\n" + trim(r.read(false, "^ "));
 
-	// Input loop
-	ProgramState state;
+	// Remove any comments (and newlines) from the input
+	auto lines = split(input, "\n");
+	input = "";
+	for(size_t i = 0; i < lines.size(); i++)
+		if(auto trimmed = trim(lines[i]); !(trimmed[0] == '-' && trimmed[1] == '-'))
+			input += lines[i] + " ";
+
+	r.appendToHistory(input);
+	return input;
+}
+
+// Function which executes some input (any number of statements and dot commands separated by semicolons), returns false if the input asked to exit
+bool execute(const std::string& input, ProgramState& state) {
 	bool keepRunning = true;
-	while(keepRunning){
-		// Read some input from the user
-		std::string input = trim(r.read(false));
-		while(rtrim(input).back() != ';' && tolower(input).find(".exit") == std::string::npos)
-			input += "\n" + trim(r.read(false, "^ "));
-
-		// Remove any comments (and newlines) from the input
-		auto lines = split(input, "\n");
-		input = "";
-		for(size_t i = 0; i < lines.size(); i++)
-			if(auto trimmed = trim(lines[i]); !(trimmed[0] == '-' && trimmed[1] == '-'))
-				input += lines[i] + " ";
-
-		r.appendToHistory(input);
-
-		// Split the input based on semicolons, so each SQL command is parsed seperately
-		std::vector<std::string> inputs = split(input, ";");
-		for(std::string& input: inputs) {
-			// If there is nothing to do, skip this input
-			input = trim(input);
-			if(input.empty()) continue;
-			// Append the semicolon that was removed when we split
-			input += ';';
-
-			// Command to exit the program
-			if(tolower(input).find(".exit") != std::string::npos){
-				keepRunning = false;
-			} else {
-				sql::Action::ptr action = parseSQL(input);
-				// If we failed to parse the provided statement... continue
-				if(action == nullptr)
-					continue; // Error message provided by parse
 
+	// Split the input based on semicolons, so each SQL command is parsed seperately
+	std::vector<std::string> inputs = split(input, ";");
+	for(size_t i = 0; i < inputs.size(); i++) {
+		std::string& input = inputs[i];
+		// If there is nothing to do, skip this input
+		input = trim(input);
+		if(input.empty()) continue;
+		// Append the semicolon that was removed when we split
+		input += ';';
+
+		// Command to exit the program
+		if(tolower(input).find(".exit") != std::string::npos){
+			keepRunning = false;
+		// Commands which configure the program (rather than the database) start with a dot
+		} else if(input.front() == '.') {
+			dotCommand(input, state);
+		} else {
+			sql::Action::ptr action = parseSQL(input);
+			// If we failed to parse the provided statement... continue
+			if(action == nullptr) {
+				// NOTE: The parser's error message is printed to the server's standard error, so remote sessions need to be told something went wrong
+				if(state.remote) std::cerr << "!Failed to parse " << input << std::endl;
+				continue; // Error message provided by parse
+			}
+
+			// Outside of a transaction, locks are only held until the statement finishes (even if the statement throws)
+			// NOTE: A statement suspended while it waits for a lock keeps its locks, it is executed again (along with the rest of the input) once the wait is over
+			try {
 				// Hand off the function to the proper dispatcher based on the action this action wishes to perform
 				// NOTE: We dereference the pointer we recieved from the parser, its lifetime extends beyond the function utilization and we can still use polymorphism on references
 				switch(action->action){
@@ -181,13 +254,222 @@ int main() {
 				break; default:
 					throw std::runtime_error("!Unsupported action: " + sql::Action::ActionNames[action->action]);
 				}
+			} catch(sql::server::Blocked& blocked) {
+				blocked.remaining = input;
+				for(size_t j = i + 1; j < inputs.size(); j++)
+					blocked.remaining += inputs[j] + ";";
+				throw;
+			} catch(...) {
+				state.lockWait.reset();
+				if(!state.transaction && state.locks)
+					state.locks->releaseAll();
+				throw;
+			}
+			state.lockWait.reset();
+			if(!state.transaction && state.locks)
+				state.locks->releaseAll();
+		}
+	}
+
+	return keepRunning;
+}
+
+// The server currently running (so it can be stopped by a signal), and the databases its sessions have used (so they can be checkpointed once it stops)
+sql::server::Server* runningServer = nullptr;
+std::mutex usedDatabasesMutex;
+std::set<std::filesystem::path> usedDatabases;
+
+// Function which creates the state of a server's session for a newly connected client, each session has its own program state
+sql::server::Server::Session createSession() {
+	auto state = std::make_shared<ProgramState>();
+	state->remote = true;
+
+	return {
+		[state](const std::string& input) {
+			bool keepRunning = execute(input, *state);
+			if(state->currentDatabase) {
+				std::scoped_lock lock(usedDatabasesMutex);
+				usedDatabases.insert(state->currentDatabase->path);
 			}
+			return keepRunning;
+		},
+		// A transaction left open when the client disconnects is aborted
+		[state] { abort(*state); }
+	};
+}
+
+// Function which runs a server listening on the provided socket, until it is interrupted
+int serve(const std::filesystem::path& socket) {
+	try {
+		sql::server::Server server(socket);
+		runningServer = &server;
+		signal(SIGINT, [](int) { if(runningServer) runningServer->stop(); });
+		signal(SIGTERM, [](int) { if(runningServer) runningServer->stop(); });
+
+		std::cout << "Listening on " << socket.string() << "." << std::endl;
+		server.run(createSession);
+		runningServer = nullptr;
+	} catch(std::runtime_error& e) {
+		std::cerr << "!" << e.what() << "." << std::endl;
+		return 1;
+	}
+
+	// Checkpoint the write-ahead log of every database the sessions used, so that nothing needs to be recovered the next time they are used
+	for(auto& database: usedDatabases)
+		try {
+			sql::storage::WriteAheadLog::checkpoint(database);
+		} catch(std::runtime_error) {}
+
+	std::cout << "All done." << std::endl;
+	return 0;
+}
+
+// Function which connects to a server listening on the provided socket, then sends it the user's input (printing everything the input printed on the server)
+int connectTo(const std::filesystem::path& socket) {
+	int fd;
+	try {
+		fd = sql::server::connect(socket);
+	} catch(std::runtime_error& e) {
+		std::cerr << "!" << e.what() << "." << std::endl;
+		return 1;
+	}
+
+	// Create input reader
+	Reader r = Reader(/*enableHistory*/true)
+		.setPrompt("sql> ");
+
+	// Input loop
+	while(true) {
+		if(!sql::server::sendFrame(fd, sql::server::Input, readInput(r)))
+			break;
+
+		// Print what the input printed until it has finished executing
+		sql::server::FrameType type;
+		std::string payload;
+		bool connected;
+		while((connected = sql::server::receiveFrame(fd, type, payload)) && type != sql::server::Done)
+			(type == sql::server::Error ? std::cerr : std::cout) << payload << std::flush;
+		if(!connected) {
+			std::cerr << "!Lost connection to the server." << std::endl;
+			close(fd);
+			return 1;
 		}
+
+		// The server closes the session once it is asked to exit
+		if(payload == "exit") break;
+	}
+
+	close(fd);
+	std::cout << "All done." << std::endl;
+	return 0;
+}
+
+// Main function/entry point, runs a read-loop and dispatches to the proper execution function
+// NOTE: "--server <socket>" instead runs a server which clients connect to with "--connect <socket>"
+int main(int argc, char* argv[]) {
+	if(argc == 3 && std::string_view(argv[1]) == "--server")
+		return serve(argv[2]);
+	if(argc == 3 && std::string_view(argv[1]) == "--connect")
+		return connectTo(argv[2]);
+	if(argc != 1) {
+		std::cerr << "!Usage: " << argv[0] << " [--server <socket> | --connect <socket>]" << std::endl;
+		return 1;
 	}
 
+	// Create input reader
+	Reader r = Reader(/*enableHistory*/true)
+		.setPrompt("sql> ");
+
+	// Input loop
+	ProgramState state;
+	bool keepRunning = true;
+	while(keepRunning)
+		try {
+			keepRunning = execute(readInput(r), state);
+		// A statement which fails unexpectedly only ends its input, rather than the whole program
+		} catch(std::exception& e) {
+			std::cerr << "!" << e.what() << std::endl;
+		}
+
+	// Checkpoint the current database's write-ahead log, so that nothing needs to be recovered the next time it is used
+	if(state.currentDatabase)
+		try {
+			sql::storage::WriteAheadLog::checkpoint(state.currentDatabase->path);
+		} catch(std::runtime_error) {}
+
 	std::cout << "All done." << std::endl;
 }
 
+// Function which executes a dot command (.stats prints buffer pool statistics, .set changes a setting)
+void dotCommand(const std::string& command, ProgramState& state) {
+	auto args = split(trim(command, " \t\v\f\r\n;"));
+	std::string name = tolower(args[0]);
+	auto& pool = sql::storage::BufferPool::global();
+
+	if(name == ".stats") {
+		auto stats = pool.statistics();
+		uint64_t requests = stats.hits + stats.misses;
+		std::cout << "Buffer pool: " << pool.size() << " of " << pool.getCapacity() << " pages in use" << std::endl
+			<< "\thits: " << stats.hits << ", misses: " << stats.misses << ", hit rate: " << (requests ? 100.0 * stats.hits / requests : 0.0) << "%" << std::endl
+			<< "\tevictions: " << stats.evictions << ", writes: " << stats.writes << std::endl;
+
+		// Print how many appends to the write-ahead log have shared each sync
+		auto log = sql::storage::WriteAheadLog::statistics();
+		std::cout << "Write-ahead log: " << log.groups << " groups appended, " << log.syncs << " syncs (" << (log.syncs ? double(log.groups) / log.syncs : 0.0) << " groups per sync)" << std::endl;
+
+		// Print how much of their time the workers have spent running tasks (once a parallel operator has created them)
+		if(state.workers) {
+			std::cout << "Workers: " << state.workers->parallelism() << " threads" << std::endl;
+			auto workers = state.workers->statistics();
+			for(size_t i = 0; i < workers.size(); i++) {
+				uint64_t total = workers[i].busy + workers[i].idle;
+				std::cout << "\tworker " << i << ": busy " << workers[i].busy / 1000000 << " ms, idle " << workers[i].idle / 1000000 << " ms (" << (total ? 100.0 * workers[i].busy / total : 0.0) << "% busy), "
+					<< "tasks: " << workers[i].tasks << ", stolen: " << workers[i].steals << std::endl;
+			}
+		}
+	} else if(name == ".set") {
+		if(args.size() != 3) {
+			std::cerr << "!Usage: .set <setting> <value>" << std::endl;
+			return;
+		}
+
+		std::string setting = tolower(args[1]);
+		// The buffer pool and write-ahead log are shared by the whole process, so a server's sessions can't change their settings for each other
+		if(state.remote && (setting == "buffer_pool_pages" || setting == "commit_delay_us" || setting == "commit_kb")) {
+			std::cerr << "!Failed to change setting " << args[1] << " because it is shared by every session of the server." << std::endl;
+			return;
+		}
+		try {
+			if(setting == "buffer_pool_pages") {
+				pool.resize(std::stoul(args[2]));
+				std::cout << "Buffer pool resized to " << pool.getCapacity() << " pages." << std::endl;
+			} else if(setting == "sort_memory_kb") {
+				state.sortMemory = std::stoul(args[2]) * 1024;
+				std::cout << "Sorts now spill to disk after buffering " << state.sortMemory / 1024 << " KiB." << std::endl;
+			} else if(setting == "parallelism") {
+				state.parallelism = std::max(std::stoul(args[2]), 1ul);
+				std::cout << "Scans are now split between " << state.parallelism << " threads." << std::endl;
+			} else if(setting == "commit_delay_us") {
+				sql::storage::WriteAheadLog::commitDelay = std::stoul(args[2]);
+				std::cout << "Commits now wait up to " << sql::storage::WriteAheadLog::commitDelay << " microseconds for concurrent commits to share their sync." << std::endl;
+			} else if(setting == "lock_timeout_ms") {
+				state.lockTimeout = std::chrono::milliseconds(std::stoul(args[2]));
+				std::cout << "Statements now wait up to " << state.lockTimeout.count() << " ms for a lock." << std::endl;
+			} else if(setting == "lock_escalation_rows") {
+				state.lockEscalation = std::stoul(args[2]);
+				std::cout << "Statements now lock the whole table once they would lock more than " << state.lockEscalation << " of its rows." << std::endl;
+			} else if(setting == "commit_kb") {
+				sql::storage::WriteAheadLog::commitBytes = std::max(std::stoul(args[2]), 1ul) * 1024;
+				std::cout << "Commits now stop waiting once " << sql::storage::WriteAheadLog::commitBytes / 1024 << " KiB are waiting to be synced." << std::endl;
+			} else
+				std::cerr << "!Unknown setting " << args[1] << "." << std::endl;
+		} catch (std::exception&) {
+			std::cerr << "!Invalid value " << args[2] << " for setting " << args[1] << "." << std::endl;
+		}
+	} else
+		std::cerr << "!Unknown command " << args[0] << "." << std::endl;
+}
+
 // Function which executes the proper USE function based on the statement target
 inline void use(const sql::Action& action, ProgramState& state){
 	switch(action.target.type){
@@ -207,6 +489,8 @@ inline void create(const sql::Action& action, ProgramState& state){
 		createDatabase(action, state);
 	break; case sql::Action::Target::Table:
 		createTable(action, state);
+	break; case sql::Action::Target::Index:
+		createIndex(action, state);
 	// If the action is unsupported for this target, error
 	break; default:
 		std::cerr << "!Can not CREATE a " << sql::Action::Target::TypeNames[action.target.type] << "." << std::endl;
@@ -220,6 +504,8 @@ inline void drop(const sql::Action& action, ProgramState& state){
 		dropDatabase(action, state);
 	break; case sql::Action::Target::Table:
 		dropTable(action, state);
+	break; case sql::Action::Target::Index:
+		dropIndex(action, state);
 	// If the action is unsupported for this target, error
 	break; default:
 		std::cerr << "!Can not DROP a " << sql::Action::Target::TypeNames[action.target.type] << "." << std::endl;
@@ -297,68 +583,105 @@ std::ostream& abort(ProgramState& state) {
 	return std::cerr;
 }
 
-// Helper function that creates a version of the file's path with the current thread ID appended to the filename
-std::filesystem::path threadLocalFile(const std::filesystem::path& path) {
-	std::stringstream tid; tid << std::this_thread::get_id();
-	auto root = path;
+// Helper function which gets the pool of worker threads scans are split between (recreating it if the degree of parallelism changed)
+// NOTE: The sessions of a server share their pools (one per degree of parallelism), so the number of threads doesn't grow with the number of sessions
+sql::WorkerPool* workerPool(ProgramState& state) {
+	if(!state.workers || state.workers->parallelism() != state.parallelism) {
+		if(state.remote) {
+			static std::mutex mutex;
+			static std::map<size_t, std::shared_ptr<sql::WorkerPool>> shared;
+			std::scoped_lock lock(mutex);
+			auto& pool = shared[state.parallelism];
+			if(!pool) pool = std::make_shared<sql::WorkerPool>(state.parallelism);
+			state.workers = pool;
+		} else state.workers = std::make_shared<sql::WorkerPool>(state.parallelism);
+	}
+	return state.workers.get();
+}
 
-	return root.remove_filename() / (tid.str() + "." + path.filename().string());
+// Helper function that creates a version of the file's path with the process ID and session number prepended to the filename
+// NOTE: A server's sessions run their statements on whichever thread is free, so the thread's ID can't identify the session
+std::filesystem::path sessionLocalFile(const std::filesystem::path& path, const ProgramState& state) {
+	auto root = path;
+	return root.remove_filename() / (std::to_string(getpid()) + "-" + std::to_string(state.session) + "." + path.filename().string());
 }
 
-// Helper function that creates a version of the file's path that is a lock file
-std::filesystem::path lockFile(const std::filesystem::path& path) {
-	return path.string() + ".lock";
+// Helpers which get the names of the resources in the lock table representing a table, one of its rows, and the latch held while its pages are written
+std::string tableResource(const std::filesystem::path& tablePath) { return tablePath.filename().string(); }
+std::string rowResource(const std::filesystem::path& tablePath, sql::RecordID rid) { return tableResource(tablePath) + "#" + std::to_string(rid.page) + "." + std::to_string(rid.slot); }
+std::string latchResource(const std::filesystem::path& tablePath) { return tableResource(tablePath) + "#write"; }
+
+// Helper function that checks if a table can be locked row by row (columnar and legacy tables are rewritten in full whenever a row changes, so they can only be locked as a whole)
+bool rowLockable(const sql::Table& table) {
+	return table.layout == sql::Table::Row && !sql::storage::isLegacyTableFile(table.path);
 }
 
-// Helper function that return true if a lock can be taken, for a table, false otherwise
-bool handleTableLock(const sql::Table& table, std::string operation, ProgramState& state) {
-	// Determine the lock path and our thread id
-	auto lock = lockFile(table.path);
-	std::stringstream _tid; _tid << std::this_thread::get_id();
-	auto tid = _tid.str();
-
-	// If the lock exists...
-	if(exists(lock)){
-		// Read the thread id from the file
-		std::ifstream fin(lock);
-		std::string lockTID;
-		fin >> lockTID;
-		fin.close();
-
-		// If the thread id is not our ID then then we failed to take the lock
-		if(tid != lockTID){
-			abort(state) << "!Failed to " << operation << " table " << table.name << " because it is locked by another process." << std::endl;
-			return false;
-		}
-	// If the lock doesn't exist and we are in a transaction, create the lock file and save our tid to it
-	} else if(state.transaction) {
-		std::ofstream fout(lock);
-		fout << tid;
-		fout.close();
+// Helper function which requests a lock on a resource, waiting (up to the lock timeout) for it to be granted
+// NOTE: A server's sessions don't wait while holding an executor, instead the statement throws sql::server::Blocked (leaving its request queued) and is executed again
+// once the wait is over, so statements must not change anything before they have taken their locks
+sql::storage::LockManager::Result requestLock(const std::string& resource, sql::storage::LockManager::Mode mode, const std::string& parent, ProgramState& state) {
+	if(!state.remote)
+		return state.locks->acquire(resource, mode, state.lockTimeout, parent);
+
+	// If the statement has already waited for the lock, the outcome of the wait is used
+	if(state.lockWait && state.lockWait->resource == resource && state.lockWait->outcome) {
+		auto result = *state.lockWait->outcome;
+		state.lockWait.reset();
+		return result;
 	}
 
-	return true;
+	auto result = state.locks->tryAcquire(resource, mode, /*expired*/ false, parent);
+	if(result != sql::storage::LockManager::Waiting)
+		return result;
+	state.lockWait = ProgramState::LockWait{resource, parent, mode, std::chrono::steady_clock::now() + state.lockTimeout, {}};
+	throw sql::server::Blocked{"", [&state] {
+		// The request is withdrawn once it has waited for longer than the lock timeout
+		auto& wait = *state.lockWait;
+		auto result = state.locks->tryAcquire(wait.resource, wait.mode, /*expired*/ std::chrono::steady_clock::now() >= wait.deadline, wait.parent);
+		if(result == sql::storage::LockManager::Waiting) return false;
+		wait.outcome = result;
+		return true;
+	}, sql::storage::LockManager::whenReleased, std::chrono::milliseconds(sql::storage::LockManager::pollInterval)};
 }
 
-// Helper function that releases a lock on a table if we control the lock
-void releaseLock(const std::filesystem::path& tablePath) {
-	// Determine the lock path and our thread id
-	auto lock = lockFile(tablePath);
-	std::stringstream _tid; _tid << std::this_thread::get_id();
-	auto tid = _tid.str();
+// Helper function that return true if a lock can be taken on a resource (which is the table, or if <row> is true one of the table's rows), false otherwise
+// NOTE: Waits (up to the lock timeout) for the lock, if it times out the statement fails but the transaction continues, if it would deadlock the transaction is aborted
+bool takeLock(const std::string& resource, sql::storage::LockManager::Mode mode, const sql::Table& table, std::string operation, ProgramState& state, bool row = false) {
+	if(!state.locks) return true;
+
+	switch(requestLock(resource, mode, row ? tableResource(table.path) : std::string(), state)) {
+	break; case sql::storage::LockManager::TimedOut:
+		std::cerr << "!Failed to " << operation << " table " << table.name << " because " << (row ? "one of its rows" : "it") << " is locked by another session (timed out after " << state.lockTimeout.count() << " ms)." << std::endl;
+		return false;
+	break; case sql::storage::LockManager::Deadlock:
+		abort(state) << "!Failed to " << operation << " table " << table.name << " because waiting for " << (row ? "the lock on one of its rows" : "its lock") << " would deadlock." << std::endl;
+		return false;
+	break; default: break;
+	}
+	return true;
+}
 
-	// If the lock exists...
-	if(exists(lock)){
-		// Read the thread id from the file
-		std::ifstream fin(lock);
-		std::string lockTID;
-		fin >> lockTID;
-		fin.close();
+// Helper function that return true if a lock can be taken, for a table, false otherwise
+// NOTE: Statements which only modify some of a table's rows take an intention exclusive lock on the table (then lock the rows they modify), anything else locks the whole table
+bool handleTableLock(const sql::Table& table, std::string operation, ProgramState& state, sql::storage::LockManager::Mode mode = sql::storage::LockManager::Exclusive) {
+	if(!takeLock(tableResource(table.path), mode, table, operation, state))
+		return false;
 
-		// If the thread id is our ID, the remove the lock
-		if(tid == lockTID)
-			remove(lock);
+	// If a table locked as a whole has been modified since the transaction began, the transaction's queries didn't see the changes so it can't modify the table
+	// NOTE: Other sessions are expected to modify the rows of a table locked row by row, changes to those rows are instead replayed onto the table when the transaction commits
+	if(mode == sql::storage::LockManager::Exclusive && state.snapshots && !state.snapshots->current(table.path)) {
+		abort(state) << "!Failed to " << operation << " table " << table.name << " because it was modified by another process after the transaction began." << std::endl;
+		return false;
 	}
+
+	return true;
+}
+
+// Helper function that latches a table while a statement writes its pages (and indexes), so that sessions which have only locked some of its rows never write the same page at once
+// NOTE: The latch is released once the statement finishes, changes in a transaction are written to its shadow so the table is only latched once the transaction commits
+bool latchTable(const sql::Table& table, std::string operation, ProgramState& state) {
+	if(state.transaction) return true;
+	return takeLock(latchResource(table.path), sql::storage::LockManager::Exclusive, table, operation, state);
 }
 
 // Helper function that saves a database's metadata
@@ -368,21 +691,42 @@ void saveDatabaseMetadataFile(const sql::Database database){
 	fout.close();
 }
 
-// Helper function that saves a table's metadata and data
-void saveTableFile(const sql::Table& table, std::string operation, ProgramState& state){
-	// If we have a transaction, overwrite the path with a temporary one for the transaction
+// Helper function that saves a table's metadata and data, returns false (aborting the current transaction) if it couldn't be written
+bool saveTableFile(const sql::Table& table, std::string operation, ProgramState& state){
+	// If we have a transaction, overwrite the path with a temporary one for the transaction (a shadow which is about to be rewritten)
 	auto path = table.path;
-	if(state.transaction)
-		path = state.transaction->tables[table.path] = threadLocalFile(table.path);
+	if(state.transaction) {
+		path = state.transaction->tables[table.path] = sessionLocalFile(table.path, state);
+		sql::storage::createShadow(path, table.path, /*rewrite*/ true);
+	}
 
 	// Save the table to disk
-	simple::file_ostream<std::true_type> fout(path.c_str());
-	fout << table;
-	fout.close();
+	try {
+		sql::storage::writeTable(path, table);
+		return true;
+	} catch(std::runtime_error& e) {
+		abort(state) << "!Failed to " << operation << " table " << table.name << " because it couldn't be written (" << e.what() << ")." << std::endl;
+	}
+	return false;
+}
+
+// Helper that determines the path changes to a table should be written to, in a transaction this is the transaction's copy-on-write shadow of the table (which is created if it doesn't already exist)
+std::filesystem::path tableWritePath(const sql::Table& table, ProgramState& state){
+	if(!state.transaction)
+		return table.path;
+
+	if(!contains(state.transaction->tables, table.path)) {
+		auto path = state.transaction->tables[table.path] = sessionLocalFile(table.path, state);
+		sql::storage::createShadow(path, table.path);
+	}
+	return state.transaction->tables[table.path];
 }
 
 // Helper that loads a table from file (also ensures that exists, both on disk and in the database)
-bool loadTable(sql::Table& table, const sql::Database& database, std::string operation, ProgramState& state){
+// NOTE: Only the table's metadata will be loaded if <schemaOnly> is true
+// NOTE: If <columns> is provided, columnar tables will only load the named columns (the rest will be null)
+// NOTE: If <rids> is provided, only the tuples stored at those record IDs will be loaded (row tables only)
+bool loadTable(sql::Table& table, const sql::Database& database, std::string operation, ProgramState& state, bool schemaOnly = false, const std::set<std::string>* columns = nullptr, const std::vector<sql::RecordID>* rids = nullptr){
 	// Ensure that the table exists in the current database
 	if(std::find(database.tables.begin(), database.tables.end(), table.path) == database.tables.end()){
 		abort(state) << "!Failed to " << operation << " table " << table.name << " because it doesn't exist." << std::endl;
@@ -400,11 +744,11 @@ bool loadTable(sql::Table& table, const sql::Database& database, std::string ope
 		abort(state) << "!Failed to " << operation << " table " << table.name << " because it does not exist." << std::endl;
 		return false;
 	}
-	simple::file_istream<std::true_type> fin(path.c_str());
 	try {
 		// Load the table
-		fin >> table;
-		fin.close();
+		if(schemaOnly) sql::storage::readSchema(path, table);
+		else if(rids) sql::storage::readTuples(path, table, *rids);
+		else sql::storage::readTable(path, table, columns);
 		// Make sure the table's path is the path to the original table
 		table.path = pathCache;
 
@@ -413,8 +757,7 @@ bool loadTable(sql::Table& table, const sql::Database& database, std::string ope
 		abort(state) << "!Failed to " << operation << " table " << table.name << " because it is corupted." << std::endl;
 	}
 
-	// If we failed for any reason then close the file and return false
-	fin.close();
+	// If we failed for any reason then return false
 	return false;
 }
 
@@ -427,16 +770,14 @@ size_t findColumn(sql::Table& table, const std::string& columnName){
 	return -1;
 }
 
-// Helper function that returns a set of indecies representing tuples that satisfy the where conditions in the provided action
-std::vector<size_t> applyWhereConditions(sql::Table& table, sql::WhereAction& action, std::string_view operation) {
-	// For each condition, find its associated column (and possibly the column its data is held in) and validate its data
-	std::vector<size_t> conditionColumns;
-	std::vector<size_t> conditionDataColumns;
+// Helper function that finds the columns associated with each where condition in the provided action (and the column its data is held in, or -1 if the data is a value), validating and adjusting the conditions' data
+// NOTE: Returns false (after printing an error) if any of the conditions are invalid
+bool prepareWhereConditions(sql::Table& table, sql::WhereAction& action, std::string_view operation, std::vector<size_t>& conditionColumns, std::vector<size_t>& conditionDataColumns) {
 	for(auto& condition: action.conditions){
 		size_t index = findColumn(table, condition.column);
 		if(index == -1){
 			std::cerr << "!Failed to " << operation << " table " << action.target.name << " because it doesn't contain a condition column named " << condition.column << "." << std::endl;
-			return {};
+			return false;
 		}
 		// Save the column index of this condition
 		conditionColumns.push_back(index);
@@ -447,13 +788,13 @@ std::vector<size_t> applyWhereConditions(sql::Table& table, sql::WhereAction& ac
 			size_t dataIndex = findColumn(table, dataColumn);
 			if(index == -1){
 				std::cerr << "!Failed to " << operation << " table " << action.target.name << " because it doesn't contain a condition data column named " << dataColumn << "." << std::endl;
-				return {};
+				return false;
 			}
 
 			// If the columns have incompatible data types, error
 			if(!table.columns[index].type.compatibleType(table.columns[dataIndex].type)) {
 				std::cerr << "!Failed to " << operation << " table " << action.target.name << " because columns `" << condition.column << "` and `" << dataColumn << "` don't have compatible data types and thus can't be compared." << std::endl;
-				return {};
+				return false;
 			}
 
 			// Mark the column this data's condition comes from
@@ -467,7 +808,7 @@ std::vector<size_t> applyWhereConditions(sql::Table& table, sql::WhereAction& ac
 				std::cerr << "!Failed to " << operation << " table " << action.target.name << " because column " << column.name
 					<< " in condition has type " << column.type.to_string() << " but comparision data of type "
 					<< sql::Data::variantTypeString(dataValue) << " provided." << std::endl;
-				return {};
+				return false;
 			}
 			sql::Data::applyColumnAdjustments(column, dataValue);
 			condition.value = sql::ast::flatten(dataValue);
@@ -477,49 +818,429 @@ std::vector<size_t> applyWhereConditions(sql::Table& table, sql::WhereAction& ac
 		}
 	}
 
-	// For each tuple...
-	std::vector<size_t> selectedTuples;
-	for(size_t i = 0; i < table.tuples.size(); i++){
-		sql::Tuple& tuple = table.tuples[i];
-
-		// Check how many of the conditions hold true for that tuple
-		size_t validations = 0;
-		for(size_t i = 0; i < action.conditions.size(); i++){
-			const auto& data = tuple[conditionColumns[i]].data;
-			auto& condition = action.conditions[i];
-			// If the condition's data comes from the table, grab it; otherwise grab the data stored in the condition
-			const auto conditionData = (condition.value.index() == 5 ? tuple[conditionDataColumns[i]].data : sql::ast::extractData(condition.value));
-
-			switch (condition.comp){
-			break; case sql::WhereAction::equal:
-				if(data == conditionData)
-					validations++;
-			break; case sql::WhereAction::notEqual:
-				if(data != conditionData)
-					validations++;
-			break; case sql::WhereAction::less:
-				if(data < conditionData)
-					validations++;
-			break; case sql::WhereAction::greater:
-				if(data > conditionData)
-					validations++;
-			break; case sql::WhereAction::lessEqual:
-				if(data <= conditionData)
-					validations++;
-			break; case sql::WhereAction::greaterEqual:
-				if(data >= conditionData)
-					validations++;
-			break; default:
-				throw std::runtime_error("Unexpected condition");
+	return true;
+}
+
+// Helper function that checks if a comparison holds between two pieces of data
+template<typename T>
+bool compare(sql::WhereAction::Comparison comp, const T& data, const T& conditionData) {
+	switch (comp){
+	break; case sql::WhereAction::equal:
+		return data == conditionData;
+	break; case sql::WhereAction::notEqual:
+		return data != conditionData;
+	break; case sql::WhereAction::less:
+		return data < conditionData;
+	break; case sql::WhereAction::greater:
+		return data > conditionData;
+	break; case sql::WhereAction::lessEqual:
+		return data <= conditionData;
+	break; case sql::WhereAction::greaterEqual:
+		return data >= conditionData;
+	break; default:
+		throw std::runtime_error("Unexpected condition");
+	}
+}
+
+// Helper function that returns a set of indecies representing tuples that satisfy the where conditions in the provided action
+// NOTE: If <workers> is provided large tables are filtered in parallel
+// NOTE: If <valid> is provided it will be set to false if the conditions are invalid (rather than just not selecting any tuples)
+std::vector<size_t> applyWhereConditions(sql::Table& table, sql::WhereAction& action, std::string_view operation, sql::WorkerPool* workers, bool* valid = nullptr) {
+	// For each condition, find its associated column (and possibly the column its data is held in) and validate its data
+	std::vector<size_t> conditionColumns;
+	std::vector<size_t> conditionDataColumns;
+	if(!prepareWhereConditions(table, action, operation, conditionColumns, conditionDataColumns)) {
+		if(valid) *valid = false;
+		return {};
+	}
+
+	// Find the tuples which satisfy all of the conditions (numeric comparisons are vectorized, the rest are compiled into a predicate)
+	return sql::selectTuples(table, action.conditions, conditionColumns, conditionDataColumns, workers);
+}
+
+// Helper function that determines which columns of a table (referenced by the provided alias) a query references, the columns are referenced either by their name alone or qualified by the table's alias
+std::set<std::string> referencedColumns(const sql::QueryTableAction& action, const sql::QueryTableAction::TableAlias& alias) {
+	std::vector<std::string> references;
+	if(action.columns.has_value())
+		references = *action.columns;
+	for(auto& conditions: {&action.conditions, &action.having})
+		for(auto& condition: *conditions) {
+			references.push_back(condition.column);
+			if(condition.value.index() == 5)
+				references.push_back(std::get<sql::Column>(condition.value).name);
+		}
+	for(auto& aggregate: action.aggregates)
+		if(aggregate.column.has_value())
+			references.push_back(*aggregate.column);
+	references.insert(references.end(), action.groupBy.begin(), action.groupBy.end());
+	for(auto& order: action.orderBy)
+		references.push_back(order.column);
+
+	std::set<std::string> columns;
+	for(auto& column: references) {
+		auto parts = split(column, ".", 0, 1);
+		if(parts.size() == 1) columns.insert(column);
+		else if(parts[0] == alias.alias) columns.insert(parts[1]);
+	}
+	return columns;
+}
+
+// Helper function that determines which of a query's tables a column reference refers to (the first table containing it, the same way the column will be found once the tables are joined), or -1 if none of the tables contain it
+size_t referencedTable(std::vector<sql::Table>& tables, const std::string& column) {
+	for(size_t i = 0; i < tables.size(); i++)
+		if(findColumn(tables[i], column) != -1)
+			return i;
+	return -1;
+}
+
+// Helper that determines the path of one of a table's indexes (indexes are stored next to their table as <table>.<index>.index)
+std::filesystem::path indexPath(const std::filesystem::path& tablePath, const std::string& index) {
+	return tablePath.parent_path() / (tablePath.stem().string() + "." + index + ".index");
+}
+
+// Helper that finds the paths of the indexes in a database, either all of them or only those on the provided table and/or with the provided name
+std::vector<std::filesystem::path> findIndexes(const std::filesystem::path& databasePath, const std::string& table = "", const std::string& name = "") {
+	std::vector<std::filesystem::path> indexes;
+	if(!exists(databasePath)) return indexes;
+
+	for(auto& entry: std::filesystem::directory_iterator(databasePath)) {
+		// Neither table nor index names can contain periods, so index files always have exactly three parts
+		auto parts = split(entry.path().filename().string(), ".");
+		if(parts.size() != 3 || parts[2] != "index") continue;
+		if(!table.empty() && parts[0] != table) continue;
+		if(!name.empty() && parts[1] != name) continue;
+		indexes.push_back(entry.path());
+	}
+	return indexes;
+}
+std::vector<std::filesystem::path> tableIndexes(const std::filesystem::path& tablePath) { return findIndexes(tablePath.parent_path(), tablePath.stem().string()); }
+
+// Helper function that takes snapshots of a table and its indexes (so that they are all read as they were at the same time)
+// NOTE: The database's publish lock should be held (shared) while the snapshots are taken, so a commit can't change the table between the snapshots of it and its indexes
+// NOTE: Tables which can't be opened are skipped, they are reported once they are loaded
+void snapshotTable(sql::storage::SnapshotSet& snapshots, const std::filesystem::path& tablePath) {
+	for(auto& path: tableIndexes(tablePath))
+		try {
+			snapshots.get(path);
+		} catch(std::runtime_error) {}
+	try {
+		snapshots.get(tablePath);
+	} catch(std::runtime_error) {}
+}
+
+// Helper function that rebuilds all of a table's indexes from the tuples stored on disk (indexes whose column no longer exists are removed)
+void rebuildIndexes(const std::filesystem::path& tablePath) {
+	auto indexes = tableIndexes(tablePath);
+	if(indexes.empty()) return;
+
+	sql::Table table;
+	try {
+		sql::storage::readTable(tablePath, table);
+	} catch(std::runtime_error) {
+		std::cerr << "!Failed to rebuild the indexes of table " << tablePath.stem().string() << " because it is corupted." << std::endl;
+		return;
+	}
+
+	for(auto& path: indexes)
+		try {
+			std::string column = sql::storage::Index(path, /*writable*/ false).column;
+			size_t index = -1;
+			for(size_t i = 0; i < table.columns.size(); i++)
+				if(table.columns[i].name == column)
+					index = i;
+			// If the column has been removed (or the table can no longer be indexed), the index is removed as well
+			if(index == size_t(-1) || table.layout != sql::Table::Row) {
+				sql::storage::PagedFile::remove(path);
+				continue;
+			}
+
+			std::vector<sql::storage::IndexEntry> entries;
+			entries.reserve(table.tuples.size());
+			for(auto& tuple: table.tuples)
+				entries.push_back({tuple[index].data, tuple.rid});
+			sql::storage::Index::create(path, table.name, table.columns[index], std::move(entries));
+		} catch(std::runtime_error) {
+			std::cerr << "!Failed to rebuild index " << split(path.filename().string(), ".")[1] << " because it is corupted." << std::endl;
+		}
+}
+
+// Struct describing how an index can be used to find the tuples which could satisfy some conditions
+struct IndexProbe {
+	// Path to the index
+	std::filesystem::path path;
+	// The (inclusive) range of keys to scan, a missing bound is unbounded
+	std::optional<sql::Data::Variant> lower = std::nullopt, upper = std::nullopt;
+
+	// Find the record IDs of the tuples within the range
+	std::vector<sql::RecordID> scan() { return sql::storage::Index(path, /*writable*/ false).scan(lower, upper); }
+};
+
+// Helper function which chooses one of a table's indexes to find the tuples which could satisfy the provided conditions (equality conditions are preferred over ranges)
+// NOTE: Returns nothing if none of the table's indexes can be used (or the table has been modified by the current transaction), the conditions still need to be applied to the found tuples
+std::optional<IndexProbe> findIndex(sql::Table& schema, const std::vector<sql::WhereAction::Condition>& conditions, ProgramState& state) {
+	if(conditions.empty() || schema.layout != sql::Table::Row) return {};
+	// The indexes describe the table on disk, not the transaction's copy of it
+	if(state.transaction && contains(state.transaction->tables, schema.path)) return {};
+
+	std::optional<IndexProbe> best;
+	for(auto& path: tableIndexes(schema.path)) {
+		size_t column;
+		try {
+			column = findColumn(schema, sql::storage::Index(path, /*writable*/ false).column);
+		} catch(std::runtime_error) { continue; }
+		if(column == size_t(-1)) continue;
+
+		// Combine the bounds of every condition comparing the indexed column to a value
+		IndexProbe probe{path};
+		for(auto& condition: conditions) {
+			if(condition.value.index() == 5 || condition.comp == sql::WhereAction::notEqual || findColumn(schema, condition.column) != column)
+				continue;
+			// Invalid values are reported once the conditions are applied
+			auto value = sql::ast::extractData(condition.value);
+			if(!sql::Data::validateVariant(schema.columns[column], value, /*parserValidation*/ true))
+				return {};
+			sql::Data::applyColumnAdjustments(schema.columns[column], value);
+
+			if(condition.comp != sql::WhereAction::less && condition.comp != sql::WhereAction::lessEqual && (!probe.lower || *probe.lower < value))
+				probe.lower = value;
+			if(condition.comp != sql::WhereAction::greater && condition.comp != sql::WhereAction::greaterEqual && (!probe.upper || value < *probe.upper))
+				probe.upper = value;
+		}
+
+		if(!probe.lower && !probe.upper) continue;
+		bool point = probe.lower && probe.upper && *probe.lower == *probe.upper;
+		if(point) return probe;
+		if(!best) best = std::move(probe);
+	}
+	return best;
+}
+
+// Helper that loads a table that is about to be modified from file, if one of its indexes can be used with the action's conditions only the tuples the index finds are loaded
+// NOTE: Only row tables can be indexed, and they are modified in place, so the tuples which aren't loaded are left untouched
+bool loadIndexedTable(sql::Table& table, const sql::Database& database, sql::WhereAction& action, std::string operation, ProgramState& state) {
+	if(!loadTable(table, database, operation, state, /*schemaOnly*/ true))
+		return false;
+
+	auto probe = findIndex(table, action.conditions, state);
+	if(!probe)
+		return loadTable(table, database, operation, state);
+
+	try {
+		auto rids = probe->scan();
+		return loadTable(table, database, operation, state, /*schemaOnly*/ false, nullptr, &rids);
+	} catch(std::runtime_error) {
+		abort(state) << "!Failed to " << operation << " table " << table.name << " because index " << split(probe->path.filename().string(), ".")[1] << " is corupted." << std::endl;
+	}
+	return false;
+}
+
+// Helper function which locks the rows a statement's conditions selected (once more rows are selected than the escalation threshold, or if the table can't be locked row
+// by row, the whole table is locked instead). The rows may have changed before they were locked, so the table is then reloaded and the rows reselected until every
+// selected row was already locked
+// NOTE: Returns false (after printing an error) if the locks couldn't be taken or the table couldn't be reloaded
+bool lockSelectedRows(sql::Table& table, const sql::Database& database, sql::WhereAction& action, std::string operation, ProgramState& state, std::vector<size_t>& selected) {
+	if(!state.locks) return true;
+
+	while(!selected.empty() && !state.locks->holds(tableResource(table.path), sql::storage::LockManager::Exclusive)) {
+		bool lockedAll = true;
+		if(!rowLockable(table)) {
+			if(!handleTableLock(table, operation, state))
+				return false;
+			lockedAll = false;
+		// NOTE: Changes to an escalated table's rows are still replayed when the transaction commits, so other sessions having modified it isn't an error
+		} else if(selected.size() > state.lockEscalation) {
+			if(!takeLock(tableResource(table.path), sql::storage::LockManager::Exclusive, table, operation, state))
+				return false;
+			// The table's lock covers all of its rows
+			state.locks->releaseChildren(tableResource(table.path));
+			lockedAll = false;
+		} else for(size_t i: selected) {
+			auto row = rowResource(table.path, table.tuples[i].rid);
+			if(state.locks->holds(row, sql::storage::LockManager::Exclusive)) continue;
+			if(!takeLock(row, sql::storage::LockManager::Exclusive, table, operation, state, /*row*/ true))
+				return false;
+			lockedAll = false;
+		}
+		if(lockedAll) break;
+
+		// Reload the table now that the rows can't change
+		table.tuples.clear();
+		if(!loadIndexedTable(table, database, action, operation, state))
+			return false;
+		selected = applyWhereConditions(table, action, operation, workerPool(state));
+	}
+	return true;
+}
+
+
+// Helper function which records the changes the current transaction made to some of a table's rows (the before and after rows are paired by position, either can be empty)
+// NOTE: Only the changes to tables which can be locked row by row are recorded, the rest are locked as a whole
+void recordRowChanges(const sql::Table& table, RowChange::Type type, const std::vector<sql::Tuple>& before, const std::vector<sql::Tuple>& after, ProgramState& state) {
+	if(!state.transaction || !rowLockable(table)) return;
+
+	auto& changes = state.rowChanges[table.path];
+	for(size_t i = 0; i < std::max(before.size(), after.size()); i++)
+		changes.push_back({type, i < before.size() ? before[i] : sql::Tuple{}, i < after.size() ? after[i] : sql::Tuple{}});
+}
+
+// Helper function which recreates a transaction's shadow of a table from the table's current contents, then replays the transaction's changes to the table's rows onto it
+// NOTE: Returns false if another session changed one of the rows after the transaction saw it, the shadow is then left partially replayed
+// NOTE: The record IDs of the changes are updated to where the rows are stored in the table and the new shadow (so they can be replayed into the table's indexes)
+bool rebaseShadow(const std::filesystem::path& tablePath, const std::filesystem::path& shadow, std::vector<RowChange>& changes) {
+	sql::storage::discardShadow(shadow);
+	sql::storage::createShadow(shadow, tablePath);
+
+	// Where each of the rows the transaction moved (or inserted) in its old shadow is stored in the new shadow
+	std::map<std::pair<uint32_t, uint16_t>, sql::RecordID> moved;
+	auto key = [](sql::RecordID rid) { return std::make_pair(rid.page, rid.slot); };
+	auto locate = [&](sql::RecordID rid) {
+		auto found = moved.find(key(rid));
+		return found == moved.end() ? rid : found->second;
+	};
+	auto same = [](const sql::Tuple& a, const sql::Tuple& b) {
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const sql::Data& x, const sql::Data& y) { return x.data == y.data; });
+	};
+
+	try {
+		for(auto& change: changes) {
+			sql::Table table;
+			if(change.type == RowChange::Insert) {
+				sql::storage::readSchema(shadow, table);
+				sql::Tuple& tuple = table.createEmptyTuple();
+				for(size_t c = 0; c < tuple.size() && c < change.after.size(); c++)
+					tuple[c].data = change.after[c].data;
+				sql::storage::insertTuple(shadow, tuple);
+				moved[key(change.after.rid)] = tuple.rid;
+				change.after.rid = tuple.rid;
+				continue;
 			}
+
+			// The row must still be what the transaction saw (it wasn't locked until the transaction read it, so another session may have changed it first)
+			sql::storage::readTuples(shadow, table, {locate(change.before.rid)});
+			if(table.tuples.size() != 1 || !same(table.tuples[0], change.before))
+				return false;
+			moved.erase(key(change.before.rid));
+			change.before.rid = table.tuples[0].rid;
+
+			if(change.type == RowChange::Update) {
+				sql::Tuple& tuple = table.tuples[0];
+				for(size_t c = 0; c < tuple.size() && c < change.after.size(); c++)
+					tuple[c].data = change.after[c].data;
+				sql::storage::updateTuples(shadow, table, {0});
+				moved[key(change.after.rid)] = tuple.rid;
+				change.after.rid = tuple.rid;
+			} else
+				sql::storage::deleteTuples(shadow, table, {0});
+		}
+	} catch(std::runtime_error) {
+		// Rows which no longer exist were deleted by another session
+		return false;
+	}
+	return true;
+}
+
+// Helper function which creates shadows of a table's indexes matching a transaction's shadow of the table, so they can be committed in the same transaction as it (the index shadows are added to <shadows>)
+// NOTE: The transaction's <changes> to the table's rows are replayed into the indexes, if they weren't recorded (null) the indexes are instead rebuilt from the table's shadow
+// NOTE: Indexes whose column no longer exists (or whose table can no longer be indexed) are added to <stale>, they should be removed once the transaction has committed
+void shadowIndexes(const std::filesystem::path& tablePath, const std::filesystem::path& tableShadow, const std::vector<RowChange>* changes, std::vector<std::filesystem::path>& shadows, std::vector<std::filesystem::path>& stale, ProgramState& state) {
+	auto indexes = tableIndexes(tablePath);
+	if(indexes.empty()) return;
+
+	// Only the schema is needed to replay the changes
+	sql::Table table;
+	if(changes) sql::storage::readSchema(tableShadow, table);
+	else sql::storage::readTable(tableShadow, table);
+
+	for(auto& path: indexes) {
+		size_t column = findColumn(table, sql::storage::Index(path, /*writable*/ false).column);
+		if(column == size_t(-1) || table.layout != sql::Table::Row) {
+			stale.push_back(path);
+			continue;
+		}
+		if(changes && changes->empty()) continue;
+
+		auto shadow = sessionLocalFile(path, state);
+		shadows.push_back(shadow);
+		if(!changes) {
+			sql::storage::createShadow(shadow, path, /*rewrite*/ true);
+			std::vector<sql::storage::IndexEntry> entries;
+			entries.reserve(table.tuples.size());
+			for(auto& tuple: table.tuples)
+				entries.push_back({tuple[column].data, tuple.rid});
+			sql::storage::Index::create(shadow, table.name, table.columns[column], std::move(entries));
+			continue;
 		}
 
-		// If all of the conditions hold we need to apply changes to this tuple
-		if(validations == action.conditions.size())
-			selectedTuples.push_back(i);
+		// Only the pages of the index the changes touch are copied into its shadow
+		sql::storage::createShadow(shadow, path);
+		sql::storage::Index index(shadow, /*writable*/ true);
+		for(auto& change: *changes) {
+			// Rows whose indexed value and location didn't change don't need to be touched
+			if(!change.before.empty() && !change.after.empty() && change.before.rid.page == change.after.rid.page && change.before.rid.slot == change.after.rid.slot
+			  && change.before[column].data == change.after[column].data)
+				continue;
+			if(!change.before.empty()) index.erase({change.before[column].data, change.before.rid});
+			if(!change.after.empty()) index.insert({change.after[column].data, change.after.rid});
+		}
+		index.flush();
+	}
+}
+
+// Helper function which writes a statement's changes to some of a table's rows, <write> is given the path to write them to and fills in the rows as they were <added>
+// (with their record IDs), while the rows which were <removed> are known beforehand. The table's indexes are then updated to match (and the changes recorded in the current transaction)
+// NOTE: In a transaction the changes are written to its shadow of the table, its indexes are updated once it commits. Otherwise the changes to a table with indexes are also
+// written to a shadow of it, which is committed along with shadows of its indexes as one transaction in the write-ahead log (so neither a crash nor a reader ever sees the table
+// changed without its indexes)
+// NOTE: Returns false (after printing an error) if the changes couldn't be written, the table and its indexes are then left unchanged
+bool writeRows(const sql::Table& table, RowChange::Type type, const std::vector<sql::Tuple>& removed, const std::vector<sql::Tuple>& added, std::string operation, ProgramState& state, const std::function<void(const std::filesystem::path&)>& write) {
+	bool indexed = !state.transaction && !tableIndexes(table.path).empty();
+	std::vector<std::filesystem::path> shadows, stale;
+	try {
+		auto path = tableWritePath(table, state);
+		if(indexed) {
+			path = sessionLocalFile(table.path, state);
+			shadows.push_back(path);
+			sql::storage::createShadow(path, table.path);
+		}
+		write(path);
+	} catch(const std::runtime_error& e) {
+		for(auto& shadow: shadows)
+			sql::storage::discardShadow(shadow);
+		abort(state) << "!Failed to " << operation << " table " << table.name << " because it couldn't be written (" << e.what() << ")." << std::endl;
+		return false;
+	}
+	recordRowChanges(table, type, removed, added, state);
+	if(!indexed) return true;
+
+	// Replay the changes into shadows of the indexes (tables which were rewritten, or can't be locked row by row, have their indexes rebuilt instead)
+	std::vector<RowChange> changes;
+	for(size_t i = 0; i < std::max(removed.size(), added.size()); i++)
+		changes.push_back({type, i < removed.size() ? removed[i] : sql::Tuple{}, i < added.size() ? added[i] : sql::Tuple{}});
+	bool replay = rowLockable(table) && !sql::storage::isRewrittenShadow(shadows[0]);
+	try {
+		shadowIndexes(table.path, shadows[0], replay ? &changes : nullptr, shadows, stale, state);
+	} catch(const std::runtime_error& e) {
+		for(auto& shadow: shadows)
+			sql::storage::discardShadow(shadow);
+		abort(state) << "!Failed to " << operation << " table " << table.name << " because its indexes couldn't be updated (" << e.what() << ")." << std::endl;
+		return false;
 	}
 
-	return selectedTuples;
+	// Then commit the table and its indexes together
+	try {
+		sql::storage::commitShadows(shadows);
+	} catch(const std::runtime_error& e) {
+		for(auto& shadow: shadows)
+			sql::storage::discardShadow(shadow);
+		abort(state) << "!Failed to " << operation << " table " << table.name << " because it couldn't be written (" << e.what() << ")." << std::endl;
+		return false;
+	}
+	// Indexes which no longer apply to the table are removed
+	for(auto& index: stale)
+		try {
+			sql::storage::PagedFile::remove(index);
+		} catch(const std::runtime_error&) {}
+	return true;
 }
 
 
@@ -543,6 +1264,14 @@ void transaction(std::unique_ptr<sql::Action> action, ProgramState& state) {
 		// Transfer ownership of this transaction to the program state
 		state.transaction = std::move(transaction);
 
+		// Every query in the transaction reads the tables as they were when it began
+		state.snapshots = std::make_unique<sql::storage::SnapshotSet>();
+		if(state.currentDatabase) {
+			sql::storage::PublishLock publishing(state.currentDatabase->path, /*exclusive*/ false);
+			for(auto& table: state.currentDatabase->tables)
+				snapshotTable(*state.snapshots, table);
+		}
+
 		std::cout << "Transaction started." << std::endl;
 	}
 	break; case sql::TransactionAction::Commit: {
@@ -552,17 +1281,78 @@ void transaction(std::unique_ptr<sql::Action> action, ProgramState& state) {
 			return;
 		}
 
-		// Overwrite the tables with the modififed versions from the transaction
-		for(auto& [dest, src]: state.transaction->tables) {
-			copy(src, dest, std::filesystem::copy_options::overwrite_existing);
-			remove(src);
-			releaseLock(dest);
-		}
+		// Latch the tables while they are committed, then replay the transaction's row changes onto the current contents of any table another session modified
+		// after the transaction began (the other session can only have modified rows the transaction didn't lock)
+		// NOTE: Every table is latched before any of them are rebased, so a commit which has to wait for a latch can be executed again
+		bool committed = true;
+		std::string reason;
+		for(auto& [dest, src]: state.transaction->tables)
+			if(state.locks && requestLock(latchResource(dest), sql::storage::LockManager::Exclusive, {}, state) != sql::storage::LockManager::Granted) {
+				committed = false;
+				reason = " because table " + dest.stem().string() + " is being written by another session";
+				break;
+			}
+		if(committed)
+			for(auto& [dest, src]: state.transaction->tables) {
+				auto changes = state.rowChanges.find(dest);
+				if(changes == state.rowChanges.end() || sql::storage::isRewrittenShadow(src) || !state.snapshots || state.snapshots->current(dest))
+					continue;
+				bool rebased = false;
+				try {
+					rebased = rebaseShadow(dest, src, changes->second);
+				} catch(std::runtime_error) {}
+				if(!rebased) {
+					committed = false;
+					reason = " because another session modified the same rows of table " + dest.stem().string();
+					break;
+				}
+			}
+
+		// Shadow the tables' indexes to match, replaying the transaction's row changes into them (tables the transaction rewrote have their indexes rebuilt instead)
+		std::vector<std::filesystem::path> shadows, stale;
+		for(auto& [dest, src]: state.transaction->tables)
+			shadows.push_back(src);
+		if(committed)
+			for(auto& [dest, src]: state.transaction->tables) {
+				static const std::vector<RowChange> unchanged;
+				auto changes = state.rowChanges.find(dest);
+				const std::vector<RowChange>* replay = nullptr;
+				if(!sql::storage::isRewrittenShadow(src))
+					replay = changes == state.rowChanges.end() ? &unchanged : &changes->second;
+				try {
+					shadowIndexes(dest, src, replay, shadows, stale, state);
+				} catch(const std::runtime_error&) {
+					committed = false;
+					reason = " because the indexes of table " + dest.stem().string() + " couldn't be updated";
+					break;
+				}
+			}
+
+		// Overwrite the tables (and their indexes) with the modififed versions from the transaction (all at once, a crash can't leave only some of them changed)
+		if(committed)
+			try {
+				sql::storage::commitShadows(shadows);
+			} catch(const std::runtime_error&) {
+				committed = false;
+			}
+		// If the transaction wasn't committed (or failed before it could be), its shadows are discarded
+		if(!committed)
+			for(auto& shadow: shadows)
+				sql::storage::discardShadow(shadow);
+		// Indexes which no longer apply to their table are removed once it has committed
+		else for(auto& index: stale)
+			try {
+				sql::storage::PagedFile::remove(index);
+			} catch(const std::runtime_error&) {}
+		if(state.locks) state.locks->releaseAll();
 
 		// We are no longer in a transaction
 		state.transaction = nullptr;
+		state.snapshots = nullptr;
+		state.rowChanges.clear();
 
-		std::cout << "Transaction committed." << std::endl;
+		if(committed) std::cout << "Transaction committed." << std::endl;
+		else std::cerr << "!Failed to commit transaction" << reason << "." << std::endl;
 	}
 	break; case sql::TransactionAction::Abort: {
 		// If there is not already a transaction, then we fail to finish it
@@ -572,13 +1362,14 @@ void transaction(std::unique_ptr<sql::Action> action, ProgramState& state) {
 		}
 
 		// Discard the modified versions of the tables
-		for(auto& [original, modified]: state.transaction->tables) {
-			remove(modified);
-			releaseLock(original);
-		}
+		for(auto& [original, modified]: state.transaction->tables)
+			sql::storage::discardShadow(modified);
+		if(state.locks) state.locks->releaseAll();
 
 		// We are no longer in a transaction
 		state.transaction = nullptr;
+		state.snapshots = nullptr;
+		state.rowChanges.clear();
 
 		std::cout << "Transaction aborted." << std::endl;
 	}
@@ -612,13 +1403,33 @@ void useDatabase(const sql::Action& action, ProgramState& state, bool quiet /*=
 		std::cerr << "!Failed to use database " << database.name << " because its metadata doesn't exist." << std::endl;
 		return;
 	}
+
+	// Repair any changes which were interrupted by a crash
+	try {
+		size_t recovered = sql::storage::WriteAheadLog::recover(database.path);
+		if(recovered > 0 && !quiet) std::cout << "Recovered " << recovered << " changes from the write-ahead log." << std::endl;
+	} catch(std::runtime_error) {
+		std::cerr << "!Failed to use database " << database.name << " because its write-ahead log couldn't be recovered." << std::endl;
+		return;
+	}
+
+	// Open the database's lock table
+	std::unique_ptr<sql::storage::LockManager> locks;
+	try {
+		locks = std::make_unique<sql::storage::LockManager>(database.path);
+	} catch(std::runtime_error) {
+		std::cerr << "!Failed to use database " << database.name << " because its lock table couldn't be opened." << std::endl;
+		return;
+	}
+
 	simple::file_istream<std::true_type> fin((database.path / metadataFileName).c_str());
 	try {
 		// Load the database's metadata file
 		fin >> database;
 
-		// Update the current database
+		// Update the current database (and switch to its lock table)
 		state.currentDatabase = database;
+		state.locks = std::move(locks);
 
 		if(!quiet) std::cout << "Using database " << database.name << "." << std::endl;
 	} catch(std::runtime_error) {
@@ -746,13 +1557,14 @@ void createTable(const sql::Action& _action, ProgramState& state){
 	}
 	if(duplicates) return;
 
-	// Set the table's column metadata
+	// Set the table's column metadata (and how it should be stored)
 	table.columns = action.columns;
-	// Add the table to the database's metadata
-	database.tables.push_back(table.path);
+	table.layout = action.layout;
 
-	// Save the changes to disk
-	saveTableFile(table, "create", state);
+	// Save the table to disk, then add it to the database's metadata
+	if(!saveTableFile(table, "create", state))
+		return;
+	database.tables.push_back(table.path);
 	saveDatabaseMetadataFile(database);
 
 	std::cout << "Table " << table.name << " created." << std::endl;
@@ -790,34 +1602,147 @@ void dropTable(const sql::Action& action, ProgramState& state){
 	// Remove the table from the database
 	database.tables.erase(itterator);
 
-	// Save the changes to disk
-	std::filesystem::remove(tablePath);
+	// Save the changes to disk (removing the table's indexes along with it)
+	sql::storage::PagedFile::remove(tablePath);
+	for(auto& index: tableIndexes(tablePath))
+		sql::storage::PagedFile::remove(index);
 	saveDatabaseMetadataFile(database);
 
 	std::cout << "Table " << action.target.name << " deleted." << std::endl;
 }
 
-// Function which modifies the metadata of a action
-void alterTable(const sql::Action& _action, ProgramState& state){
+// Function which creates a B+tree index on one of a table's columns
+void createIndex(const sql::Action& _action, ProgramState& state){
 	// Sanity checked downcast to the special type of action used by this function
-	if(_action.action != sql::Action::Alter)
-		throw std::runtime_error("A parsing issue has occured! Somehow a non-AlterTableAction has arrived in alterTable");
-	const sql::AlterTableAction& action = *reinterpret_cast<const sql::AlterTableAction*>(&_action);
+	if(_action.action != sql::Action::Create)
+		throw std::runtime_error("A parsing issue has occured! Somehow a non-CreateIndexAction has arrived in createIndex");
+	const sql::CreateIndexAction& action = *reinterpret_cast<const sql::CreateIndexAction*>(&_action);
 
 	// Make sure that a database is currently being used
 	if(!state.currentDatabase.has_value()){
-		abort(state) << "!Failed to alter table " << action.target.name << " because no database is currently being used." << std::endl;
+		std::cerr << "!Failed to create index " << action.target.name << " because no database is currently being used." << std::endl;
 		return;
 	}
 	sql::Database& database = *state.currentDatabase;
 
-	// Create a table and set its metadata
-	sql::Table table;
-	table.name = action.target.name;
-	table.path = database.path / (table.name + ".table");
-
-	// Create lock (or fail if someone else has lock)
-	if(!handleTableLock(table, "alter", state))
+	// If there is currently a transaction, error
+	if(state.transaction) {
+		std::cerr << "!Failed to create index " << action.target.name << " because you can't create indexes during a transaction." << std::endl;
+		return;
+	}
+
+	// Disallow periods
+	if(action.target.name.find(".") != std::string::npos){
+		std::cerr << "!Failed to create index " << action.target.name << " because index names are not allowed to contain a period." << std::endl;
+		return;
+	}
+
+	// Ensure that the index doesn't already exist (index names are unique across the database)
+	if(!findIndexes(database.path, "", action.target.name).empty()){
+		std::cerr << "!Failed to create index " << action.target.name << " because it already exists." << std::endl;
+		return;
+	}
+
+	// Create a temporary table and set its metadata
+	sql::Table table;
+	table.name = action.table;
+	table.path = database.path / (table.name + ".table");
+
+	// Take the table's lock (waiting if another session holds it)
+	if(!handleTableLock(table, "create an index on", state))
+		return;
+
+	// Load the table from disk (helper handles ensuring that it exists)
+	if(!loadTable(table, database, "create an index on", state))
+		return;
+
+	// Find the column being indexed
+	size_t column = -1;
+	for(size_t i = 0; i < table.columns.size(); i++)
+		if(table.columns[i].name == action.column)
+			column = i;
+	if(column == size_t(-1)){
+		std::cerr << "!Failed to create index " << action.target.name << " because table " << table.name << " doesn't contain a column named " << action.column << "." << std::endl;
+		return;
+	}
+
+	// Only tables whose tuples have stable record IDs can be indexed
+	if(table.layout != sql::Table::Row){
+		std::cerr << "!Failed to create index " << action.target.name << " because columnar tables can't be indexed." << std::endl;
+		return;
+	}
+
+	try {
+		// Legacy tables are upgraded (and reloaded so that their tuples have record IDs) before they are indexed
+		if(sql::storage::isLegacyTableFile(table.path)) {
+			sql::storage::writeTable(table.path, table);
+			table.tuples.clear();
+			sql::storage::readTable(table.path, table);
+		}
+
+		// Build the index from every tuple in the table
+		std::vector<sql::storage::IndexEntry> entries;
+		entries.reserve(table.tuples.size());
+		for(auto& tuple: table.tuples)
+			entries.push_back({tuple[column].data, tuple.rid});
+		sql::storage::Index::create(indexPath(table.path, action.target.name), table.name, table.columns[column], std::move(entries));
+	} catch(std::runtime_error) {
+		std::cerr << "!Failed to create index " << action.target.name << " because table " << table.name << " is corupted." << std::endl;
+		return;
+	}
+
+	std::cout << "Index " << action.target.name << " created." << std::endl;
+}
+
+// Function which deletes an index
+void dropIndex(const sql::Action& action, ProgramState& state){
+	// Make sure that a database is currently being used
+	if(!state.currentDatabase.has_value()){
+		std::cerr << "!Failed to delete index " << action.target.name << " because no database is currently being used." << std::endl;
+		return;
+	}
+	sql::Database& database = *state.currentDatabase;
+
+	// Ensure that the index exists
+	auto indexes = findIndexes(database.path, "", action.target.name);
+	if(indexes.empty()){
+		std::cerr << "!Failed to delete index " << action.target.name << " because it doesn't exist." << std::endl;
+		return;
+	}
+
+	// If there is currently a transaction, error
+	if(state.transaction) {
+		std::cerr << "!Failed to delete index " << action.target.name << " because you can't delete indexes during a transaction." << std::endl;
+		return;
+	}
+
+	for(auto& index: indexes)
+		sql::storage::PagedFile::remove(index);
+
+	std::cout << "Index " << action.target.name << " deleted." << std::endl;
+}
+
+// Function which modifies the metadata of a action
+void alterTable(const sql::Action& _action, ProgramState& state){
+	// Sanity checked downcast to the special type of action used by this function
+	if(_action.action != sql::Action::Alter)
+		throw std::runtime_error("A parsing issue has occured! Somehow a non-AlterTableAction has arrived in alterTable");
+	const sql::AlterTableAction& action = *reinterpret_cast<const sql::AlterTableAction*>(&_action);
+
+	// Make sure that a database is currently being used
+	if(!state.currentDatabase.has_value()){
+		abort(state) << "!Failed to alter table " << action.target.name << " because no database is currently being used." << std::endl;
+		return;
+	}
+	sql::Database& database = *state.currentDatabase;
+
+	// Create a table and set its metadata
+	sql::Table table;
+	table.name = action.target.name;
+	table.path = database.path / (table.name + ".table");
+
+	// Take the table's lock (waiting if another session holds it)
+	if(!handleTableLock(table, "alter", state))
 		return;
 
 	// Load the table from disk (helper handles ensuring that it exists)
@@ -832,7 +1757,8 @@ void alterTable(const sql::Action& _action, ProgramState& state){
 			break;
 		}
 
-	// Determine how to procede based on the secondary alter action
+	// Determine how to procede based on the secondary alter action (describing the change once it has been saved)
+	std::string change;
 	switch(action.alterAction){
 	break; case sql::Action::Add: {
 		// Make sure sure that the column isn't in the metadata, error if present
@@ -852,7 +1778,7 @@ void alterTable(const sql::Action& _action, ProgramState& state){
 		for(sql::Tuple& tuple: table.tuples)
 			tuple.emplace_back(sql::Data::null(&table.columns.back()));
 
-		std::cout << "Table " << table.name << " modified, added " << action.alterTarget.name << "." << std::endl;
+		change = "added " + action.alterTarget.name;
 	}
 	break; case sql::Action::Remove: {
 		// Find the column's index in the table, error if not present
@@ -866,7 +1792,7 @@ void alterTable(const sql::Action& _action, ProgramState& state){
 		for(sql::Tuple& tuple: table.tuples)
 			tuple.erase(tuple.begin() + index);
 
-		std::cout << "Table " << table.name << " modified, removed " << action.alterTarget.name << "." << std::endl;
+		change = "removed " + action.alterTarget.name;
 	}
 	break; case sql::Action::Alter: {
 		// Find the column's index in the table, error if not present
@@ -880,15 +1806,20 @@ void alterTable(const sql::Action& _action, ProgramState& state){
 		for(sql::Tuple& tuple: table.tuples)
 			tuple[index] = sql::Data::null(&table.columns[index]);
 
-		std::cout << "Table " << table.name << " modified, modified " << action.alterTarget.name << "." << std::endl;
+		change = "modified " + action.alterTarget.name;
 	}
 	// If the action is unsupported, error
 	break; default:
 		throw std::runtime_error("!Unsupported action: " + sql::Action::ActionNames[action.alterAction]);
 	}
 
-	// Save changes to disk
-	saveTableFile(table, "alter", state);
+	// Save changes to disk (the tuples are rewritten, so the table's indexes need to be rebuilt)
+	if(!saveTableFile(table, "alter", state))
+		return;
+	if(!state.transaction)
+		rebuildIndexes(table.path);
+
+	std::cout << "Table " << table.name << " modified, " << change << "." << std::endl;
 }
 
 // Function which inserts a new tuple into a table
@@ -910,12 +1841,15 @@ void insertIntoTable(const sql::Action& _action, ProgramState& state){
 	table.name = action.target.name;
 	table.path = database.path / (table.name + ".table");
 
-	// Create lock (or fail if someone else has lock)
-	if(!handleTableLock(table, "insert into", state))
+	// Take an intention lock on the table (waiting if another session has locked the whole table), the new row can't be seen by other sessions until it is inserted
+	if(!handleTableLock(table, "insert into", state, sql::storage::LockManager::IntentionExclusive))
 		return;
 
-	// Load the table from disk (helper handles ensuring that it exists)
-	if(!loadTable(table, database, "insert into", state))
+	// Load the table's metadata from disk (helper handles ensuring that it exists), the existing tuples aren't needed to insert a new one
+	if(!loadTable(table, database, "insert into", state, /*schemaOnly*/ true))
+		return;
+	// Tables which can't be locked row by row are locked as a whole
+	if(!rowLockable(table) && !handleTableLock(table, "insert into", state))
 		return;
 
 	// Create a new empty tuple in the table
@@ -949,10 +1883,484 @@ void insertIntoTable(const sql::Action& _action, ProgramState& state){
 	for(sql::Data& data: tuple)
 		data.applyColumnAdjustments();
 
+	// Make sure the tuple can be stored in a single page
+	if(!sql::storage::fitsInPage(tuple)){
+		abort(state) << "!Failed to insert into table " << action.target.name << " because the record is larger than " << sql::storage::maxRecordSize << " bytes." << std::endl;
+		return;
+	}
+
+	// Latch the table while its pages are written
+	if(!latchTable(table, "insert into", state))
+		return;
+
+	// Insert the new tuple into the table on disk (only the pages it touches are written), and add it to the table's indexes
+	std::vector<sql::Tuple> added;
+	if(!writeRows(table, RowChange::Insert, {}, added, "insert into", state, [&](const std::filesystem::path& path) {
+		sql::storage::insertTuple(path, tuple);
+		added = {tuple};
+	}))
+		return;
+
 	std::cout << "1 new record inserted." << std::endl;
+}
+
+// Helper function which removes the tuples of a table which don't satisfy the provided conditions, returns false if the conditions are invalid
+bool filterTable(sql::Table& table, const sql::Action::Target& target, std::vector<sql::WhereAction::Condition> conditions, sql::WorkerPool* workers = nullptr) {
+	if(conditions.empty()) return true;
+
+	sql::WhereAction action{{sql::Action::Query, target}, std::move(conditions)};
+	bool valid = true;
+	auto selectedTuples = applyWhereConditions(table, action, "query", workers, &valid);
+	if(!valid) return false;
+
+	// Move the selected tuples into a new array, which becomes the table's list of tuples
+	std::vector<sql::Tuple> tuples;
+	tuples.reserve(selectedTuples.size());
+	for(size_t selected: selectedTuples)
+		tuples.emplace_back(std::move(table.tuples[selected]));
+	table.tuples = std::move(tuples);
+	return true;
+}
+
+// Helper function which finds the columns of a table that a query's tuples are ordered by
+// NOTE: Returns false (after printing an error) if any of the columns don't exist
+bool prepareOrder(sql::Table& table, sql::QueryTableAction& action, std::vector<sql::SortKey>& keys) {
+	for(auto& order: action.orderBy) {
+		size_t index = findColumn(table, order.column);
+		if(index == -1) {
+			std::cerr << "!Failed to query table " << action.target.name << " because it doesn't contain an order column named " << order.column << "." << std::endl;
+			return false;
+		}
+		keys.push_back({index, order.descending});
+	}
+	return true;
+}
+
+// Helper function which orders a table's (already loaded) tuples and removes those outside of the query's LIMIT and OFFSET
+// NOTE: If the limit is small enough, a bounded heap only keeps the tuples which will be output instead of sorting every tuple
+// NOTE: If <workers> is provided large tables are sorted in parallel
+void orderAndLimit(sql::Table& table, sql::QueryTableAction& action, const std::vector<sql::SortKey>& keys, sql::WorkerPool* workers = nullptr) {
+	auto& tuples = table.tuples;
+	if(!keys.empty() && action.limitEnd() <= sql::TopN::maxTuples) {
+		sql::TopN top(table, keys, action.limitEnd());
+		for(sql::Tuple& tuple: tuples)
+			top.add(tuple);
+		tuples.clear();
+		top.finish([&](const sql::Tuple& tuple) {
+			tuples.emplace_back(tuple).table = &table;
+		});
+	} else sql::stableSort(workers, tuples.begin(), tuples.end(), sql::TupleOrder{keys});
+
+	tuples.erase(tuples.begin(), tuples.begin() + std::min(action.offset, tuples.size()));
+	if(tuples.size() > action.limit)
+		tuples.erase(tuples.begin() + action.limit, tuples.end());
+}
+
+// Helper that determines the name a column is printed with (columns are printed without the alias qualifying them, aggregates are printed as they were written)
+std::string printedName(const std::string& name) {
+	if(name.find('(') != std::string::npos) return name;
+	return split(name, ".").back();
+}
+
+// Helper function which prints the columns and tuples of a table
+void printTable(sql::Table& table, ProgramState& state) {
+	// If the table has no metadata then there is nothing to display
+	if(table.columns.empty())
+		return;
+
+	// If there is an active transaction, warn that the show data is outdated
+	if(state.transaction)
+		std::cout << "NOTE: There is an active transaction, commit the transaction to see its data!" << std::endl;
+
+	// Print out the headers
+	std::cout << printedName(table.columns[0].name) << " " << table.columns[0].type.to_string();
+	for(int i = 1; i < table.columns.size(); i++)
+		std::cout << " | " << printedName(table.columns[i].name) << " " << table.columns[i].type.to_string();
+	std::cout << std::endl;
+
+	// Print out the data
+	for(sql::Tuple& t: table.tuples){
+		bool first = true;
+		for(sql::Data& d: t) {
+			std::visit([first](auto v){
+				if(!first) std::cout << " | ";
+
+				if constexpr(std::is_same_v<decltype(v), std::monostate>) std::cout << "null";
+				else std::cout << v;
+			}, d.data);
+			first = false;
+		}
+		std::cout << std::endl;
+	}
+}
+
+// Helper function which prepares the hash aggregation of a query, the columns it groups by and aggregates are found and the columns of <result> are set to the grouped columns followed by the aggregates
+// NOTE: <output> is set to the indices of the result's columns which the query prints (in order)
+// NOTE: Returns an empty optional (after printing an error) if the query can't be aggregated
+std::optional<sql::HashAggregation> prepareAggregation(sql::Table& table, sql::QueryTableAction& action, sql::Table& result, std::vector<size_t>& output) {
+	using Aggregate = sql::QueryTableAction::Aggregate;
+	if(action.columns.all()) {
+		std::cerr << "!Failed to query table " << action.target.name << " because * can't be queried alongside aggregates or a GROUP BY clause." << std::endl;
+		return {};
+	}
+
+	// Find the grouped columns
+	std::vector<size_t> groupColumns;
+	for(auto& name: action.groupBy) {
+		size_t index = findColumn(table, name);
+		if(index == -1) {
+			std::cerr << "!Failed to query table " << action.target.name << " because it doesn't contain a grouped column named " << name << "." << std::endl;
+			return {};
+		}
+		groupColumns.push_back(index);
+		result.columns.push_back(table.columns[index]);
+	}
+
+	// Find the aggregated columns and determine the types of the aggregates (an aggregate which appears more than once is only calculated once)
+	std::vector<sql::HashAggregation::Aggregate> aggregates;
+	for(auto& aggregate: action.aggregates) {
+		if(findColumn(result, aggregate.name()) != -1) continue;
+
+		sql::HashAggregation::Aggregate resolved{aggregate.function, (size_t) -1, sql::DataType::INT};
+		sql::DataType type{sql::DataType::INT};
+		if(aggregate.column.has_value()) {
+			resolved.column = findColumn(table, *aggregate.column);
+			if(resolved.column == -1) {
+				std::cerr << "!Failed to query table " << action.target.name << " because it doesn't contain an aggregated column named " << *aggregate.column << "." << std::endl;
+				return {};
+			}
+			type = table.columns[resolved.column].type;
+			resolved.type = type.type;
+
+			// Only numbers can be summed or averaged
+			if((aggregate.function == Aggregate::Sum || aggregate.function == Aggregate::Avg) && type.type != sql::DataType::INT && type.type != sql::DataType::FLOAT) {
+				std::cerr << "!Failed to query table " << action.target.name << " because " << aggregate.name() << " can't be calculated for a column of type " << type.to_string() << "." << std::endl;
+				return {};
+			}
+		} else if(aggregate.function != Aggregate::Count) {
+			std::cerr << "!Failed to query table " << action.target.name << " because " << aggregate.name() << " requires a column." << std::endl;
+			return {};
+		}
+
+		// Counts are integers and averages are floats, the rest of the aggregates have the type of their column
+		if(aggregate.function == Aggregate::Count) type = {sql::DataType::INT};
+		else if(aggregate.function == Aggregate::Avg) type = {sql::DataType::FLOAT};
+		aggregates.push_back(resolved);
+		result.columns.emplace_back(aggregate.name(), type);
+	}
+
+	// Determine which of the result's columns are printed, the queried columns fill in the positions the aggregates don't occupy
+	output.assign(action.columns->size(), -1);
+	for(auto& aggregate: action.aggregates)
+		if(aggregate.position != -1)
+			output.insert(output.begin() + std::min(aggregate.position, output.size()), findColumn(result, aggregate.name()));
+	auto column = action.columns->begin();
+	for(size_t& index: output) {
+		if(index != -1) continue;
+
+		// Only grouped columns can be queried (every tuple in a group shares their values)
+		index = findColumn(result, *column);
+		if(index == -1 || index >= groupColumns.size()) {
+			std::cerr << "!Failed to query table " << action.target.name << " because column " << *column << " is neither grouped nor aggregated." << std::endl;
+			return {};
+		}
+		column++;
+	}
+
+	return sql::HashAggregation(std::move(groupColumns), std::move(aggregates));
+}
+
+// Helper function which finishes the hash aggregation of a query, the groups are filtered by the HAVING conditions and then the query's columns are projected (in order)
+// NOTE: Returns false (after printing an error) if the HAVING conditions are invalid
+bool finishAggregation(sql::HashAggregation& aggregation, sql::QueryTableAction& action, sql::Table& result, const std::vector<size_t>& output) {
+	aggregation.finish(result);
+	if(!filterTable(result, action.target, action.having))
+		return false;
+
+	// Order and limit the groups (there is only one tuple per group, so they are always sorted in memory)
+	std::vector<sql::SortKey> keys;
+	if(!prepareOrder(result, action, keys))
+		return false;
+	orderAndLimit(result, action, keys);
+
+	sql::Table projectedTable;
+	for(size_t i: output)
+		projectedTable.columns.emplace_back(result.columns[i]);
+	for(sql::Tuple& tuple: result.tuples) {
+		sql::Tuple& projectedTuple = projectedTable.createEmptyTuple();
+		size_t i = 0;
+		for(size_t keep: output)
+			projectedTuple[i++].data = tuple[keep].data;
+	}
+	result = std::move(projectedTable);
+	return true;
+}
+
+// Helper function which performs a single table query by mapping the table's file into memory, tuples are filtered and printed without copying any of their data
+// NOTE: Returns false if the query couldn't be performed this way (the table is in the legacy format or doesn't exist), in which case it should be performed normally
+bool queryMappedTable(sql::QueryTableAction& action, const sql::Database& database, ProgramState& state) {
+	auto& alias = action.tableAliases.front();
+	auto path = database.path / (alias.table + ".table");
+	// Let the normal path report any missing tables
+	if(std::find(database.tables.begin(), database.tables.end(), path) == database.tables.end() || !exists(path) || sql::storage::isLegacyTableFile(path))
+		return false;
+
+	try {
+		auto columns = referencedColumns(action, alias);
+		sql::storage::MappedTable mapped(path, action.columns.all() ? nullptr : &columns);
+		sql::Table& table = mapped.table;
+		// Add the alias to the table columns' names
+		for(auto& column: table.columns)
+			column.name = alias.alias + "." + column.name;
+
+		// Find the columns associated with the conditions
+		std::vector<size_t> conditionColumns, conditionDataColumns;
+		if(!prepareWhereConditions(table, action, "query", conditionColumns, conditionDataColumns))
+			return true;
+		sql::Predicate<std::vector<sql::storage::DataView>> predicate(table, action.conditions, conditionColumns, conditionDataColumns);
+
+		// Aggregate queries stream every tuple which satisfies the conditions into the aggregation, then print its result
+		if(action.isAggregate()) {
+			sql::Table result;
+			std::vector<size_t> output;
+			auto aggregation = prepareAggregation(table, action, result, output);
+			if(!aggregation) return true;
+
+			while(mapped.next())
+				if(predicate(mapped.current))
+					aggregation->add(mapped.current);
+
+			if(finishAggregation(*aggregation, action, result, output))
+				printTable(result, state);
+			return true;
+		}
+
+		// Calculate the indecies of the columns we need to print
+		std::vector<size_t> columnsToKeep;
+		if(action.columns.all())
+			for(size_t i = 0; i < table.columns.size(); i++)
+				columnsToKeep.push_back(i);
+		else for(std::string column: *action.columns){
+			size_t index = findColumn(table, column);
+			if(index == -1){
+				std::cerr << "!Failed to query table " << alias.table << " because projection column " << column << " doesn't exist." << std::endl;
+				return true;
+			}
+
+			columnsToKeep.push_back(index);
+		}
+
+		// If the table has no metadata then there is nothing to display
+		if(columnsToKeep.empty())
+			return true;
+
+		// Find the columns the tuples are ordered by
+		std::vector<sql::SortKey> keys;
+		if(!prepareOrder(table, action, keys))
+			return true;
+
+		// Print out the headers (if there are conditions they are only printed once a tuple satisfies them)
+		bool printedHeaders = false;
+		auto printHeaders = [&] {
+			// If there is an active transaction, warn that the show data is outdated
+			if(state.transaction)
+				std::cout << "NOTE: There is an active transaction, commit the transaction to see its data!" << std::endl;
+
+			std::cout << printedName(table.columns[columnsToKeep[0]].name) << " " << table.columns[columnsToKeep[0]].type.to_string();
+			for(size_t i = 1; i < columnsToKeep.size(); i++)
+				std::cout << " | " << printedName(table.columns[columnsToKeep[i]].name) << " " << table.columns[columnsToKeep[i]].type.to_string();
+			std::cout << std::endl;
+			printedHeaders = true;
+		};
+		if(action.conditions.empty())
+			printHeaders();
+
+		// Helper which prints a row (either the mapped table's current tuple, or a sorted tuple)
+		auto printRow = [&](const auto& row) {
+			if(!printedHeaders) printHeaders();
+
+			bool first = true;
+			for(size_t keep: columnsToKeep) {
+				std::visit([first](const auto& v){
+					if(!first) std::cout << " | ";
+
+					if constexpr(std::is_same_v<std::decay_t<decltype(v)>, std::monostate>) std::cout << "null";
+					else std::cout << v;
+				}, sql::cell(row, keep));
+				first = false;
+			}
+			std::cout << std::endl;
+		};
+
+		// Helper which prints the rows within the query's LIMIT and OFFSET, returns false once every row which will be printed has been
+		size_t seen = 0, end = action.limitEnd();
+		auto printLimitedRow = [&](const auto& row) {
+			if(seen >= action.offset && seen < end)
+				printRow(row);
+			return ++seen < end;
+		};
+
+		// Print out the data of every tuple which satisfies all of the conditions (the scan stops once the limit has been reached)
+		auto& tuple = mapped.current;
+		if(keys.empty()) {
+			if(end == 0) return true;
+			while(mapped.next())
+				if(predicate(tuple) && !printLimitedRow(tuple))
+					break;
+
+		// Limited ordered queries only keep the tuples they will print in a bounded heap
+		} else if(end <= sql::TopN::maxTuples) {
+			sql::TopN top(table, keys, end);
+			while(mapped.next())
+				if(predicate(tuple))
+					top.add(tuple);
+			top.finish([&](const sql::Tuple& sorted) { printLimitedRow(sorted); });
+
+		// Other ordered queries stream the tuples into an external sort (which spills them to disk once they outgrow its memory budget), then print them in order
+		} else {
+			sql::ExternalSort sort(table, keys, database.path, state.sortMemory, workerPool(state));
+			while(mapped.next())
+				if(predicate(tuple))
+					sort.add(tuple);
+			sort.finish([&](const sql::Tuple& sorted) { printLimitedRow(sorted); });
+		}
+	} catch(std::runtime_error) {
+		std::cerr << "!Failed to query table " << alias.table << " because it is corupted." << std::endl;
+	}
+
+	return true;
+}
+
+// Helper function which joins a table onto the (already joined) tables to its left, a pair of tuples match if all of the conditions hold for them
+// Equality conditions between a column of each side become the keys of a hash join (the right table is built into a hash table which each left tuple then probes), otherwise every pair of tuples is checked
+// NOTE: Left joins mark which left tuples matched, the unmatched tuples are then added (padded with nulls) after all of the matches
+// NOTE: If <workers> is provided large left tables are probed (and their matches copied) a morsel at a time in parallel
+// NOTE: Returns false (after printing an error) if any of the conditions are invalid
+bool joinTables(sql::Table& left, sql::Table& right, bool leftJoin, sql::WhereAction& action, sql::Table& joined, sql::WorkerPool* workers = nullptr) {
+	// Create a new table with all of the columns of both tables
+	joined.columns = left.columns;
+	joined.columns.insert(joined.columns.end(), right.columns.begin(), right.columns.end());
+	const size_t offset = left.columns.size();
+
+	// Find the columns associated with the conditions (in the joined table)
+	std::vector<size_t> conditionColumns, conditionDataColumns;
+	if(!prepareWhereConditions(joined, action, "query", conditionColumns, conditionDataColumns))
+		return false;
+
+	// Split the conditions into hash join keys and conditions that need to be checked for each pair of tuples
+	std::vector<size_t> leftKeys, rightKeys, residual;
+	std::vector<sql::Data::Variant> conditionValues;
+	for(size_t i = 0; i < action.conditions.size(); i++) {
+		auto& condition = action.conditions[i];
+		conditionValues.push_back(condition.value.index() == 5 ? sql::Data::Variant{} : sql::ast::extractData(condition.value));
+
+		size_t column = conditionColumns[i], dataColumn = conditionDataColumns[i];
+		if(condition.comp == sql::WhereAction::equal && dataColumn != -1 && (column < offset) != (dataColumn < offset)) {
+			leftKeys.push_back(std::min(column, dataColumn));
+			rightKeys.push_back(std::max(column, dataColumn) - offset);
+		} else residual.push_back(i);
+	}
+
+	// Build a hash table mapping the right table's keys to its tuples
+	using Key = std::vector<sql::Data::Variant>;
+	struct KeyHash {
+		size_t operator()(const Key& key) const {
+			size_t hash = 0;
+			for(auto& data: key)
+				hash = hash * 31 + std::hash<sql::Data::Variant>{}(data);
+			return hash;
+		}
+	};
+	std::unordered_map<Key, std::vector<size_t>, KeyHash> built;
+	Key key(rightKeys.size());
+	if(!rightKeys.empty()) {
+		built.reserve(right.tuples.size());
+		for(size_t i = 0; i < right.tuples.size(); i++) {
+			for(size_t k = 0; k < rightKeys.size(); k++)
+				key[k] = right.tuples[i][rightKeys[k]].data;
+			built[key].push_back(i);
+		}
+	}
+	// Without any keys, every right tuple is a candidate match
+	std::vector<size_t> everyTuple;
+	if(rightKeys.empty())
+		for(size_t i = 0; i < right.tuples.size(); i++)
+			everyTuple.push_back(i);
+
+	// Helper which fills in an (empty) tuple of the joined table from a left tuple and a right tuple (or nulls)
+	auto fillTuple = [&](sql::Tuple& tuple, const sql::Tuple& leftTuple, const sql::Tuple* rightTuple) {
+		tuple.table = &joined;
+		for(sql::Column& column: joined.columns)
+			tuple.emplace_back(sql::Data::null(&column));
+		for(size_t i = 0; i < leftTuple.size(); i++)
+			tuple[i].data = leftTuple[i].data;
+		if(rightTuple)
+			for(size_t i = 0; i < rightTuple->size(); i++)
+				tuple[i + offset].data = (*rightTuple)[i].data;
+	};
+
+	// Helper which processes each morsel of the left table (in parallel if there are workers)
+	size_t morsels = std::max<size_t>((left.tuples.size() + sql::morselSize - 1) / sql::morselSize, 1);
+	auto forEachMorsel = [&](const std::function<void(size_t morsel)>& process) {
+		if(workers) workers->run(morsels, process);
+		else for(size_t morsel = 0; morsel < morsels; morsel++)
+			process(morsel);
+	};
+
+	// Probe with each of the left tuples, finding every right tuple they match (each morsel remembers its own matches)
+	std::vector<std::vector<std::pair<size_t, size_t>>> matches(morsels);
+	std::vector<char> matched(left.tuples.size(), false);
+	forEachMorsel([&](size_t morsel) {
+		Key key(leftKeys.size());
+		size_t end = std::min((morsel + 1) * sql::morselSize, left.tuples.size());
+		for(size_t l = morsel * sql::morselSize; l < end; l++) {
+			auto& leftTuple = left.tuples[l];
+			const std::vector<size_t>* candidates = &everyTuple;
+			if(!leftKeys.empty()) {
+				for(size_t k = 0; k < leftKeys.size(); k++)
+					key[k] = leftTuple[leftKeys[k]].data;
+				auto found = built.find(key);
+				if(found == built.end()) continue;
+				candidates = &found->second;
+			}
+
+			for(size_t r: *candidates) {
+				auto& rightTuple = right.tuples[r];
+				auto cell = [&](size_t column) -> const sql::Data::Variant& { return column < offset ? leftTuple[column].data : rightTuple[column - offset].data; };
+
+				// Check the rest of the conditions
+				bool valid = true;
+				for(size_t i = 0; i < residual.size() && valid; i++) {
+					size_t c = residual[i];
+					valid = compare(action.conditions[c].comp, cell(conditionColumns[c]), conditionDataColumns[c] != -1 ? cell(conditionDataColumns[c]) : conditionValues[c]);
+				}
+				if(!valid) continue;
+
+				matches[morsel].emplace_back(l, r);
+				matched[l] = true;
+			}
+		}
+	});
+
+	// Copy the matching pairs of tuples into the joined table (each morsel's matches are placed after the previous morsel's)
+	std::vector<size_t> starts(morsels + 1, 0);
+	for(size_t morsel = 0; morsel < morsels; morsel++)
+		starts[morsel + 1] = starts[morsel] + matches[morsel].size();
+	joined.tuples.resize(starts.back());
+	forEachMorsel([&](size_t morsel) {
+		for(size_t i = 0; i < matches[morsel].size(); i++) {
+			auto [l, r] = matches[morsel][i];
+			fillTuple(joined.tuples[starts[morsel] + i], left.tuples[l], &right.tuples[r]);
+		}
+	});
 
-	// Save changes to disk
-	saveTableFile(table, "insert into", state);
+	// Add the left tuples which didn't match anything if this is a left join
+	if(leftJoin)
+		for(size_t l = 0; l < left.tuples.size(); l++)
+			if(!matched[l])
+				fillTuple(joined.tuples.emplace_back(), left.tuples[l], nullptr);
+
+	return true;
 }
 
 // Function which performs a query on the data in a table
@@ -980,112 +2388,159 @@ void queryTable(const sql::Action& _action, ProgramState& state){
 	}
 
 
-	// Create a temporary table
-	sql::Table table;
 	// A null bit of state, used so that queries always load from disk instead of the current transaction
 	ProgramState nullState;
 
-	// Load all of the tables from disk, cartesian producting them together as nessicary
+	// Every file the query reads is read as it was when the query started (or when the current transaction began), so the query never waits on (or sees part of) another process's changes
+	sql::storage::SnapshotSet querySnapshots;
+	sql::storage::SnapshotSet& snapshots = state.snapshots ? *state.snapshots : querySnapshots;
+	sql::storage::SnapshotSet::Scope snapshotScope(snapshots);
+	{
+		sql::storage::PublishLock publishing(database.path, /*exclusive*/ false);
+		for(auto& alias: action.tableAliases)
+			snapshotTable(snapshots, database.path / (alias.table + ".table"));
+	}
+
+	// Helper which adds the alias to a table columns' names
+	auto qualifyColumns = [](sql::Table& table, const sql::QueryTableAction::TableAlias& alias) {
+		for(auto& column: table.columns)
+			column.name = alias.alias + "." + column.name;
+	};
+
+	// Load the schemas of all of the tables from disk (their tuples are loaded once the conditions have been planned)
+	std::vector<sql::Table> tables(action.tableAliases.size());
 	for(size_t i = 0; i < action.tableAliases.size(); i++) {
 		auto& alias = action.tableAliases[i];
-		// Load the table from disk (helper handles ensuring that it exists)
-		sql::Table tempTable;
+		// Load the table's schema from disk (helper handles ensuring that it exists)
+		sql::Table& tempTable = tables[i];
 		tempTable.name = alias.table;
 		tempTable.path = database.path / (tempTable.name + ".table");
-		if(!loadTable(tempTable, database, "query", nullState))
+		if(!loadTable(tempTable, database, "query", nullState, /*schemaOnly*/ true))
 			return;
-		// Add the alias to the table columns' names
-		for(auto& column: tempTable.columns)
-			column.name = alias.alias + "." + column.name;
-		// Prepend the index of the data to this new table
-		tempTable.columns.insert(tempTable.columns.begin(), {&tempTable, "__index" + std::to_string(i) + "__", {sql::DataType::INT}});
-		for(size_t i = 0; i < tempTable.tuples.size(); i++)
-			tempTable.tuples[i].insert(tempTable.tuples[i].begin(), {(int64_t)i, &tempTable.columns.front()});
-
-
-		// Create a new table with all of the columns of both the old and newly loaded tables
-		sql::Table cartesianProduct;
-		for(auto& column: table.columns)
-			cartesianProduct.columns.push_back(column);
-		for(auto& column: tempTable.columns)
-			cartesianProduct.columns.push_back(column);
+		qualifyColumns(tempTable, alias);
+	}
 
-		// Preform a cartesian product of the tuples in both tables
-		if(table.tuples.empty() && !tempTable.tuples.empty()) {
-			table = std::move(tempTable);
+	// Plan where each of the conditions should be applied:
+	//  - If the last table is outer joined, every condition is part of its ON clause (the parser places the ON clause after all of the joins)
+	//  - Otherwise the conditions act as a WHERE clause, and are applied as soon as all of the tables they reference have been joined
+	// Conditions which only reference a single table are pushed down to filter that table before it is joined, unless that would change which tuples an outer join preserves
+	const size_t last = tables.size() - 1;
+	bool hasConditions = !action.conditions.empty();
+	bool onClause = tables.size() > 1 && action.tableAliases[last].isOuterJoin();
+	std::vector<std::vector<sql::WhereAction::Condition>> pushedConditions(tables.size()), joinConditions(tables.size()), filterConditions(tables.size());
+	std::vector<sql::WhereAction::Condition> unresolvedConditions;
+	for(auto& condition: action.conditions) {
+		size_t index = referencedTable(tables, condition.column);
+		size_t dataIndex = condition.value.index() == 5 ? referencedTable(tables, std::get<sql::Column>(condition.value).name) : index;
+		// Conditions referencing columns that don't exist are reported once the tables are joined
+		if(index == -1 || dataIndex == -1) {
+			unresolvedConditions.push_back(condition);
 			continue;
 		}
-		if(!table.tuples.empty() && tempTable.tuples.empty())
-			continue;
-		for(auto& oldTuple: table.tuples)
-			for(auto& newTuple: tempTable.tuples) {
-				auto& tuple = cartesianProduct.createEmptyTuple();
-				for(size_t i = 0; i < oldTuple.size(); i++)
-					tuple[i] = oldTuple[i];
-				for(size_t i = 0, offset = oldTuple.size(); i < newTuple.size(); i++)
-					tuple[i + offset] = newTuple[i];
-			}
 
-		// Add extra left and right tuples with opposite null values if we are preforming an outer join
-		if(alias.isOuterJoin()) {
-			// Add all of the left table tuples with null right values
-			for(auto& oldTuple: table.tuples) {
-				auto& leftTuple = cartesianProduct.createEmptyTuple();
-				for(size_t i = 0; i < oldTuple.size(); i++)
-					leftTuple[i] = oldTuple[i];
-			}
-			// Add all of the right table tuples with null left values
-			for(auto& newTuple: tempTable.tuples) {
-				auto& rightTuple = cartesianProduct.createEmptyTuple();
-				for(size_t i = 0, offset = table.columns.size(); i < newTuple.size(); i++)
-					rightTuple[i + offset] = newTuple[i];
-			}
+		size_t step = std::max(index, dataIndex);
+		if(onClause) {
+			if(index == dataIndex && index == last) pushedConditions[last].push_back(condition);
+			else joinConditions[last].push_back(condition);
+		} else {
+			// Conditions on the null supplying side of an outer join need to filter the join's result (so that the padded tuples are filtered as well)
+			bool nullSupplying = step > 0 && action.tableAliases[step].isOuterJoin();
+			if(nullSupplying) filterConditions[step].push_back(condition);
+			else if(index == dataIndex) pushedConditions[index].push_back(condition);
+			else joinConditions[step].push_back(condition);
 		}
-
-		// Move the calculated cartesian product to our table
-		table = std::move(cartesianProduct);
 	}
 
+	// Choose which index (if any) each table's tuples are found with
+	std::vector<std::optional<IndexProbe>> probes(tables.size());
+	for(size_t i = 0; i < tables.size(); i++)
+		probes[i] = findIndex(tables[i], pushedConditions[i], nullState);
 
-	// Select tuples
-	if(!action.conditions.empty()){
-		// Filter out all of the tuples that don't satisfy the conditions
-		auto selectedTuples = applyWhereConditions(table, action, "query");
-		if(selectedTuples.empty())
-			return;
+	// Single table queries without a usable index are answered directly from a mapping of the table's file
+	if(tables.size() == 1 && !probes[0] && queryMappedTable(action, database, state))
+		return;
 
-		// Add in missing left tuples if we are doing a left outer join
-		if(action.tableAliases.size() > 1 && action.tableAliases[1].isOuterJoin()){
-			// Determine the indecies we have selected
-			std::vector<size_t> indeciesFound;
-			for(size_t selected: selectedTuples)
-				if(!table.tuples[selected][0].isNull())
-					indeciesFound.push_back(std::get<int64_t>(table.tuples[selected][0].data)); // Tuple index 0, since we prepended data to the table
-			// Determine where the index column for the second table is stored
-			size_t rightIndex = findColumn(table, "__index1__");
-
-			// Find all tuples with an index we haven't yet discovered, and a null second half, add them to the table
-			for(size_t i = 0; i < table.tuples.size(); i++){
-				auto& tuple = table.tuples[i];
-				auto dataIndex = tuple[0].isNull() ? -1 : std::get<int64_t>(tuple[0].data);
-				if(std::find(indeciesFound.begin(), indeciesFound.end(), dataIndex) == indeciesFound.end()
-					&& tuple[rightIndex].isNull())
-				{
-					selectedTuples.push_back(i);
-					indeciesFound.push_back(dataIndex);
-				}
+	// Load the tuples of all of the tables, then push conditions down to the tables they reference
+	for(size_t i = 0; i < tables.size(); i++) {
+		auto& alias = action.tableAliases[i];
+		// Determine which of this table's columns are referenced (so columnar tables only need to load those columns)
+		auto columns = referencedColumns(action, alias);
+		// If one of the table's indexes can be used, only load the tuples it finds
+		std::optional<std::vector<sql::RecordID>> rids;
+		if(auto& probe = probes[i])
+			try {
+				rids = probe->scan();
+			} catch(std::runtime_error) {
+				std::cerr << "!Failed to query table " << alias.table << " because index " << split(probe->path.filename().string(), ".")[1] << " is corupted." << std::endl;
+				return;
 			}
-		}
 
-		// Move the selected tuples into a new array
-		std::vector<sql::Tuple> tuples;
-		for(size_t i: selectedTuples)
-			tuples.emplace_back(std::move(table.tuples[i]));
+		sql::Table& tempTable = tables[i] = {};
+		tempTable.name = alias.table;
+		tempTable.path = database.path / (tempTable.name + ".table");
+		if(!loadTable(tempTable, database, "query", nullState, /*schemaOnly*/ false, action.columns.all() ? nullptr : &columns, rids ? &*rids : nullptr))
+			return;
+		qualifyColumns(tempTable, alias);
+
+		if(!filterTable(tempTable, action.target, std::move(pushedConditions[i]), workerPool(state)))
+			return;
+	}
+
+	// Join all of the tables together
+	sql::Table table = std::move(tables[0]);
+	for(size_t i = 1; i < tables.size(); i++) {
+		sql::WhereAction conditions{{sql::Action::Query, action.target}, std::move(joinConditions[i])};
+		sql::Table joined;
+		if(!joinTables(table, tables[i], action.tableAliases[i].isOuterJoin(), conditions, joined, workerPool(state)))
+			return;
+		table = std::move(joined);
+		tables[i] = {};
+
+		if(!filterTable(table, action.target, std::move(filterConditions[i]), workerPool(state)))
+			return;
+	}
+
+	// Apply the conditions which couldn't be planned (reporting the missing columns)
+	if(!filterTable(table, action.target, std::move(unresolvedConditions), workerPool(state)))
+		return;
 
-		// The array of selected tuples becomes the table's list of tuples
-		table.tuples = std::move(tuples);
+	// Aggregate queries stream the joined tuples into the aggregation, then print its result
+	if(action.isAggregate()) {
+		sql::Table result;
+		std::vector<size_t> output;
+		auto aggregation = prepareAggregation(table, action, result, output);
+		if(!aggregation) return;
+
+		// Large tables are aggregated in parallel, each morsel is aggregated separately then the partial aggregations are merged in order
+		size_t morsels = (table.tuples.size() + sql::morselSize - 1) / sql::morselSize;
+		if(morsels > 1) {
+			std::vector<sql::HashAggregation> partials(morsels, *aggregation);
+			workerPool(state)->run(morsels, [&](size_t morsel) {
+				size_t end = std::min((morsel + 1) * sql::morselSize, table.tuples.size());
+				for(size_t i = morsel * sql::morselSize; i < end; i++)
+					partials[morsel].add(table.tuples[i]);
+			});
+			for(auto& partial: partials)
+				aggregation->merge(std::move(partial));
+		} else for(sql::Tuple& tuple: table.tuples)
+			aggregation->add(tuple);
+		table = {};
+
+		if(finishAggregation(*aggregation, action, result, output))
+			printTable(result, state);
+		return;
 	}
 
+	// If there were conditions, make sure something was selected
+	if(hasConditions && table.tuples.empty())
+		return;
+
+	// Order and limit the tuples (they have already been loaded, so they are sorted in memory)
+	std::vector<sql::SortKey> keys;
+	if(!prepareOrder(table, action, keys))
+		return;
+	orderAndLimit(table, action, keys, workerPool(state));
+
 	// Project tuples (if we aren't selecting all of them)
 	if(!action.columns.all()){
 		// Calculate the indecies of the tuples we need to keep in the projection
@@ -1113,46 +2568,9 @@ void queryTable(const sql::Action& _action, ProgramState& state){
 
 		// Replace the table with the new projection
 		table = std::move(projectedTable);
-
-	// If we are keeping all of the columns, remove the __index#__ columns we added
-	} else {
-		for(size_t i = 0; i < table.columns.size(); i++)
-			if(table.columns[i].name.find("__index") != std::string::npos) {
-				table.columns.erase(table.columns.begin() + i);
-				for(auto& tuple: table.tuples)
-					tuple.erase(tuple.begin() + i);
-				i--;
-			}
 	}
 
-	// If the table has no metadata then there is nothing to display
-	if(table.columns.empty())
-		return;
-
-	// If there is an active transaction, warn that the show data is outdated
-	if(state.transaction)
-		std::cout << "NOTE: There is an active transaction, commit the transaction to see its data!" << std::endl;
-
-	// Print out the headers
-	std::cout << split(table.columns[0].name, ".").back() << " " << table.columns[0].type.to_string();
-	for(int i = 1; i < table.columns.size(); i++)
-		std::cout << " | " << split(table.columns[i].name, ".").back() << " " << table.columns[i].type.to_string();
-	std::cout << std::endl;
-
-	// Print out the data
-	for(sql::Tuple& t: table.tuples){
-		bool first = true;
-		for(sql::Data& d: t) {
-			std::visit([first](auto v){
-				if(!first) std::cout << " | ";
-
-				if constexpr(std::is_same_v<decltype(v), std::monostate>) std::cout << "null";
-				else std::cout << v;
-			}, d.data);
-			first = false;
-		}
-		std::cout << std::endl;
-	}
+	printTable(table, state);
 }
 
 // Function which updates the data in a table
@@ -1174,12 +2592,12 @@ void updateTable(const sql::Action& _action, ProgramState& state){
 	table.name = action.target.name;
 	table.path = database.path / (table.name + ".table");
 
-	// Create lock (or fail if someone else has lock)
-	if(!handleTableLock(table, "update", state))
+	// Take an intention lock on the table (waiting if another session has locked the whole table), the rows being updated are locked once they are found
+	if(!handleTableLock(table, "update", state, sql::storage::LockManager::IntentionExclusive))
 		return;
 
-	// Load the table from disk (helper handles ensuring that it exists)
-	if(!loadTable(table, database, "update", state))
+	// Load the table from disk (helper handles ensuring that it exists), if one of its indexes can be used only the tuples it finds are loaded
+	if(!loadIndexedTable(table, database, action, "update", state))
 		return;
 
 	// Find the column index that we are updating (error if it doesn't exist)
@@ -1196,22 +2614,42 @@ void updateTable(const sql::Action& _action, ProgramState& state){
 			<< sql::Data::variantTypeString(action.value) << " provided." << std::endl;
 	}
 
-	// Filter out all of the tuples that don't satisfy the conditions
-	auto selectedTuples = applyWhereConditions(table, action, "update");
-	if(selectedTuples.empty())
+	// Filter out all of the tuples that don't satisfy the conditions, then lock the rows that do
+	auto selectedTuples = applyWhereConditions(table, action, "update", workerPool(state));
+	if(!lockSelectedRows(table, database, action, "update", state, selectedTuples) || selectedTuples.empty())
 		return;
 
+	// Remember the tuples as they were, so their index entries can be updated
+	std::vector<sql::Tuple> before, after;
+	for(size_t tupleIndex: selectedTuples)
+		before.push_back(table.tuples[tupleIndex]);
+
 	// Update the value in tuples where all of the conditions hold
 	for(size_t tupleIndex: selectedTuples) {
 		table.tuples[tupleIndex][columnIndex].data = action.value;
 		table.tuples[tupleIndex][columnIndex].applyColumnAdjustments();
+
+		// Make sure the updated tuple can still be stored in a single page
+		if(!sql::storage::fitsInPage(table.tuples[tupleIndex])){
+			abort(state) << "!Failed to update table " << action.target.name << " because an updated record is larger than " << sql::storage::maxRecordSize << " bytes." << std::endl;
+			return;
+		}
 	}
 
 
-	std::cout << selectedTuples.size() << " record" << (selectedTuples.size() > 1 ? "s" : "") << " modified." << std::endl;
+	// Latch the table while its pages are written
+	if(!latchTable(table, "update", state))
+		return;
+
+	// Save changes to disk (only the pages holding the updated tuples are written), then update the table's indexes (the tuples may have moved)
+	if(!writeRows(table, RowChange::Update, before, after, "update", state, [&](const std::filesystem::path& path) {
+		sql::storage::updateTuples(path, table, selectedTuples);
+		for(size_t tupleIndex: selectedTuples)
+			after.push_back(table.tuples[tupleIndex]);
+	}))
+		return;
 
-	// Save changes to disk
-	saveTableFile(table, "update", state);
+	std::cout << selectedTuples.size() << " record" << (selectedTuples.size() > 1 ? "s" : "") << " modified." << std::endl;
 }
 
 // Function which deletes some data from a table
@@ -1233,31 +2671,32 @@ void deleteFromTable(const sql::Action& _action, ProgramState& state){
 	table.name = action.target.name;
 	table.path = database.path / (table.name + ".table");
 
-	// Create lock (or fail if someone else has lock)
-	if(!handleTableLock(table, "delete from", state))
+	// Take an intention lock on the table (waiting if another session has locked the whole table), the rows being deleted are locked once they are found
+	if(!handleTableLock(table, "delete from", state, sql::storage::LockManager::IntentionExclusive))
 		return;
 
-	// Load the table from disk (helper handles ensuring that it exists)
-	if(!loadTable(table, database, "delete from", state))
+	// Load the table from disk (helper handles ensuring that it exists), if one of its indexes can be used only the tuples it finds are loaded
+	if(!loadIndexedTable(table, database, action, "delete from", state))
 		return;
 
-	// Filter out all of the tuples that don't satisfy the conditions
-	auto selectedTuples = applyWhereConditions(table, action, "delete from");
-	if(selectedTuples.empty())
+	// Filter out all of the tuples that don't satisfy the conditions, then lock the rows that do
+	auto selectedTuples = applyWhereConditions(table, action, "delete from", workerPool(state));
+	if(!lockSelectedRows(table, database, action, "delete from", state, selectedTuples) || selectedTuples.empty())
 		return;
 
-	// Remove all of the selected tuples from the table
-	size_t selectedSize = selectedTuples.size();
-	for(size_t i = 0; i < selectedSize; i++){
-		table.tuples.erase(table.tuples.begin() + selectedTuples[0]);
-		selectedTuples.erase(selectedTuples.begin());
+	// Latch the table while its pages are written
+	if(!latchTable(table, "delete from", state))
+		return;
 
-		for(size_t& index: selectedTuples)
-			index--;
-	}
+	// Remove the selected tuples from the table on disk (only the pages holding them are written), and from the table's indexes
+	std::vector<sql::Tuple> removed;
+	for(size_t tupleIndex: selectedTuples)
+		removed.push_back(table.tuples[tupleIndex]);
+	if(!writeRows(table, RowChange::Delete, removed, {}, "delete from", state, [&](const std::filesystem::path& path) {
+		sql::storage::deleteTuples(path, table, selectedTuples);
+	}))
+		return;
 
+	size_t selectedSize = selectedTuples.size();
 	std::cout << selectedSize << " record" << (selectedSize > 1 ? "s" : "") << " deleted." << std::endl;
-
-	// Save changes to disk
-	saveTableFile(table, "delete from", state);
 }
\ No newline at end of file
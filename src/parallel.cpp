@@ -0,0 +1,201 @@
+/*------------------------------------------------------------
+ * Filename: parallel.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the work-stealing pool's workers, the scheduling of tasks between them, and task groups.
+ *------------------------------------------------------------*/
+
+#include "parallel.hpp"
+
+#include <chrono>
+#include <utility>
+
+namespace sql {
+
+	thread_local const WorkerPool* WorkerPool::currentPool = nullptr;
+	thread_local WorkerPool::Worker* WorkerPool::current = nullptr;
+
+	// Helper which measures nanoseconds since some fixed point
+	static uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	size_t WorkerPool::defaultParallelism() {
+		// NOTE: hardware_concurrency may report 0 if the number of cores can't be determined
+		return std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	WorkerPool::WorkerPool(size_t parallelism) {
+		// NOTE: Every worker is created before any of them start, since workers steal from each other
+		for(size_t i = 1; i < parallelism; i++)
+			workers.emplace_back(std::make_unique<Worker>());
+		for(auto& worker: workers)
+			worker->thread = std::thread([this, &worker = *worker] { work(worker); });
+	}
+
+	WorkerPool::~WorkerPool() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(auto& worker: workers)
+			worker->thread.join();
+	}
+
+	void WorkerPool::work(Worker& self) {
+		currentPool = this;
+		current = &self;
+
+		Task task;
+		while(true) {
+			if(pop(&self, task)) {
+				uint64_t start = now();
+				execute(task);
+				self.busy += now() - start;
+				continue;
+			}
+
+			// Sleep until there is something to run
+			uint64_t start = now();
+			{
+				std::unique_lock lock(mutex);
+				wake.wait(lock, [&] { return stopping || queued > 0; });
+			}
+			self.idle += now() - start;
+			if(stopping) return;
+		}
+	}
+
+	void WorkerPool::push(Task task) {
+		if(Worker* self = currentWorker()) {
+			std::lock_guard lock(self->mutex);
+			self->tasks.push_back(std::move(task));
+		} else {
+			std::lock_guard lock(injectionMutex);
+			injection.push_back(std::move(task));
+		}
+		queued++;
+
+		// NOTE: The mutex is taken so that a thread which just found nothing to run can't miss the notification
+		{ std::lock_guard lock(mutex); }
+		wake.notify_one();
+	}
+
+	bool WorkerPool::pop(Worker* self, Task& task) {
+		if(queued == 0) return false;
+
+		// Workers run the newest of their own tasks first (it is the most likely to still be in the cache)
+		if(self) {
+			std::lock_guard lock(self->mutex);
+			if(!self->tasks.empty()) {
+				task = std::move(self->tasks.back());
+				self->tasks.pop_back();
+				queued--;
+				return true;
+			}
+		}
+
+		{
+			std::lock_guard lock(injectionMutex);
+			if(!injection.empty()) {
+				task = std::move(injection.front());
+				injection.pop_front();
+				queued--;
+				return true;
+			}
+		}
+
+		// Steal the oldest task of another worker (starting with the worker after this one, so thieves spread out)
+		size_t first = 0;
+		for(size_t i = 0; i < workers.size(); i++)
+			if(workers[i].get() == self)
+				first = i + 1;
+		for(size_t i = 0; i < workers.size(); i++) {
+			Worker& victim = *workers[(first + i) % workers.size()];
+			if(&victim == self) continue;
+
+			std::lock_guard lock(victim.mutex);
+			if(!victim.tasks.empty()) {
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				queued--;
+				if(self) self->steals++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WorkerPool::execute(Task& task) {
+		TaskGroup* group = task.group;
+		try {
+			task.function();
+		} catch(...) {
+			std::lock_guard lock(group->errorMutex);
+			if(!group->error) group->error = std::current_exception();
+		}
+		task.function = nullptr;
+		if(Worker* self = currentWorker()) self->executed++;
+
+		// Wake anyone waiting on the group once its last task finishes
+		if(--group->pending == 0) {
+			{ std::lock_guard lock(mutex); }
+			wake.notify_all();
+		}
+	}
+
+	void WorkerPool::TaskGroup::spawn(std::function<void()> function) {
+		pending++;
+		pool.push({std::move(function), this});
+	}
+
+	WorkerPool::TaskGroup::~TaskGroup() {
+		if(pending == 0) return;
+		try {
+			wait();
+		} catch(...) {}
+	}
+
+	void WorkerPool::TaskGroup::wait() {
+		Worker* self = pool.currentWorker();
+		Task task;
+		while(pending > 0) {
+			// Help run tasks (which may not belong to this group) while the group is running
+			if(pool.pop(self, task)) {
+				pool.execute(task);
+				continue;
+			}
+
+			std::unique_lock lock(pool.mutex);
+			pool.wake.wait(lock, [&] { return pending == 0 || pool.queued > 0; });
+		}
+
+		std::lock_guard lock(errorMutex);
+		if(error) std::rethrow_exception(std::exchange(error, nullptr));
+	}
+
+	void WorkerPool::run(size_t morsels, const std::function<void(size_t morsel)>& process) {
+		// Jobs which can't be split don't need to involve the workers
+		if(workers.empty() || morsels <= 1) {
+			for(size_t morsel = 0; morsel < morsels; morsel++)
+				process(morsel);
+			return;
+		}
+
+		TaskGroup group(*this);
+		for(size_t morsel = 0; morsel < morsels; morsel++)
+			group.spawn([&process, morsel] { process(morsel); });
+		group.wait();
+	}
+
+	std::vector<WorkerPool::WorkerStatistics> WorkerPool::statistics() const {
+		std::vector<WorkerStatistics> out;
+		for(auto& worker: workers)
+			out.push_back({worker->busy, worker->idle, worker->executed, worker->steals});
+		return out;
+	}
+
+} // sql
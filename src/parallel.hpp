@@ -0,0 +1,167 @@
+/*------------------------------------------------------------
+ * Filename: parallel.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides a work-stealing pool of worker threads which the executor's operators split their work between. Each
+ * 				worker has its own deque of tasks (it runs the newest of its tasks first, while idle workers steal the
+ * 				oldest), tasks spawned by threads outside of the pool are placed in a global injection queue instead.
+ * 				Threads waiting for a group of tasks help run tasks, so operators can spawn subtasks (and wait on them)
+ * 				without ever creating more threads than the pool was created with.
+ *------------------------------------------------------------*/
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sql {
+
+	class WorkerPool {
+	public:
+		class TaskGroup;
+
+		// Struct holding statistics about the work a worker has done
+		struct WorkerStatistics {
+			// Nanoseconds spent running tasks, and spent waiting for tasks to run
+			uint64_t busy = 0, idle = 0;
+			// The number of tasks run, and how many of them were stolen from another worker
+			uint64_t tasks = 0, steals = 0;
+		};
+
+	private:
+		// Struct representing a task, and the group waiting on it
+		struct Task {
+			std::function<void()> function;
+			TaskGroup* group;
+		};
+
+		// Struct representing a worker thread and its deque of tasks
+		struct Worker {
+			std::thread thread;
+			std::mutex mutex;
+			std::deque<Task> tasks;
+			std::atomic<uint64_t> busy = 0, idle = 0, executed = 0, steals = 0;
+		};
+		std::vector<std::unique_ptr<Worker>> workers;
+
+		// Queue of tasks spawned by threads outside of the pool
+		std::mutex injectionMutex;
+		std::deque<Task> injection;
+
+		// Mutex and condition variable used to sleep until there are tasks to run (or a group has finished)
+		std::mutex mutex;
+		std::condition_variable wake;
+		// The number of tasks waiting to be run
+		std::atomic<size_t> queued = 0;
+		bool stopping = false;
+
+		// The pool (and its worker) running on the current thread
+		static thread_local const WorkerPool* currentPool;
+		static thread_local Worker* current;
+		// The worker (of this pool) running on the current thread, or null if the thread isn't one of the pool's workers
+		Worker* currentWorker() const { return currentPool == this ? current : nullptr; }
+		// Function run by each of the worker threads
+		void work(Worker& self);
+		// Add a task to the current worker's deque (or the injection queue)
+		void push(Task task);
+		// Find a task to run (from the current worker's deque, the injection queue, or by stealing from another worker), returns false if there aren't any
+		bool pop(Worker* self, Task& task);
+		// Run a task, notifying its group once it (and the rest of its group) has finished
+		void execute(Task& task);
+
+	public:
+		// Class representing a group of tasks which can be waited on together
+		// NOTE: Tasks may spawn more tasks into their own group (or a new group they wait on)
+		class TaskGroup {
+			friend class WorkerPool;
+			WorkerPool& pool;
+			// The number of the group's tasks which haven't finished
+			std::atomic<size_t> pending = 0;
+			// The first exception thrown by one of the group's tasks
+			std::mutex errorMutex;
+			std::exception_ptr error;
+
+		public:
+			TaskGroup(WorkerPool& pool): pool(pool) {}
+			TaskGroup(const TaskGroup&) = delete;
+			// NOTE: Waits for any unfinished tasks (ignoring their exceptions), since they reference the group
+			~TaskGroup();
+
+			// Spawn a task into the group
+			void spawn(std::function<void()> function);
+			// Help run tasks until all of the group's tasks have finished
+			// NOTE: If any of the tasks threw an exception, the first one is rethrown
+			void wait();
+		};
+
+		// The number of threads queries are split between by default (one per core)
+		static size_t defaultParallelism();
+
+		// Create a pool where work is split between <parallelism> threads (including the thread waiting on the work)
+		explicit WorkerPool(size_t parallelism = defaultParallelism());
+		WorkerPool(const WorkerPool&) = delete;
+		~WorkerPool();
+
+		// The number of threads work is split between
+		size_t parallelism() const { return workers.size() + 1; }
+
+		// Run a job by calling <process> once for each of its morsels (in no particular order or thread), returns once every morsel has been processed
+		// NOTE: If processing any of the morsels throws an exception, it is rethrown once the rest of the morsels have been processed
+		void run(size_t morsels, const std::function<void(size_t morsel)>& process);
+
+		// Get the statistics of each of the workers
+		std::vector<WorkerStatistics> statistics() const;
+	};
+
+	// Function which stably sorts a range, the range is split into a chunk per thread which are sorted in parallel then merged together (in parallel) a pair at a time
+	// NOTE: If no pool is provided (or the range is small) the range is simply sorted by the current thread
+	template<typename Iterator, typename Compare>
+	void stableSort(WorkerPool* workers, Iterator begin, Iterator end, Compare compare) {
+		constexpr size_t minimumChunk = 16 * 1024;
+		size_t size = end - begin;
+		size_t chunks = workers ? std::min(workers->parallelism(), size / minimumChunk) : 1;
+		if(chunks <= 1) {
+			std::stable_sort(begin, end, compare);
+			return;
+		}
+
+		// Find where each chunk starts
+		std::vector<Iterator> bounds;
+		for(size_t i = 0; i < chunks; i++)
+			bounds.push_back(begin + size * i / chunks);
+		bounds.push_back(end);
+
+		workers->run(chunks, [&](size_t chunk) {
+			std::stable_sort(bounds[chunk], bounds[chunk + 1], compare);
+		});
+
+		// Merge neighboring chunks until only one remains (earlier chunks are always merged in front of later ones, keeping the sort stable)
+		while(bounds.size() > 2) {
+			size_t pairs = (bounds.size() - 1) / 2;
+			workers->run(pairs, [&](size_t pair) {
+				std::inplace_merge(bounds[pair * 2], bounds[pair * 2 + 1], bounds[pair * 2 + 2], compare);
+			});
+
+			std::vector<Iterator> merged;
+			for(size_t i = 0; i < bounds.size(); i += 2)
+				merged.push_back(bounds[i]);
+			if(merged.back() != end) merged.push_back(end);
+			bounds = std::move(merged);
+		}
+	}
+
+} // sql
+
+#endif // PARALLEL_HPP
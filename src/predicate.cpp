@@ -0,0 +1,146 @@
+/*------------------------------------------------------------
+ * Filename: predicate.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the batched selection of tuples (combining the SIMD kernels' selection bitmaps with a compiled predicate),
+ * 				large tables are split into morsels which are filtered in parallel.
+ *------------------------------------------------------------*/
+
+#include "predicate.hpp"
+
+#include <algorithm>
+
+#include "simd.hpp"
+
+namespace sql {
+
+	// Struct representing a condition evaluated by the SIMD kernels
+	struct VectorizedCondition {
+		size_t column;
+		WhereAction::Comparison comp;
+		std::variant<int64_t, double> value;
+	};
+
+	// Function which compares two values the same way the generic variant comparison would
+	static bool compare(WhereAction::Comparison comp, const Data::Variant& a, const Data::Variant& b) {
+		switch(comp){
+		break; case WhereAction::equal: return a == b;
+		break; case WhereAction::notEqual: return a != b;
+		break; case WhereAction::less: return a < b;
+		break; case WhereAction::greater: return a > b;
+		break; case WhereAction::lessEqual: return a <= b;
+		break; case WhereAction::greaterEqual: return a >= b;
+		break; default:
+			throw std::runtime_error("Unexpected condition");
+		}
+	}
+
+	// Function which appends the indices of the tuples in [begin, end) that satisfy the conditions to <selected>
+	static void selectRange(const Table& table, const std::vector<VectorizedCondition>& vectorized, const Predicate<Tuple>& predicate, size_t begin, size_t end, std::vector<size_t>& selected) {
+		// If none of the conditions can be vectorized, simply check the predicate against every tuple
+		if(vectorized.empty()) {
+			for(size_t i = begin; i < end; i++)
+				if(predicate(table.tuples[i]))
+					selected.push_back(i);
+			return;
+		}
+
+		std::vector<int64_t> ints(simd::batchSize);
+		std::vector<double> doubles(simd::batchSize);
+		std::vector<size_t> irregular;
+		simd::Word selection[simd::wordsPerBatch], bitmap[simd::wordsPerBatch];
+		for(size_t start = begin; start < end; start += simd::batchSize) {
+			size_t count = std::min(simd::batchSize, end - start);
+
+			std::fill(selection, selection + simd::wordsPerBatch, ~simd::Word(0));
+			for(auto& condition: vectorized) {
+				std::visit([&](auto value) {
+					using T = decltype(value);
+					T* values;
+					if constexpr(std::is_same_v<T, int64_t>) values = ints.data();
+					else values = doubles.data();
+
+					// Copy the batch's values into a typed array (remembering any nulls, which the kernels can't compare)
+					irregular.clear();
+					for(size_t i = 0; i < count; i++)
+						if(auto typed = std::get_if<T>(&table.tuples[start + i][condition.column].data))
+							values[i] = *typed;
+						else {
+							values[i] = 0;
+							irregular.push_back(i);
+						}
+
+					simd::filter(values, count, condition.comp, value, bitmap);
+
+					// Nulls are compared the same way the generic variant comparison would compare them (they are less than everything else)
+					for(size_t i: irregular) {
+						bool holds = compare(condition.comp, table.tuples[start + i][condition.column].data, value);
+						simd::Word bit = simd::Word(1) << (i % 64);
+						bitmap[i / 64] = holds ? bitmap[i / 64] | bit : bitmap[i / 64] & ~bit;
+					}
+				}, condition.value);
+
+				// AND this condition's selection into the batch's selection, nothing more needs to be checked once nothing is selected
+				simd::Word any = 0;
+				for(size_t w = 0; w < simd::wordsPerBatch; w++)
+					any |= selection[w] &= bitmap[w];
+				if(!any) break;
+			}
+
+			// Check the remaining conditions against the selected tuples
+			for(size_t w = 0; w < simd::wordsPerBatch; w++)
+				for(simd::Word bits = selection[w]; bits; bits &= bits - 1) {
+					size_t i = start + w * 64 + __builtin_ctzll(bits);
+					if(predicate(table.tuples[i]))
+						selected.push_back(i);
+				}
+		}
+	}
+
+	std::vector<size_t> selectTuples(const Table& table, const std::vector<WhereAction::Condition>& conditions, const std::vector<size_t>& conditionColumns, const std::vector<size_t>& conditionDataColumns, WorkerPool* workers) {
+		// Split the conditions into those the kernels can evaluate and the rest
+		std::vector<VectorizedCondition> vectorized;
+		std::vector<WhereAction::Condition> remaining;
+		std::vector<size_t> remainingColumns, remainingDataColumns;
+		for(size_t i = 0; i < conditions.size(); i++) {
+			auto type = table.columns[conditionColumns[i]].type.type;
+			auto& value = conditions[i].value;
+			if(conditionDataColumns[i] == size_t(-1) && type == DataType::INT && value.index() == 2)
+				vectorized.push_back({conditionColumns[i], conditions[i].comp, std::get<int64_t>(value)});
+			else if(conditionDataColumns[i] == size_t(-1) && type == DataType::FLOAT && value.index() == 3)
+				vectorized.push_back({conditionColumns[i], conditions[i].comp, std::get<double>(value)});
+			else {
+				remaining.push_back(conditions[i]);
+				remainingColumns.push_back(conditionColumns[i]);
+				remainingDataColumns.push_back(conditionDataColumns[i]);
+			}
+		}
+		Predicate<Tuple> predicate(table, remaining, remainingColumns, remainingDataColumns);
+
+		// Small tables (or scans without any workers) are filtered by this thread alone
+		std::vector<size_t> selectedTuples;
+		size_t morsels = (table.tuples.size() + morselSize - 1) / morselSize;
+		if(!workers || workers->parallelism() == 1 || morsels <= 1) {
+			selectRange(table, vectorized, predicate, 0, table.tuples.size(), selectedTuples);
+			return selectedTuples;
+		}
+
+		// Otherwise each morsel's selection is found by whichever worker claims it, then the selections are concatenated in order
+		std::vector<std::vector<size_t>> selections(morsels);
+		workers->run(morsels, [&](size_t morsel) {
+			size_t begin = morsel * morselSize;
+			selectRange(table, vectorized, predicate, begin, std::min(begin + morselSize, table.tuples.size()), selections[morsel]);
+		});
+
+		size_t total = 0;
+		for(auto& selection: selections)
+			total += selection.size();
+		selectedTuples.reserve(total);
+		for(auto& selection: selections)
+			selectedTuples.insert(selectedTuples.end(), selection.begin(), selection.end());
+		return selectedTuples;
+	}
+
+} // sql
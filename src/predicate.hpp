@@ -0,0 +1,150 @@
+/*------------------------------------------------------------
+ * Filename: predicate.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides compiled WHERE predicates. The conditions' columns and values are resolved once, and each condition
+ * 				becomes a comparator specialized for its column's type and comparison, so evaluating a tuple doesn't need
+ * 				to copy any data or switch on the comparison. Whole tables of tuples are instead filtered a batch at a time,
+ * 				numeric comparisons against values are evaluated by SIMD kernels over typed copies of their columns.
+ *------------------------------------------------------------*/
+
+#ifndef PREDICATE_HPP
+#define PREDICATE_HPP
+
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "SQL.hpp"
+#include "parallel.hpp"
+#include "storage.hpp"
+
+namespace sql {
+
+	// Functions which access a piece of data in a row (either a tuple, or the views of a mapped table's current tuple)
+	inline const Data::Variant& cell(const Tuple& tuple, size_t column) { return tuple[column].data; }
+	inline const storage::DataView& cell(const std::vector<storage::DataView>& row, size_t column) { return row[column]; }
+	// Functions which convert a piece of data read from a row into data which owns its value (so it outlives the row)
+	inline const Data::Variant& own(const Data::Variant& data) { return data; }
+	inline Data::Variant own(const storage::DataView& data) {
+		return std::visit([](const auto& value) -> Data::Variant {
+			if constexpr(std::is_same_v<std::decay_t<decltype(value)>, std::string_view>) return std::string(value);
+			else return value;
+		}, data);
+	}
+
+	// Class which evaluates a conjunction of where conditions against rows, evaluation stops at the first condition which doesn't hold
+	// NOTE: Rows are compared the same way the generic variant comparison would compare them (nulls are less than everything else)
+	template<typename Row>
+	class Predicate {
+		// The type of data stored in the row
+		using Variant = std::decay_t<decltype(cell(std::declval<const Row&>(), 0))>;
+		// The type strings are stored as in the row
+		using String = std::variant_alternative_t<4, Variant>;
+
+		// Struct representing a single compiled condition
+		struct Term {
+			// The column being compared, and the column it is compared against (or -1 if it is compared against a value)
+			size_t column, dataColumn;
+			// The value the column is compared against (the variant owns the data, the value may only view it)
+			Data::Variant data;
+			Variant value;
+			// Comparator specialized for the column's type and the condition's comparison
+			bool (*evaluate)(const Term& term, const Row& row);
+		};
+		std::vector<Term> terms;
+
+		// Function which applies a comparison to two values
+		template<WhereAction::Comparison comp, typename T>
+		static bool apply(const T& a, const T& b) {
+			if constexpr(comp == WhereAction::equal) return a == b;
+			else if constexpr(comp == WhereAction::notEqual) return a != b;
+			else if constexpr(comp == WhereAction::less) return a < b;
+			else if constexpr(comp == WhereAction::greater) return a > b;
+			else if constexpr(comp == WhereAction::lessEqual) return a <= b;
+			else return a >= b;
+		}
+
+		// Function which evaluates a term whose column holds values of type T
+		template<typename T, WhereAction::Comparison comp, bool againstColumn>
+		static bool evaluate(const Term& term, const Row& row) {
+			const Variant& a = cell(row, term.column);
+			const Variant& b = againstColumn ? cell(row, term.dataColumn) : term.value;
+			// Non-null values are compared directly, only nulls need the generic comparison
+			auto x = std::get_if<T>(&a), y = std::get_if<T>(&b);
+			if(x && y) return apply<comp>(*x, *y);
+			return apply<comp>(a, b);
+		}
+
+		// Functions which select the comparator for a term
+		template<typename T, bool againstColumn>
+		static auto comparator(WhereAction::Comparison comp) -> decltype(Term::evaluate) {
+			switch(comp){
+			break; case WhereAction::equal: return &evaluate<T, WhereAction::equal, againstColumn>;
+			break; case WhereAction::notEqual: return &evaluate<T, WhereAction::notEqual, againstColumn>;
+			break; case WhereAction::less: return &evaluate<T, WhereAction::less, againstColumn>;
+			break; case WhereAction::greater: return &evaluate<T, WhereAction::greater, againstColumn>;
+			break; case WhereAction::lessEqual: return &evaluate<T, WhereAction::lessEqual, againstColumn>;
+			break; case WhereAction::greaterEqual: return &evaluate<T, WhereAction::greaterEqual, againstColumn>;
+			break; default:
+				throw std::runtime_error("Unexpected condition");
+			}
+		}
+		template<bool againstColumn>
+		static auto comparator(DataType::Type type, WhereAction::Comparison comp) -> decltype(Term::evaluate) {
+			switch(type){
+			break; case DataType::BOOL: return comparator<bool, againstColumn>(comp);
+			break; case DataType::INT: return comparator<int64_t, againstColumn>(comp);
+			break; case DataType::FLOAT: return comparator<double, againstColumn>(comp);
+			break; case DataType::CHAR:
+			case DataType::VARCHAR:
+			case DataType::TEXT: return comparator<String, againstColumn>(comp);
+			break; default:
+				throw std::runtime_error("Unknown type");
+			}
+		}
+
+	public:
+		// Compile a set of conditions (which have already been validated) given the columns they (and their data) are associated with
+		Predicate(const Table& table, const std::vector<WhereAction::Condition>& conditions, const std::vector<size_t>& conditionColumns, const std::vector<size_t>& conditionDataColumns) {
+			// NOTE: The terms are never reallocated once they are built, since their values may view their own data
+			terms.resize(conditions.size());
+			for(size_t i = 0; i < conditions.size(); i++) {
+				Term& term = terms[i];
+				term.column = conditionColumns[i];
+				term.dataColumn = conditionDataColumns[i];
+				term.data = ast::extractData(conditions[i].value);
+				term.value = std::visit([](const auto& value) -> Variant { return value; }, term.data);
+
+				auto type = table.columns[term.column].type.type;
+				term.evaluate = term.dataColumn == size_t(-1) ? comparator<false>(type, conditions[i].comp) : comparator<true>(type, conditions[i].comp);
+			}
+		}
+		Predicate(const Predicate&) = delete;
+
+		// Check if all of the conditions hold for a row
+		bool operator()(const Row& row) const {
+			for(const Term& term: terms)
+				if(!term.evaluate(term, row))
+					return false;
+			return true;
+		}
+	};
+
+	// The number of tuples in each of the morsels a parallel scan is split into
+	constexpr size_t morselSize = 16 * 1024;
+
+	// Function which finds the indices of the tuples in a table satisfying a set of (validated) conditions given the columns they (and their data) are associated with
+	// NOTE: Conditions comparing INT or FLOAT columns to values are evaluated by the SIMD kernels (the selection bitmaps of each condition are ANDed together),
+	//	the remaining conditions are compiled into a predicate which is only checked for the tuples the kernels selected
+	// NOTE: If a worker pool is provided, tables larger than a morsel are split into morsels which the pool's threads filter in parallel
+	std::vector<size_t> selectTuples(const Table& table, const std::vector<WhereAction::Condition>& conditions, const std::vector<size_t>& conditionColumns, const std::vector<size_t>& conditionDataColumns, WorkerPool* workers = nullptr);
+
+} // sql
+
+#endif // PREDICATE_HPP
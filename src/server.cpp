@@ -0,0 +1,552 @@
+/*------------------------------------------------------------
+ * Filename: server.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the framing protocol, the redirection of sessions' output, the event loops and executors sessions run
+ * 				on, and the socket server.
+ *------------------------------------------------------------*/
+
+#include "server.hpp"
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+
+namespace sql::server {
+
+	// Size of the header at the start of every frame (its type and payload length)
+	constexpr size_t frameHeaderSize = 5;
+
+	// Helpers which send/receive exactly <size> bytes, returning false if the connection was closed
+	// NOTE: Sessions' connections are non-blocking (so the event loops never block on them), sending waits for room on a full connection
+	static bool sendAll(int fd, const char* data, size_t size) {
+		while(size > 0) {
+			ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+			if(sent < 0 && errno == EINTR) continue;
+			if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				pollfd writable = {fd, POLLOUT, 0};
+				poll(&writable, 1, -1);
+				continue;
+			}
+			if(sent <= 0) return false;
+			data += sent;
+			size -= sent;
+		}
+		return true;
+	}
+	static bool receiveAll(int fd, char* data, size_t size) {
+		while(size > 0) {
+			ssize_t received = recv(fd, data, size, 0);
+			if(received < 0 && errno == EINTR) continue;
+			if(received <= 0) return false;
+			data += received;
+			size -= received;
+		}
+		return true;
+	}
+
+	bool sendFrame(int fd, FrameType type, std::string_view payload) {
+		if(payload.size() > maxFrameSize)
+			throw std::runtime_error("Frame is too large");
+
+		char header[frameHeaderSize] = {char(type)};
+		for(size_t i = 0; i < 4; i++)
+			header[1 + i] = char((payload.size() >> (8 * i)) & 0xFF);
+		return sendAll(fd, header, frameHeaderSize) && sendAll(fd, payload.data(), payload.size());
+	}
+
+	// Helper which decodes the payload length from a frame's header
+	static uint32_t payloadSize(const unsigned char* header) {
+		uint32_t size = 0;
+		for(size_t i = 0; i < 4; i++)
+			size |= uint32_t(header[1 + i]) << (8 * i);
+		return size;
+	}
+
+	bool receiveFrame(int fd, FrameType& type, std::string& payload) {
+		unsigned char header[frameHeaderSize];
+		if(!receiveAll(fd, reinterpret_cast<char*>(header), frameHeaderSize))
+			return false;
+		uint32_t size = payloadSize(header);
+		if(header[0] > Done || size > maxFrameSize) return false;
+
+		type = FrameType(header[0]);
+		payload.resize(size);
+		return receiveAll(fd, payload.data(), size);
+	}
+
+	// Helper which appends everything which has arrived on a non-blocking connection to <buffer>, returns false if the connection has been closed
+	static bool receiveAvailable(int fd, std::string& buffer) {
+		char chunk[4096];
+		while(true) {
+			ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+			if(received > 0) {
+				buffer.append(chunk, received);
+				continue;
+			}
+			if(received < 0 && errno == EINTR) continue;
+			return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+		}
+	}
+
+	// Helper which removes a whole frame from the front of <buffer>, returns false if the buffer doesn't hold a whole frame yet (setting <malformed> if it never will)
+	static bool takeFrame(std::string& buffer, FrameType& type, std::string& payload, bool& malformed) {
+		if(buffer.size() < frameHeaderSize) return false;
+		auto header = reinterpret_cast<const unsigned char*>(buffer.data());
+		uint32_t size = payloadSize(header);
+		if(header[0] > Done || size > maxFrameSize) {
+			malformed = true;
+			return false;
+		}
+		if(buffer.size() < frameHeaderSize + size) return false;
+
+		type = FrameType(header[0]);
+		payload.assign(buffer, frameHeaderSize, size);
+		buffer.erase(0, frameHeaderSize + size);
+		return true;
+	}
+
+
+	// --- Session Output ---
+
+
+	void SessionOutput::append(FrameType type, std::string_view text) {
+		if(type != pendingType || pending.size() + text.size() > bufferSize) {
+			flush();
+			pendingType = type;
+		}
+		// Text which is too large for a single frame is split between several frames
+		while(text.size() > maxFrameSize) {
+			if(connected) connected = sendFrame(fd, type, text.substr(0, maxFrameSize));
+			text.remove_prefix(maxFrameSize);
+		}
+		pending += text;
+	}
+
+	void SessionOutput::flush() {
+		// NOTE: If the client has disconnected the text is dropped, the session finds out it disconnected once it waits for more input
+		if(!pending.empty() && connected)
+			connected = sendFrame(fd, pendingType, pending);
+		pending.clear();
+	}
+
+	void SessionOutput::finish(std::string_view payload /*= {}*/) {
+		flush();
+		if(connected) connected = sendFrame(fd, Done, payload);
+		// An idle session shouldn't hold on to the memory its last input's output needed
+		std::string().swap(pending);
+	}
+
+
+	// --- Redirection ---
+
+
+	thread_local SessionOutput* Redirect::current = nullptr;
+
+	// Stream buffer which forwards everything written to it to the redirected output of the thread writing it (or to the stream's original buffer)
+	struct RoutedBuffer: public std::streambuf {
+		std::streambuf* original;
+		FrameType type;
+		RoutedBuffer(std::streambuf* original, FrameType type): original(original), type(type) {}
+	protected:
+		int overflow(int c) override {
+			if(c == traits_type::eof()) return traits_type::not_eof(c);
+			if(auto output = Redirect::active()) {
+				char ch = char(c);
+				output->append(type, {&ch, 1});
+				return c;
+			}
+			return original->sputc(char(c));
+		}
+		std::streamsize xsputn(const char* data, std::streamsize size) override {
+			if(auto output = Redirect::active()) {
+				output->append(type, {data, size_t(size)});
+				return size;
+			}
+			return original->sputn(data, size);
+		}
+		// NOTE: Redirected text is only sent once enough is buffered (or the session finishes its input), rather than every time the stream is flushed
+		int sync() override { return Redirect::active() ? 0 : original->pubsync(); }
+	};
+
+	Redirect::Redirect(SessionOutput& output): previous(current) {
+		static std::once_flag installed;
+		std::call_once(installed, [] {
+			static RoutedBuffer out(std::cout.rdbuf(), Output), err(std::cerr.rdbuf(), Error);
+			std::cout.rdbuf(&out);
+			std::cerr.rdbuf(&err);
+		});
+		current = &output;
+	}
+
+	Redirect::~Redirect() { current = previous; }
+
+
+	// --- Event Loops ---
+
+
+	EventLoop::EventLoop() {
+		epoll = epoll_create1(EPOLL_CLOEXEC);
+		wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.ptr = nullptr;
+		if(epoll < 0 || wakeup < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, wakeup, &event) != 0) {
+			if(epoll >= 0) close(epoll);
+			if(wakeup >= 0) close(wakeup);
+			throw std::runtime_error("Failed to create event loop");
+		}
+		thread = std::thread([this] { run(); });
+	}
+
+	EventLoop::~EventLoop() {
+		{
+			std::scoped_lock lock(mutex);
+			stopping = true;
+		}
+		uint64_t one = 1;
+		[[maybe_unused]] auto written = write(wakeup, &one, sizeof(one));
+		thread.join();
+		close(wakeup);
+		close(epoll);
+	}
+
+	void EventLoop::run() {
+		epoll_event events[64];
+		std::vector<std::function<void()>> functions;
+		while(true) {
+			// Wait until the earliest timer is due (or for as long as it takes if there aren't any)
+			int timeout = -1;
+			{
+				std::scoped_lock lock(mutex);
+				if(!timers.empty()) {
+					auto remaining = std::chrono::ceil<std::chrono::milliseconds>(timers.begin()->first - std::chrono::steady_clock::now());
+					timeout = std::max<int>(remaining.count(), 0);
+				}
+			}
+
+			int count = epoll_wait(epoll, events, 64, timeout);
+			for(int i = 0; i < count; i++)
+				// The event file is the only thing registered without a session waiting on it
+				if(events[i].data.ptr)
+					std::coroutine_handle<>::from_address(events[i].data.ptr).resume();
+				else {
+					uint64_t value;
+					[[maybe_unused]] auto read = ::read(wakeup, &value, sizeof(value));
+				}
+
+			{
+				std::scoped_lock lock(mutex);
+				if(stopping) return;
+				functions.swap(posted);
+
+				// The timers which are due run along with the posted functions
+				auto due = timers.upper_bound(std::chrono::steady_clock::now());
+				for(auto timer = timers.begin(); timer != due; timer++)
+					functions.push_back(std::move(timer->second));
+				timers.erase(timers.begin(), due);
+			}
+			for(auto& function: functions)
+				function();
+			functions.clear();
+		}
+	}
+
+	void EventLoop::post(std::function<void()> function) {
+		{
+			std::scoped_lock lock(mutex);
+			posted.push_back(std::move(function));
+		}
+		uint64_t one = 1;
+		[[maybe_unused]] auto written = write(wakeup, &one, sizeof(one));
+	}
+
+	void EventLoop::postAfter(std::chrono::milliseconds delay, std::function<void()> function) {
+		{
+			std::scoped_lock lock(mutex);
+			timers.emplace(std::chrono::steady_clock::now() + delay, std::move(function));
+		}
+		// The loop needs to recalculate how long it can wait for
+		uint64_t one = 1;
+		[[maybe_unused]] auto written = write(wakeup, &one, sizeof(one));
+	}
+
+	void EventLoop::forget(int fd) { epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr); }
+
+	bool EventLoop::Readable::await_suspend(std::coroutine_handle<> session) {
+		epoll_event event = {};
+		event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+		event.data.ptr = session.address();
+		// NOTE: One shot events are disabled once they fire, so the connection is rearmed (or added the first time) every time its session waits
+		// NOTE: The session runs on the loop's thread, so the event can't be handled before the session has suspended
+		if(epoll_ctl(loop.epoll, EPOLL_CTL_MOD, fd, &event) == 0 || epoll_ctl(loop.epoll, EPOLL_CTL_ADD, fd, &event) == 0)
+			return true;
+		// If the connection can't be waited on, the session carries on (and finds out the connection is unusable when it reads)
+		return false;
+	}
+
+
+	void EventLoop::Alarm::notify() {
+		std::scoped_lock lock(mutex);
+		if(!session) return;
+		// NOTE: The session is only resumed by its loop's thread, so it can't be resumed before it has finished suspending
+		loop->post([session = session] { session.resume(); });
+		session = nullptr;
+	}
+
+	void EventLoop::Sleep::await_suspend(std::coroutine_handle<> session) {
+		{
+			std::scoped_lock lock(alarm->mutex);
+			alarm->loop = &loop;
+			alarm->session = session;
+		}
+		// NOTE: The timer holds the alarm rather than the session, so if the alarm has already woken the session the timer does nothing
+		loop.postAfter(timeout, [alarm = alarm] { alarm->notify(); });
+	}
+
+
+	// --- Executors ---
+
+
+	Executor::Executor(size_t threads) {
+		for(size_t i = 0; i < std::max<size_t>(threads, 1); i++)
+			this->threads.emplace_back([this] { work(); });
+	}
+
+	Executor::~Executor() {
+		{
+			std::scoped_lock lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(auto& thread: threads)
+			thread.join();
+	}
+
+	void Executor::work() {
+		while(true) {
+			std::function<void()> job;
+			{
+				std::unique_lock lock(mutex);
+				wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if(jobs.empty()) return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	void Executor::submit(std::function<void()> job) {
+		{
+			std::scoped_lock lock(mutex);
+			jobs.push_back(std::move(job));
+		}
+		wake.notify_one();
+	}
+
+	void Executor::Offload::await_suspend(std::coroutine_handle<> session) {
+		// NOTE: The session is only resumed by its loop's thread (which is busy suspending it right now), so it can't be resumed before it has suspended
+		executor.submit([this, session] {
+			try {
+				job();
+			} catch(...) {
+				error = std::current_exception();
+			}
+			loop.post([session] { session.resume(); });
+		});
+	}
+
+
+	// --- Server ---
+
+
+	// Helper which fills in the address of a socket (throws std::runtime_error if the path is too long)
+	static sockaddr_un socketAddress(const std::filesystem::path& path) {
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if(path.string().size() >= sizeof(address.sun_path))
+			throw std::runtime_error("Socket path " + path.string() + " is too long");
+		std::strcpy(address.sun_path, path.c_str());
+		return address;
+	}
+
+	Server::Server(const std::filesystem::path& path, size_t loops /*= defaultLoops()*/, size_t executors /*= defaultExecutors*/): path(path), executor(executors) {
+		for(size_t i = 0; i < std::max<size_t>(loops, 1); i++)
+			this->loops.push_back(std::make_unique<EventLoop>());
+
+		auto address = socketAddress(path);
+
+		// A socket nothing is listening on was left behind by a server which exited without removing it
+		if(std::filesystem::exists(path)) {
+			if(!std::filesystem::is_socket(path))
+				throw std::runtime_error(path.string() + " already exists and isn't a socket");
+			int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+			bool listening = probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+			if(probe >= 0) close(probe);
+			if(listening)
+				throw std::runtime_error("A server is already listening on " + path.string());
+			std::filesystem::remove(path);
+		}
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd < 0)
+			throw std::runtime_error("Failed to create socket");
+		if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+			close(fd);
+			throw std::runtime_error("Failed to listen on " + path.string());
+		}
+	}
+
+	Server::~Server() {
+		close(fd);
+		std::error_code ignored;
+		std::filesystem::remove(path, ignored);
+
+		// Disconnecting a client wakes its session if it is waiting for input, the session then finishes (after the input it is executing)
+		{
+			std::unique_lock lock(mutex);
+			for(int client: clients)
+				shutdown(client, SHUT_RDWR);
+			finished.wait(lock, [this] { return clients.empty(); });
+		}
+		loops.clear();
+	}
+
+	size_t Server::defaultExecutors() {
+		// NOTE: hardware_concurrency may report 0 if the number of cores can't be determined
+		return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	}
+
+	size_t Server::defaultLoops() {
+		// NOTE: hardware_concurrency may report 0 if the number of cores can't be determined
+		return std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 4);
+	}
+
+	SessionCoroutine Server::session(EventLoop& loop, int client) {
+		SessionOutput output(client);
+		Session session = factory();
+		std::string buffer, input;
+		FrameType type;
+		bool keepRunning = true, malformed = false;
+
+		while(keepRunning && output.isConnected()) {
+			// Wait for a whole frame to arrive (without holding a thread)
+			if(!takeFrame(buffer, type, input, malformed)) {
+				if(malformed) break;
+				co_await loop.readable(client);
+				if(!receiveAvailable(client, buffer)) break;
+				continue;
+			}
+			if(type != Input) break;
+
+			// Statements may block (on the disk), so they run on an executor rather than the event loop
+			std::optional<Blocked> blocked;
+			while(true) {
+				co_await executor.offload(loop, [&] {
+					{
+						Redirect redirect(output);
+						try {
+							keepRunning = session.execute(input);
+						} catch(Blocked& wait) {
+							blocked = std::move(wait);
+							return;
+						// A statement which fails unexpectedly only ends its input, rather than the whole server
+						} catch(std::exception& e) {
+							std::cerr << "!" << e.what() << std::endl;
+						}
+					}
+					output.finish(keepRunning ? "" : "exit");
+				});
+				if(!blocked) break;
+
+				// A statement which has to wait (for a lock) gives up its executor, the session sleeps until it is woken up (or for the poll interval) and then checks if
+				// the wait is over, once it is the rest of the input is executed
+				auto alarm = std::make_shared<EventLoop::Alarm>();
+				auto subscribed = std::make_shared<std::atomic<bool>>(false);
+				bool ready = false;
+				while(!ready) {
+					if(!subscribed->exchange(true))
+						blocked->subscribe([alarm, subscribed] {
+							*subscribed = false;
+							alarm->notify();
+						});
+					co_await loop.sleep(alarm, blocked->poll);
+					co_await executor.offload(loop, [&] {
+						// If the wait can't be checked, the statement is executed again (and reports the error itself)
+						try {
+							ready = blocked->ready();
+						} catch(std::exception&) {
+							ready = true;
+						}
+					});
+				}
+				input = std::move(blocked->remaining);
+				blocked.reset();
+			}
+
+			// An idle session shouldn't hold on to the memory its last input needed
+			std::string().swap(input);
+			if(buffer.empty()) std::string().swap(buffer);
+		}
+
+		co_await executor.offload(loop, [&] {
+			Redirect redirect(output);
+			if(session.close) session.close();
+			output.flush();
+		});
+
+		loop.forget(client);
+		{
+			std::scoped_lock lock(mutex);
+			clients.erase(client);
+			close(client);
+		}
+		finished.notify_all();
+	}
+
+	void Server::run(const SessionFactory& factory) {
+		this->factory = factory;
+		pollfd listening = {fd, POLLIN, 0};
+		size_t next = 0;
+		while(!stopping) {
+			// Wake up regularly to check if the server has been stopped
+			if(poll(&listening, 1, 100) <= 0) continue;
+			int client = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if(client < 0) continue;
+
+			{
+				std::scoped_lock lock(mutex);
+				clients.insert(client);
+			}
+			// Sessions are spread between the event loops, each session then only runs on its loop's thread
+			EventLoop& loop = *loops[next++ % loops.size()];
+			loop.post([this, &loop, client] { session(loop, client); });
+		}
+	}
+
+	int connect(const std::filesystem::path& path) {
+		auto address = socketAddress(path);
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd < 0)
+			throw std::runtime_error("Failed to create socket");
+		if(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+			close(fd);
+			throw std::runtime_error("Failed to connect to " + path.string());
+		}
+		return fd;
+	}
+
+} // sql::server
@@ -0,0 +1,280 @@
+/*------------------------------------------------------------
+ * Filename: server.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides the client/server mode, where one long lived process owns the storage (so its buffer pool and
+ * 				locks are shared in memory) and clients connect to it over a Unix domain socket. Clients and the server
+ * 				exchange frames: a one byte type, a four byte (little endian) payload length, then the payload. A client
+ * 				sends its input in an Input frame, and the server replies with the Output and Error frames the input
+ * 				printed followed by a Done frame. Output printed to std::cout and std::cerr by a session is redirected
+ * 				to its connection, so statements print the same way whether they run locally or in a server.
+ * 				Sessions are coroutines multiplexed over a few epoll event loops, a session waiting for input doesn't
+ * 				hold a thread, while its statements (which may wait on the disk) run on a pool of executors. A statement
+ * 				which has to wait for a lock doesn't hold its executor either, its session is suspended until the lock
+ * 				is released and the statement is then executed again.
+ *------------------------------------------------------------*/
+
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace sql::server {
+
+	// The types of frame which can be sent over a connection
+	enum FrameType : uint8_t {
+		// Input for the server to execute (client to server)
+		Input,
+		// Text the input printed to standard output or standard error (server to client)
+		Output,
+		Error,
+		// The input has finished executing, the payload is "exit" if the server closed the session (server to client)
+		Done,
+	};
+
+	// The largest payload a frame can hold
+	constexpr size_t maxFrameSize = 16 * 1024 * 1024;
+
+	// Function which sends a frame, returns false if the connection has been closed
+	bool sendFrame(int fd, FrameType type, std::string_view payload);
+	// Function which receives a frame, returns false if the connection has been closed (or the frame is malformed)
+	bool receiveFrame(int fd, FrameType& type, std::string& payload);
+
+	// Class which collects the text a session prints and sends it over its connection as Output and Error frames
+	// NOTE: Text is sent once enough has been buffered, when it switches between standard output and standard error, or when the session finishes its input
+	class SessionOutput {
+		int fd;
+		FrameType pendingType = Output;
+		std::string pending;
+		bool connected = true;
+
+	public:
+		// How much text is buffered before it is sent
+		static constexpr size_t bufferSize = 64 * 1024;
+
+		SessionOutput(int fd): fd(fd) {}
+		SessionOutput(const SessionOutput&) = delete;
+
+		// Append text to the pending frame (sending the pending frame first if it holds a different type of text, or if it is full)
+		void append(FrameType type, std::string_view text);
+		// Send any pending text
+		void flush();
+		// Send any pending text followed by a Done frame
+		void finish(std::string_view payload = {});
+		// Check if the client is still connected
+		bool isConnected() const { return connected; }
+	};
+
+	// Class which redirects std::cout and std::cerr on the current thread to a session's output until it is destroyed
+	// NOTE: The streams' buffers are replaced (once) with buffers which forward to the redirection of whichever thread writes to them, no formatting
+	// state is ever changed on the shared streams so sessions on different threads can print at the same time
+	class Redirect {
+		SessionOutput* previous;
+		static thread_local SessionOutput* current;
+
+	public:
+		Redirect(SessionOutput& output);
+		Redirect(const Redirect&) = delete;
+		~Redirect();
+
+		// The session output of the current thread (null if it isn't redirected)
+		static SessionOutput* active() { return current; }
+	};
+
+	// Coroutine type of a session, a session starts running as soon as it is created and its frame is destroyed once it finishes
+	struct SessionCoroutine {
+		struct promise_type {
+			SessionCoroutine get_return_object() { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+		};
+	};
+
+	// Class representing a thread which waits (with epoll) for many connections to become readable, and resumes the sessions waiting on them
+	// NOTE: Every session assigned to a loop only ever runs on the loop's thread
+	class EventLoop {
+		int epoll = -1;
+		// Event file written to wake the loop when a function is posted to it
+		int wakeup = -1;
+		std::mutex mutex;
+		std::vector<std::function<void()>> posted;
+		// Functions to run once a time has passed (ordered by the time)
+		std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> timers;
+		bool stopping = false;
+		std::thread thread;
+
+		// Function run by the loop's thread
+		void run();
+
+	public:
+		// Create the loop and start its thread (throws std::runtime_error if the epoll instance can't be created)
+		EventLoop();
+		EventLoop(const EventLoop&) = delete;
+		// Stops the loop and waits for its thread, sessions still suspended on the loop are never resumed
+		~EventLoop();
+
+		// Run a function on the loop's thread (safe to call from any thread)
+		void post(std::function<void()> function);
+		// Run a function on the loop's thread once <delay> has passed (safe to call from any thread)
+		void postAfter(std::chrono::milliseconds delay, std::function<void()> function);
+		// Stop waiting for a connection's events (must be called on the loop's thread before the connection is closed)
+		void forget(int fd);
+
+		// Awaitable which suspends a session until its connection is readable (or has been closed)
+		struct Readable {
+			EventLoop& loop;
+			int fd;
+
+			bool await_ready() const noexcept { return false; }
+			bool await_suspend(std::coroutine_handle<> session);
+			void await_resume() const noexcept {}
+		};
+		Readable readable(int fd) { return {*this, fd}; }
+
+		struct Sleep;
+		// Class which wakes a session suspended on a loop (by Sleep), it can be notified from any thread any number of times
+		class Alarm {
+			std::mutex mutex;
+			EventLoop* loop = nullptr;
+			std::coroutine_handle<> session = nullptr;
+			friend struct Sleep;
+		public:
+			// Resume the session on its loop if it is sleeping (otherwise does nothing)
+			void notify();
+		};
+
+		// Awaitable which suspends a session until its alarm is notified or <timeout> has passed (whichever happens first)
+		struct Sleep {
+			EventLoop& loop;
+			std::shared_ptr<Alarm> alarm;
+			std::chrono::milliseconds timeout;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> session);
+			void await_resume() const noexcept {}
+		};
+		Sleep sleep(std::shared_ptr<Alarm> alarm, std::chrono::milliseconds timeout) { return {*this, std::move(alarm), timeout}; }
+	};
+
+	// Class which runs blocking jobs (such as statements, which may wait on locks or the disk) on a fixed set of threads so they never hold up an event loop
+	class Executor {
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<std::function<void()>> jobs;
+		bool stopping = false;
+		std::vector<std::thread> threads;
+
+		// Function run by each of the executor's threads
+		void work();
+
+	public:
+		explicit Executor(size_t threads);
+		Executor(const Executor&) = delete;
+		// Waits for the jobs which have already been submitted
+		~Executor();
+
+		// Queue a job to run on one of the threads
+		void submit(std::function<void()> job);
+
+		// Awaitable which runs a job on the executor, the session is resumed on its event loop once the job has finished (rethrowing anything the job threw)
+		struct Offload {
+			Executor& executor;
+			EventLoop& loop;
+			std::function<void()> job;
+			std::exception_ptr error = nullptr;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> session);
+			void await_resume() { if(error) std::rethrow_exception(error); }
+		};
+		Offload offload(EventLoop& loop, std::function<void()> job) { return {*this, loop, std::move(job)}; }
+	};
+
+	// Exception thrown by a session's input when one of its statements has to wait (such as for a lock held by another session), rather than holding an
+	// executor while it waits. The session is suspended until <ready> returns true, then the rest of its input (starting with the statement which had to wait) is executed
+	struct Blocked {
+		// The input still to be executed
+		std::string remaining;
+		// Check if the wait is over (called on an executor, every time the session wakes up)
+		std::function<bool()> ready;
+		// Call a function (once) the next time whatever the statement is waiting for might have changed
+		std::function<void(std::function<void()>)> subscribe;
+		// How long the session sleeps before checking again, even if it wasn't woken up
+		std::chrono::milliseconds poll;
+	};
+
+	// Class which listens on a Unix domain socket and runs a session for each client that connects
+	class Server {
+	public:
+		// Struct holding the functions which run a session's inputs, they are called on an executor with the session's output redirected to its client
+		struct Session {
+			// Execute an input, returns false if the session should be closed (throws Blocked if a statement has to wait)
+			std::function<bool(const std::string& input)> execute;
+			// Called once the client has disconnected (or the session was closed)
+			std::function<void()> close;
+		};
+		// Function which creates the state of a new session
+		using SessionFactory = std::function<Session()>;
+
+		// The number of threads statements run on by default (one per core, statements waiting for locks don't hold one)
+		static size_t defaultExecutors();
+		// The number of event loops sessions are spread between by default (one per core, but no more than 4)
+		static size_t defaultLoops();
+
+	private:
+		int fd = -1;
+		std::filesystem::path path;
+		std::atomic<bool> stopping = false;
+		SessionFactory factory;
+
+		// The connected clients (the set is emptied as their sessions finish)
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::set<int> clients;
+
+		// NOTE: The loops are destroyed before the executor (and the set of clients), since the sessions running on them use both
+		Executor executor;
+		std::vector<std::unique_ptr<EventLoop>> loops;
+
+		// Coroutine which runs a client's session: it waits for each input, executes it on the executor, then replies with the input's output
+		SessionCoroutine session(EventLoop& loop, int client);
+
+	public:
+		// Start listening on a socket (throws std::runtime_error if it can't be created), a stale socket left by a server which exited is replaced
+		explicit Server(const std::filesystem::path& path, size_t loops = defaultLoops(), size_t executors = defaultExecutors());
+		Server(const Server&) = delete;
+		// Disconnects every client (waiting for their sessions to finish the input they are executing) and removes the socket
+		~Server();
+
+		// Accept connections until stop is called, running a session created by <factory> for each of them
+		void run(const SessionFactory& factory);
+		// Make run return (safe to call from a signal handler)
+		void stop() { stopping = true; }
+	};
+
+	// Function which connects to a server's socket (throws std::runtime_error if it can't connect)
+	int connect(const std::filesystem::path& path);
+
+} // sql::server
+
+#endif // SERVER_HPP
@@ -0,0 +1,181 @@
+/*------------------------------------------------------------
+ * Filename: simd.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the vectorized filter kernels (and the runtime selection between their AVX2, SSE, and scalar versions).
+ *------------------------------------------------------------*/
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define SIMD_X86
+	#include <immintrin.h>
+#endif
+
+namespace sql::simd {
+
+	using Comparison = WhereAction::Comparison;
+
+	// Function which applies a comparison to two values
+	template<Comparison comp, typename T>
+	inline bool apply(T a, T b) {
+		if constexpr(comp == WhereAction::equal) return a == b;
+		else if constexpr(comp == WhereAction::notEqual) return a != b;
+		else if constexpr(comp == WhereAction::less) return a < b;
+		else if constexpr(comp == WhereAction::greater) return a > b;
+		else if constexpr(comp == WhereAction::lessEqual) return a <= b;
+		else return a >= b;
+	}
+
+	// Function which compares the values in [start, count) one at a time (used for the whole batch, or the values left over after the vectorized loop)
+	template<Comparison comp, typename T>
+	inline void scalarLoop(const T* values, size_t start, size_t count, T literal, Word* bitmap) {
+		for(size_t i = start; i < count; i++)
+			bitmap[i / 64] |= Word(apply<comp>(values[i], literal)) << (i % 64);
+	}
+
+	// --- Scalar ---
+
+	// Kernel which compares the values one at a time (used when the processor supports neither AVX2 nor SSE 4.2)
+	template<Comparison comp, typename T>
+	void scalarKernel(const T* values, size_t count, T literal, Word* bitmap) {
+		std::fill(bitmap, bitmap + wordsPerBatch, 0);
+		scalarLoop<comp>(values, 0, count, literal, bitmap);
+	}
+
+#ifdef SIMD_X86
+	// The mask bits which need to be flipped after a comparison (AVX2 and SSE only provide equal and greater for integers, the other comparisons are their complements)
+	template<Comparison comp>
+	constexpr bool inverted = comp == WhereAction::notEqual || comp == WhereAction::lessEqual || comp == WhereAction::greaterEqual;
+
+	// --- AVX2 ---
+
+	// Kernels which compare four values at a time
+	template<Comparison comp>
+	__attribute__((target("avx2"))) void avx2Kernel(const int64_t* values, size_t count, int64_t literal, Word* bitmap) {
+		std::fill(bitmap, bitmap + wordsPerBatch, 0);
+		const __m256i lit = _mm256_set1_epi64x(literal);
+		size_t i = 0;
+		for(; i + 4 <= count; i += 4) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)), mask;
+			if constexpr(comp == WhereAction::equal || comp == WhereAction::notEqual) mask = _mm256_cmpeq_epi64(v, lit);
+			else if constexpr(comp == WhereAction::greater || comp == WhereAction::lessEqual) mask = _mm256_cmpgt_epi64(v, lit);
+			else mask = _mm256_cmpgt_epi64(lit, v);
+
+			Word bits = _mm256_movemask_pd(_mm256_castsi256_pd(mask));
+			if constexpr(inverted<comp>) bits ^= 0xF;
+			bitmap[i / 64] |= bits << (i % 64);
+		}
+		scalarLoop<comp>(values, i, count, literal, bitmap);
+	}
+
+	template<Comparison comp>
+	__attribute__((target("avx2"))) void avx2Kernel(const double* values, size_t count, double literal, Word* bitmap) {
+		// NOTE: The predicates match C++'s comparisons, only not equal holds when a value is NaN
+		constexpr int predicate = comp == WhereAction::equal ? _CMP_EQ_OQ : comp == WhereAction::notEqual ? _CMP_NEQ_UQ
+			: comp == WhereAction::less ? _CMP_LT_OQ : comp == WhereAction::greater ? _CMP_GT_OQ
+			: comp == WhereAction::lessEqual ? _CMP_LE_OQ : _CMP_GE_OQ;
+
+		std::fill(bitmap, bitmap + wordsPerBatch, 0);
+		const __m256d lit = _mm256_set1_pd(literal);
+		size_t i = 0;
+		for(; i + 4 <= count; i += 4) {
+			__m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(values + i), lit, predicate);
+			bitmap[i / 64] |= Word(_mm256_movemask_pd(mask)) << (i % 64);
+		}
+		scalarLoop<comp>(values, i, count, literal, bitmap);
+	}
+
+	// --- SSE ---
+
+	// Kernels which compare two values at a time
+	template<Comparison comp>
+	__attribute__((target("sse4.2"))) void sseKernel(const int64_t* values, size_t count, int64_t literal, Word* bitmap) {
+		std::fill(bitmap, bitmap + wordsPerBatch, 0);
+		const __m128i lit = _mm_set1_epi64x(literal);
+		size_t i = 0;
+		for(; i + 2 <= count; i += 2) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), mask;
+			if constexpr(comp == WhereAction::equal || comp == WhereAction::notEqual) mask = _mm_cmpeq_epi64(v, lit);
+			else if constexpr(comp == WhereAction::greater || comp == WhereAction::lessEqual) mask = _mm_cmpgt_epi64(v, lit);
+			else mask = _mm_cmpgt_epi64(lit, v);
+
+			Word bits = _mm_movemask_pd(_mm_castsi128_pd(mask));
+			if constexpr(inverted<comp>) bits ^= 0x3;
+			bitmap[i / 64] |= bits << (i % 64);
+		}
+		scalarLoop<comp>(values, i, count, literal, bitmap);
+	}
+
+	template<Comparison comp>
+	__attribute__((target("sse4.2"))) void sseKernel(const double* values, size_t count, double literal, Word* bitmap) {
+		std::fill(bitmap, bitmap + wordsPerBatch, 0);
+		const __m128d lit = _mm_set1_pd(literal);
+		size_t i = 0;
+		for(; i + 2 <= count; i += 2) {
+			__m128d v = _mm_loadu_pd(values + i), mask;
+			if constexpr(comp == WhereAction::equal) mask = _mm_cmpeq_pd(v, lit);
+			else if constexpr(comp == WhereAction::notEqual) mask = _mm_cmpneq_pd(v, lit);
+			else if constexpr(comp == WhereAction::less) mask = _mm_cmplt_pd(v, lit);
+			else if constexpr(comp == WhereAction::greater) mask = _mm_cmpgt_pd(v, lit);
+			else if constexpr(comp == WhereAction::lessEqual) mask = _mm_cmple_pd(v, lit);
+			else mask = _mm_cmpge_pd(v, lit);
+
+			bitmap[i / 64] |= Word(_mm_movemask_pd(mask)) << (i % 64);
+		}
+		scalarLoop<comp>(values, i, count, literal, bitmap);
+	}
+#endif // SIMD_X86
+
+	// --- Dispatch ---
+
+	// Struct holding the kernels selected for this machine (indexed by comparison)
+	struct Kernels {
+		const char* name;
+		void (*ints[6])(const int64_t*, size_t, int64_t, Word*);
+		void (*doubles[6])(const double*, size_t, double, Word*);
+	};
+
+	// Macro which builds the table of kernels from a kernel template
+	#define SIMD_KERNELS(name, kernel) Kernels{name,\
+		{&kernel<WhereAction::equal>, &kernel<WhereAction::notEqual>, &kernel<WhereAction::less>, &kernel<WhereAction::greater>, &kernel<WhereAction::lessEqual>, &kernel<WhereAction::greaterEqual>},\
+		{&kernel<WhereAction::equal>, &kernel<WhereAction::notEqual>, &kernel<WhereAction::less>, &kernel<WhereAction::greater>, &kernel<WhereAction::lessEqual>, &kernel<WhereAction::greaterEqual>}}
+
+	// Function which selects the best kernels the processor supports (only done once)
+	const Kernels& kernels() {
+		static const Kernels selected = []{
+#ifdef SIMD_X86
+			if(__builtin_cpu_supports("avx2")) return SIMD_KERNELS("avx2", avx2Kernel);
+			if(__builtin_cpu_supports("sse4.2")) return SIMD_KERNELS("sse4.2", sseKernel);
+#endif
+			return SIMD_KERNELS("scalar", scalarKernel);
+		}();
+		return selected;
+	}
+	#undef SIMD_KERNELS
+
+	// Function which checks that a comparison has a kernel
+	inline size_t kernelIndex(Comparison comp) {
+		if(comp < WhereAction::equal || comp > WhereAction::greaterEqual)
+			throw std::runtime_error("Unexpected condition");
+		return comp;
+	}
+
+	// Functions which filter a batch using the selected kernels
+	void filter(const int64_t* values, size_t count, Comparison comp, int64_t literal, Word* bitmap) {
+		kernels().ints[kernelIndex(comp)](values, std::min(count, batchSize), literal, bitmap);
+	}
+
+	void filter(const double* values, size_t count, Comparison comp, double literal, Word* bitmap) {
+		kernels().doubles[kernelIndex(comp)](values, std::min(count, batchSize), literal, bitmap);
+	}
+
+	// Function which names the selected kernels
+	const char* instructionSet() { return kernels().name; }
+
+} // sql::simd
@@ -0,0 +1,37 @@
+/*------------------------------------------------------------
+ * Filename: simd.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides vectorized filter kernels which compare a batch of typed values to a literal, producing a selection
+ * 				bitmap. AVX2 or SSE versions of the kernels are chosen at runtime (falling back to scalar code).
+ *------------------------------------------------------------*/
+
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SQL.hpp"
+
+namespace sql::simd {
+
+	// Word of a selection bitmap (bit i of word w represents row w * 64 + i)
+	using Word = uint64_t;
+	// The number of rows filtered at once (a multiple of 64, so a batch's selection fits in whole words)
+	constexpr size_t batchSize = 1024;
+	constexpr size_t wordsPerBatch = batchSize / 64;
+
+	// Functions which set bit i of the bitmap if values[i] satisfies the comparison with the literal (bits past <count> are cleared)
+	// NOTE: <count> may not be larger than the batch size, and the bitmap must hold a whole batch
+	void filter(const int64_t* values, size_t count, WhereAction::Comparison comp, int64_t literal, Word* bitmap);
+	void filter(const double* values, size_t count, WhereAction::Comparison comp, double literal, Word* bitmap);
+
+	// The name of the instruction set the kernels use on this machine ("avx2", "sse4.2", or "scalar")
+	const char* instructionSet();
+
+} // sql::simd
+
+#endif // SIMD_HPP
@@ -0,0 +1,171 @@
+/*------------------------------------------------------------
+ * Filename: sort.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the external merge sort's spilling of sorted runs and their k-way merge, and the bounded top-N heap.
+ *------------------------------------------------------------*/
+
+#include "sort.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+
+#include "storage.hpp"
+
+namespace sql {
+
+	ExternalSort::ExternalSort(const Table& schema, std::vector<SortKey> keys, std::filesystem::path directory, size_t memoryBudget, WorkerPool* workers)
+		: order{std::move(keys)}, directory(std::move(directory)), memoryBudget(memoryBudget), workers(workers) {
+		buffer.name = schema.name;
+		buffer.columns = schema.columns;
+		id = storage::newModification();
+	}
+
+	ExternalSort::~ExternalSort() {
+		std::error_code ignored;
+		for(auto& run: runs)
+			std::filesystem::remove(run, ignored);
+	}
+
+	// Struct representing a run file being merged, holding the next tuple it will output
+	struct ExternalSort::Run {
+		std::ifstream file;
+		std::vector<char> record;
+		Tuple current;
+
+		Run(const std::filesystem::path& path, Table& schema): file(path, std::ios::binary) {
+			if(!file) throw std::runtime_error("Failed to open sort run " + path.string());
+			current.table = &schema;
+			for(Column& column: schema.columns)
+				current.emplace_back(Data::null(&column));
+		}
+
+		// Read the run's next tuple, returns false once the run is exhausted
+		bool next() {
+			uint32_t size;
+			if(!file.read((char*) &size, sizeof(size))) return false;
+			record.resize(size);
+			if(!file.read(record.data(), size))
+				throw std::runtime_error("Sort run ended prematurely");
+			storage::Reader in(record);
+			storage::decodeTuple(in, current);
+			return true;
+		}
+	};
+
+	std::filesystem::path ExternalSort::createRun(std::ofstream& file) {
+		// Run files are hidden files named after the sort (so concurrent sorts in the same directory don't collide)
+		std::stringstream name;
+		name << ".sort." << std::hex << id << "." << std::dec << nextRun++ << ".run";
+		auto path = directory / name.str();
+		file.open(path, std::ios::binary | std::ios::trunc);
+		if(!file) throw std::runtime_error("Failed to create sort run " + path.string());
+		return path;
+	}
+
+	void ExternalSort::writeTuple(std::ofstream& file, const Tuple& tuple, std::vector<char>& record) {
+		// Each tuple is stored prefixed by its encoded size
+		record.clear();
+		storage::Writer out(record);
+		storage::encodeTuple(out, tuple);
+		uint32_t size = record.size();
+		file.write((const char*) &size, sizeof(size));
+		file.write(record.data(), record.size());
+	}
+
+	void ExternalSort::spill() {
+		if(buffer.tuples.empty()) return;
+		stableSort(workers, buffer.tuples.begin(), buffer.tuples.end(), order);
+
+		std::ofstream file;
+		runs.push_back(createRun(file));
+		std::vector<char> record;
+		for(auto& tuple: buffer.tuples)
+			writeTuple(file, tuple, record);
+		if(!file) throw std::runtime_error("Failed to write sort run " + runs.back().string());
+
+		buffer.tuples.clear();
+		bufferedBytes = 0;
+	}
+
+	void ExternalSort::merge(size_t count, const std::function<void(const Tuple&)>& output) {
+		std::vector<std::unique_ptr<Run>> merging;
+		for(size_t i = 0; i < count; i++)
+			merging.emplace_back(std::make_unique<Run>(runs[i], buffer));
+
+		// Repeatedly output the smallest of the runs' next tuples (ties are broken by the run's age, keeping the sort stable)
+		auto after = [&](size_t a, size_t b) {
+			if(order(merging[b]->current, merging[a]->current)) return true;
+			if(order(merging[a]->current, merging[b]->current)) return false;
+			return a > b;
+		};
+		std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(after);
+		for(size_t i = 0; i < merging.size(); i++)
+			if(merging[i]->next())
+				heap.push(i);
+
+		while(!heap.empty()) {
+			size_t i = heap.top();
+			heap.pop();
+			output(merging[i]->current);
+			if(merging[i]->next())
+				heap.push(i);
+		}
+
+		// The merged runs are no longer needed
+		merging.clear();
+		std::error_code ignored;
+		for(size_t i = 0; i < count; i++)
+			std::filesystem::remove(runs[i], ignored);
+		runs.erase(runs.begin(), runs.begin() + count);
+	}
+
+	void ExternalSort::finish(const std::function<void(const Tuple&)>& output) {
+		// If nothing was spilled, the tuples can be sorted in memory
+		if(runs.empty()) {
+			stableSort(workers, buffer.tuples.begin(), buffer.tuples.end(), order);
+			for(auto& tuple: buffer.tuples)
+				output(tuple);
+			buffer.tuples.clear();
+			return;
+		}
+		spill();
+
+		// If there are too many runs to merge at once, the oldest runs are merged into a single run (which takes their place, keeping the sort stable) until few enough remain
+		std::vector<char> record;
+		while(runs.size() > maxMergeWidth) {
+			std::ofstream file;
+			auto merged = createRun(file);
+			merge(maxMergeWidth, [&](const Tuple& tuple) { writeTuple(file, tuple, record); });
+			file.close();
+			if(!file) throw std::runtime_error("Failed to write sort run " + merged.string());
+			runs.insert(runs.begin(), merged);
+		}
+
+		merge(runs.size(), output);
+	}
+
+	TopN::TopN(const Table& schema, std::vector<SortKey> keys, size_t n): order{std::move(keys)}, n(n) {
+		buffer.name = schema.name;
+		buffer.columns = schema.columns;
+		buffer.tuples.reserve(n);
+		candidate.table = &buffer;
+		for(Column& column: buffer.columns)
+			candidate.emplace_back(Data::null(&column));
+	}
+
+	void TopN::finish(const std::function<void(const Tuple&)>& output) {
+		std::sort(heap.begin(), heap.end(), [this](size_t a, size_t b) { return before(a, b); });
+		for(size_t i: heap)
+			output(buffer.tuples[i]);
+		buffer.tuples.clear();
+		heap.clear();
+	}
+
+} // sql
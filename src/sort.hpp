@@ -0,0 +1,171 @@
+/*------------------------------------------------------------
+ * Filename: sort.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides the ordering of tuples by a set of sort keys, and an external merge sort which buffers tuples in memory
+ * 				until a memory budget is exceeded, spilling each sorted buffer to a run file which are then merged. Also provides a bounded
+ * 				heap which keeps only the first few tuples of an ordered stream (used to answer limited queries).
+ *------------------------------------------------------------*/
+
+#ifndef SORT_HPP
+#define SORT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#include "SQL.hpp"
+#include "parallel.hpp"
+#include "predicate.hpp"
+
+namespace sql {
+
+	// Struct representing one of the columns tuples are sorted by
+	struct SortKey {
+		size_t column;
+		bool descending = false;
+	};
+
+	// Struct which orders tuples by a set of sort keys (nulls are ordered before everything else, as they are in comparisons)
+	struct TupleOrder {
+		std::vector<SortKey> keys;
+
+		// Check if tuple <a> should be ordered before tuple <b>
+		bool operator()(const Tuple& a, const Tuple& b) const {
+			for(auto& key: keys) {
+				const Data::Variant& x = a[key.column].data, & y = b[key.column].data;
+				if(x == y) continue;
+				return key.descending ? y < x : x < y;
+			}
+			return false;
+		}
+	};
+
+	// Class which sorts a stream of rows, rows are buffered in memory until they exceed the memory budget at which point the buffered
+	// tuples are sorted and spilled to a run file (in the provided directory), once every row has been added the runs are merged
+	// NOTE: The sort is stable, tuples which are ordered the same are output in the order they were added
+	class ExternalSort {
+		// Table holding the schema of the sorted tuples, and the tuples buffered in memory
+		Table buffer;
+		TupleOrder order;
+		std::filesystem::path directory;
+		size_t memoryBudget;
+		// The pool of workers the buffered tuples are sorted with (or null if they should be sorted by the current thread)
+		WorkerPool* workers;
+		// The (estimated) number of bytes of memory used by the buffered tuples
+		size_t bufferedBytes = 0;
+		// The run files spilled so far, oldest first (removed once the sort is destroyed)
+		std::vector<std::filesystem::path> runs;
+		// Random value identifying the sort's run files, and the number of run files created so far
+		uint64_t id;
+		size_t nextRun = 0;
+
+		struct Run;
+		// Create a new run file
+		std::filesystem::path createRun(std::ofstream& file);
+		// Append a tuple to a run file
+		static void writeTuple(std::ofstream& file, const Tuple& tuple, std::vector<char>& record);
+		// Sort the buffered tuples and write them to a new run file
+		void spill();
+		// Merge the oldest <count> runs, passing their tuples to the provided function in order (the merged runs are removed)
+		void merge(size_t count, const std::function<void(const Tuple&)>& output);
+
+	public:
+		// The default amount of memory tuples are buffered in before they are spilled to disk
+		static constexpr size_t defaultMemoryBudget = 64 * 1024 * 1024;
+		// The most runs which are merged at once (more runs are first merged in several passes)
+		static constexpr size_t maxMergeWidth = 64;
+
+		ExternalSort(const Table& schema, std::vector<SortKey> keys, std::filesystem::path directory, size_t memoryBudget = defaultMemoryBudget, WorkerPool* workers = nullptr);
+		ExternalSort(const ExternalSort&) = delete;
+		~ExternalSort();
+
+		// Add a row (either a tuple, or the views of a mapped table's current tuple) to the sort
+		template<typename Row>
+		void add(const Row& row) {
+			Tuple& tuple = buffer.createEmptyTuple();
+			for(size_t i = 0; i < tuple.size(); i++)
+				tuple[i].data = own(cell(row, i));
+			bufferedBytes += storage::encodedSize(tuple) + sizeof(Tuple) + tuple.size() * sizeof(Data);
+
+			if(bufferedBytes > memoryBudget)
+				spill();
+		}
+
+		// Pass each of the added tuples, in order, to the provided function
+		void finish(const std::function<void(const Tuple&)>& output);
+
+		// The number of runs that have been spilled to disk
+		size_t runCount() const { return runs.size(); }
+	};
+
+	// Class which keeps only the first <n> (in order) of a stream of rows, the kept tuples form a bounded heap (whose top is the last
+	// kept tuple) so each row only needs to be compared against the top to determine if it displaces a kept tuple
+	// NOTE: Like the external sort this is stable, tuples which are ordered the same are kept in the order they were added
+	class TopN {
+		// Table holding the schema of the kept tuples, and the kept tuples themselves
+		Table buffer;
+		TupleOrder order;
+		size_t n;
+		// The indices of the kept tuples arranged as a heap, and the order each kept tuple was added in
+		std::vector<size_t> heap, sequence;
+		// The number of rows added so far
+		size_t added = 0;
+		// Tuple holding the sorted columns of a row while it is compared against the heap
+		Tuple candidate;
+
+		// Check if kept tuple <a> is ordered before kept tuple <b> (ties are broken by the order they were added)
+		bool before(size_t a, size_t b) const {
+			if(order(buffer.tuples[a], buffer.tuples[b])) return true;
+			if(order(buffer.tuples[b], buffer.tuples[a])) return false;
+			return sequence[a] < sequence[b];
+		}
+
+	public:
+		// The largest number of tuples kept (larger limits should be sorted externally so they can't exhaust memory)
+		static constexpr size_t maxTuples = 100'000;
+
+		TopN(const Table& schema, std::vector<SortKey> keys, size_t n);
+		TopN(const TopN&) = delete;
+
+		// Add a row (either a tuple, or the views of a mapped table's current tuple), it is only copied if it is kept
+		template<typename Row>
+		void add(const Row& row) {
+			size_t slot;
+			if(heap.size() < n) {
+				slot = buffer.tuples.size();
+				buffer.createEmptyTuple();
+				sequence.push_back(0);
+			} else {
+				if(n == 0) return;
+				// Rows ordered the same as the last kept tuple were added after it, and thus aren't kept either
+				for(auto& key: order.keys)
+					candidate[key.column].data = own(cell(row, key.column));
+				if(!order(candidate, buffer.tuples[heap.front()])) return;
+
+				// The row replaces the last kept tuple
+				std::pop_heap(heap.begin(), heap.end(), [this](size_t a, size_t b) { return before(a, b); });
+				slot = heap.back();
+				heap.pop_back();
+			}
+
+			Tuple& tuple = buffer.tuples[slot];
+			for(size_t i = 0; i < tuple.size(); i++)
+				tuple[i].data = own(cell(row, i));
+			sequence[slot] = added++;
+			heap.push_back(slot);
+			std::push_heap(heap.begin(), heap.end(), [this](size_t a, size_t b) { return before(a, b); });
+		}
+
+		// Pass each of the kept tuples, in order, to the provided function
+		void finish(const std::function<void(const Tuple&)>& output);
+	};
+
+} // sql
+
+#endif // SORT_HPP
@@ -0,0 +1,1103 @@
+/*------------------------------------------------------------
+ * Filename: storage.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements reading and writing table files (in both row and columnar layouts), along with page level
+ * 				modification of their tuples and the copy-on-write shadows transactions modify.
+ *------------------------------------------------------------*/
+
+#include "storage.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <SimpleBinStream.h>
+
+#include "index.hpp"
+#include "versions.hpp"
+#include "wal.hpp"
+
+namespace sql::storage {
+
+	// Data de/encoding (a null flag followed by the data if it isn't null)
+	void encodeData(Writer& out, const Data& data) {
+		out << std::byte(data.isNull());
+		if(!data.isNull())
+			std::visit([&](const auto& value){
+				if constexpr(!std::is_same_v<std::decay_t<decltype(value)>, std::monostate>)
+					out << value;
+			}, data.data);
+	}
+	void decodeData(Reader& in, Data& data) {
+		std::byte null;
+		in >> null;
+		if(bool(null)) {
+			data.data = {};
+			return;
+		}
+
+		// If the data isn't null, we use the column pointer to determine how to decode the data
+		switch(data.column->type.type){
+		break; case DataType::BOOL: {
+			bool value;
+			in >> value;
+			data.data = value;
+		}
+		break; case DataType::INT: {
+			int64_t value;
+			in >> value;
+			data.data = value;
+		}
+		break; case DataType::FLOAT: {
+			double value;
+			in >> value;
+			data.data = value;
+		}
+		break; case DataType::CHAR:
+		case DataType::VARCHAR:
+		case DataType::TEXT: {
+			std::string value;
+			in >> value;
+			data.data = std::move(value);
+		}
+		break; default:
+			throw std::runtime_error("Unexpected data type");
+		}
+	}
+
+	// Tuple de/encoding (the number of pieces of data followed by each piece of data)
+	void encodeTuple(Writer& out, const Tuple& tuple) {
+		out << uint64_t(tuple.size());
+		for(const Data& data: tuple)
+			encodeData(out, data);
+	}
+	void decodeTuple(Reader& in, Tuple& tuple) {
+		uint64_t size;
+		in >> size;
+		// The tuple should already have been sized to match the table's columns
+		if(size != tuple.size())
+			throw std::runtime_error("Tuple doesn't match the table's schema");
+		for(Data& data: tuple)
+			decodeData(in, data);
+	}
+
+	// Schema de/encoding (the table's name followed by its columns)
+	void encodeSchema(Writer& out, const Table& table) {
+		out << table.name << uint64_t(table.columns.size());
+		for(const Column& column: table.columns)
+			out << column.name << column.type.type << column.type.size;
+	}
+	void decodeSchema(Reader& in, Table& table) {
+		uint64_t size;
+		in >> table.name >> size;
+		table.columns.resize(size);
+		for(Column& column: table.columns) {
+			column.table = &table;
+			in >> column.name >> column.type.type >> column.type.size;
+		}
+	}
+
+	// Data view decoding (strings point into the buffer being read rather than being copied)
+	void decodeData(Reader& in, const Column& column, DataView& data) {
+		std::byte null;
+		in >> null;
+		if(bool(null)) {
+			data = {};
+			return;
+		}
+
+		switch(column.type.type){
+		break; case DataType::BOOL: {
+			bool value;
+			in >> value;
+			data = value;
+		}
+		break; case DataType::INT: {
+			int64_t value;
+			in >> value;
+			data = value;
+		}
+		break; case DataType::FLOAT: {
+			double value;
+			in >> value;
+			data = value;
+		}
+		break; case DataType::CHAR:
+		case DataType::VARCHAR:
+		case DataType::TEXT: {
+			std::string_view value;
+			in >> value;
+			data = value;
+		}
+		break; default:
+			throw std::runtime_error("Unexpected data type");
+		}
+	}
+
+	size_t encodedSize(const Tuple& tuple) {
+		size_t size = sizeof(uint64_t);
+		for(const Data& data: tuple)
+			size += 1 + std::visit([](const auto& value) -> size_t {
+				using T = std::decay_t<decltype(value)>;
+				if constexpr(std::is_same_v<T, std::monostate>) return 0;
+				else if constexpr(std::is_same_v<T, std::string>) return sizeof(uint32_t) + value.size();
+				else return sizeof(T);
+			}, data.data);
+		return size;
+	}
+
+
+	// --- Pages ---
+
+
+	// Helpers which access the pieces of a page
+	static FileHeader& fileHeader(char* page) { return *reinterpret_cast<FileHeader*>(page); }
+	static DirectoryHeader& directoryHeader(char* page) { return *reinterpret_cast<DirectoryHeader*>(page); }
+	static DirectoryEntry* directoryEntries(char* page) { return reinterpret_cast<DirectoryEntry*>(page + sizeof(DirectoryHeader)); }
+	static PageHeader& pageHeader(char* page) { return *reinterpret_cast<PageHeader*>(page); }
+	static Slot* slots(char* page) { return reinterpret_cast<Slot*>(page + sizeof(PageHeader)); }
+	static SegmentPageHeader& segmentHeader(char* page) { return *reinterpret_cast<SegmentPageHeader*>(page); }
+
+	// Helper which calculates the amount of contiguous free space between the slot array and the records in a data page
+	static size_t contiguousSpace(char* page) {
+		auto& header = pageHeader(page);
+		return header.recordStart - (sizeof(PageHeader) + header.slotCount * sizeof(Slot));
+	}
+	// Helper which calculates the amount of free space a data page would have if it was compacted
+	static size_t freeSpace(char* page) { return contiguousSpace(page) + pageHeader(page).fragmented; }
+
+	// Helper which gets a view of a record stored in a data page (empty if the record has been deleted)
+	static std::string_view record(char* page, uint16_t slot) {
+		Slot& s = slots(page)[slot];
+		return {page + s.offset, s.length};
+	}
+
+	// Helper which sets up an empty data page
+	static void initDataPage(char* page, uint32_t directoryPage, uint16_t directoryEntry) {
+		std::memset(page, 0, pageSize);
+		auto& header = pageHeader(page);
+		header.directoryPage = directoryPage;
+		header.directoryEntry = directoryEntry;
+		header.recordStart = pageSize;
+	}
+
+	// Helper which packs all of the records in a data page against the end of the page, reclaiming any fragmented space
+	static void compactPage(char* page) {
+		auto& header = pageHeader(page);
+		std::vector<char> copy(page, page + pageSize);
+
+		header.recordStart = pageSize;
+		for(uint16_t i = 0; i < header.slotCount; i++) {
+			Slot& slot = slots(page)[i];
+			if(slot.length == 0) continue;
+
+			header.recordStart -= slot.length;
+			std::memcpy(page + header.recordStart, copy.data() + slot.offset, slot.length);
+			slot.offset = header.recordStart;
+		}
+		header.fragmented = 0;
+	}
+
+	// Helper which stores a record at the start of the record area of a data page (the page must have enough contiguous space)
+	static void placeRecord(char* page, uint16_t slot, std::string_view bytes) {
+		auto& header = pageHeader(page);
+		header.recordStart -= bytes.size();
+		std::memcpy(page + header.recordStart, bytes.data(), bytes.size());
+		slots(page)[slot] = {header.recordStart, uint16_t(bytes.size())};
+	}
+
+	// Helper which adds a new record to a data page, returns false if there isn't enough space
+	static bool insertRecord(char* page, std::string_view bytes, uint16_t& slot) {
+		if(freeSpace(page) < bytes.size() + sizeof(Slot))
+			return false;
+		if(contiguousSpace(page) < bytes.size() + sizeof(Slot))
+			compactPage(page);
+
+		slot = pageHeader(page).slotCount++;
+		placeRecord(page, slot, bytes);
+		return true;
+	}
+
+	// Helper which marks a record in a data page as deleted
+	static void eraseRecord(char* page, uint16_t slot) {
+		Slot& s = slots(page)[slot];
+		pageHeader(page).fragmented += s.length;
+		s = {0, 0};
+	}
+
+	// Helper which replaces a record in a data page, returns false (leaving the old record in place) if there isn't enough space
+	static bool updateRecord(char* page, uint16_t slot, std::string_view bytes) {
+		Slot& s = slots(page)[slot];
+		// If the new record is no bigger than the old one, overwrite it in place
+		if(bytes.size() <= s.length) {
+			std::memcpy(page + s.offset, bytes.data(), bytes.size());
+			pageHeader(page).fragmented += s.length - bytes.size();
+			s.length = bytes.size();
+			return true;
+		}
+
+		if(freeSpace(page) + s.length < bytes.size())
+			return false;
+		eraseRecord(page, slot);
+		if(contiguousSpace(page) < bytes.size())
+			compactPage(page);
+		placeRecord(page, slot, bytes);
+		return true;
+	}
+
+
+	// --- Table Files ---
+
+
+	uint64_t newModification() {
+		static thread_local std::mt19937_64 random{std::random_device{}()};
+		return random();
+	}
+
+	// Struct tracking a copy-on-write shadow of a table file
+	struct Shadow {
+		// The table the shadow is a copy of
+		std::filesystem::path table;
+		// The pages which have been copied into the shadow (the rest of the table's pages are still read from the table)
+		std::set<uint32_t> pages;
+		// Set if the shadow was rewritten, in which case none of its pages are read from the table
+		bool rewritten = false;
+	};
+	static std::mutex shadowMutex;
+	static std::map<std::filesystem::path, Shadow> shadows;
+
+	// Helper which finds the shadow stored at a path (null if the file isn't a shadow)
+	static Shadow* findShadow(const std::filesystem::path& path) {
+		std::scoped_lock lock(shadowMutex);
+		auto shadow = shadows.find(path);
+		return shadow == shadows.end() ? nullptr : &shadow->second;
+	}
+
+	ShadowedFile::ShadowedFile(const std::filesystem::path& path, bool writable, bool logged /*= true*/): shadow(findShadow(path)), file(path, writable, logged && !shadow) {
+		if(shadow && !shadow->rewritten)
+			original.emplace(shadow->table, /*writable*/ false);
+	}
+
+	bool ShadowedFile::inOriginal(uint32_t number) const { return original && number != 0 && !shadow->pages.count(number) && !copied.count(number); }
+
+	void ShadowedFile::attach(uint64_t version, uint64_t originalVersion /*= 0*/) {
+		file.attach(version);
+		if(original) original->attach(originalVersion);
+	}
+
+	char* ShadowedFile::page(uint32_t number) {
+		// Pages are copied into a shadow the first time they are accessed for modification
+		if(inOriginal(number)) {
+			auto page = original->fetch(number);
+			std::memcpy(file.create(number), page.data(), pageSize);
+			copied.insert(number);
+		}
+		return file.page(number);
+	}
+
+	char* ShadowedFile::create(uint32_t number) {
+		if(shadow) copied.insert(number);
+		return file.create(number);
+	}
+
+	void ShadowedFile::flush(uint64_t version) {
+		file.flush(version);
+
+		// The pages copied into a shadow are now stored in it
+		if(shadow) {
+			std::scoped_lock lock(shadowMutex);
+			shadow->pages.merge(copied);
+			copied.clear();
+		}
+	}
+
+	// Class which provides page level access to a table file, the pages are held in the buffer pool (pinned until the file is flushed)
+	// NOTE: If the file is a shadow, pages which haven't been copied into it are read from its table (and copied into the shadow once they are modified)
+	class TableFile {
+		ShadowedFile file;
+		// Set once a search of the directory found no page with enough free space, cleared once a page gains space (so appending many records doesn't search every time a page fills)
+		bool searchedFull = false;
+
+	public:
+		// Copy of the header stored in page 0
+		FileHeader header;
+
+		// The number of pinned pages after which long running operations should flush
+		constexpr static size_t flushThreshold = PagedFile::flushThreshold;
+
+		// NOTE: Shadows (and files opened with <logged> false) aren't recorded in the write-ahead log, shadows are only logged once they are committed
+		TableFile(const std::filesystem::path& path, bool writable, bool logged = true): file(path, writable, logged) {
+			header = fileHeader(file.page(0));
+			if(std::string_view(header.magic, sizeof(header.magic)) != tableMagic)
+				throw std::runtime_error("Not a table file");
+			if(header.version != formatVersion || header.pageSize != pageSize)
+				throw std::runtime_error("Unsupported table file version");
+
+			// Any pages cached from an older version of the file (or the table a shadow is a copy of) will be discarded
+			char* original = file.originalHeader();
+			file.attach(header.modification, original ? fileHeader(original).modification : 0);
+		}
+
+		// Get a page (pinning it in the buffer pool until the file is flushed)
+		char* page(uint32_t number) {
+			if(number != 0 && number >= header.pageCount)
+				throw std::runtime_error("Page out of bounds");
+			return file.page(number);
+		}
+		// Pin a page only until the returned handle is destroyed
+		BufferPool::Page fetch(uint32_t number) { return file.fetch(number); }
+		// Mark a page as needing to be written back to disk
+		void markDirty(uint32_t number) { file.markDirty(number); }
+		// The number of pages currently pinned by this file
+		size_t pinnedPages() { return file.pinnedPages(); }
+
+		// Add a new zeroed page to the end of the file
+		uint32_t allocatePage() {
+			uint32_t number = header.pageCount++;
+			file.create(number);
+			return number;
+		}
+
+		// Add a new data page to the end of the file (and an entry for it to the directory)
+		uint32_t allocateDataPage() {
+			// If the last directory page is full, start a new one
+			if(header.lastDirectoryPage == noPage || directoryHeader(page(header.lastDirectoryPage)).entryCount == directoryEntriesPerPage) {
+				uint32_t directory = allocatePage();
+				if(header.lastDirectoryPage == noPage)
+					header.firstDirectoryPage = directory;
+				else {
+					directoryHeader(page(header.lastDirectoryPage)).next = directory;
+					markDirty(header.lastDirectoryPage);
+				}
+				header.lastDirectoryPage = directory;
+			}
+
+			uint32_t number = allocatePage();
+			char* directory = page(header.lastDirectoryPage);
+			uint16_t entry = directoryHeader(directory).entryCount++;
+			directoryEntries(directory)[entry] = {number, uint16_t(pageSize - sizeof(PageHeader)), 0};
+			markDirty(header.lastDirectoryPage);
+
+			initDataPage(page(number), header.lastDirectoryPage, entry);
+			header.lastDataPage = number;
+			return number;
+		}
+
+		// Update a data page's directory entry to reflect its current free space
+		void syncDirectory(uint32_t number) {
+			char* data = page(number);
+			auto& header = pageHeader(data);
+			auto& entry = directoryEntries(page(header.directoryPage))[header.directoryEntry];
+			if(freeSpace(data) > entry.freeSpace) searchedFull = false;
+			entry.freeSpace = freeSpace(data);
+			markDirty(header.directoryPage);
+			markDirty(number);
+		}
+
+		// Find the first data page with at least <size> bytes of free space according to the directory, returns noPage if there isn't one
+		uint32_t findDataPage(size_t size) {
+			if(searchedFull) return noPage;
+			for(uint32_t d = header.firstDirectoryPage; d != noPage; ) {
+				auto directory = fetch(d);
+				for(size_t e = 0; e < directoryHeader(directory.data()).entryCount; e++)
+					if(directoryEntries(directory.data())[e].freeSpace >= size)
+						return directoryEntries(directory.data())[e].page;
+				d = directoryHeader(directory.data()).next;
+			}
+			searchedFull = true;
+			return noPage;
+		}
+
+		// Get the page storing a record, ensuring that the record exists
+		char* recordPage(RecordID rid) {
+			if(!rid.valid() || rid.page >= header.pageCount)
+				throw std::runtime_error("Record doesn't exist");
+			char* data = page(rid.page);
+			if(rid.slot >= pageHeader(data).slotCount || slots(data)[rid.slot].length == 0)
+				throw std::runtime_error("Record doesn't exist");
+			return data;
+		}
+
+		// Add a record to the table, placing it in the most recent data page if it fits, otherwise in the first page the directory says has room (space freed
+		// by deleted or moved records is reused) before a new page is added
+		RecordID insert(std::string_view bytes) {
+			if(bytes.size() > maxRecordSize)
+				throw std::runtime_error("Record is too large to fit in a page");
+
+			RecordID rid;
+			rid.page = header.lastDataPage;
+			if(rid.page == noPage || !insertRecord(page(rid.page), bytes, rid.slot)) {
+				rid.page = findDataPage(bytes.size() + sizeof(Slot));
+				if(rid.page == noPage || !insertRecord(page(rid.page), bytes, rid.slot)) {
+					rid.page = allocateDataPage();
+					insertRecord(page(rid.page), bytes, rid.slot);
+				}
+			}
+			syncDirectory(rid.page);
+			return rid;
+		}
+
+		// Get the array of segments (one per column) stored after the schema of a columnar table
+		Segment* segments() { return reinterpret_cast<Segment*>(page(0) + sizeof(FileHeader) + header.schemaSize); }
+
+		// Append an encoded value to the end of a column's segment (columnar tables only)
+		void appendValue(size_t column, std::string_view bytes) {
+			if(sizeof(SegmentPageHeader) + bytes.size() > pageSize)
+				throw std::runtime_error("Value is too large to fit in a page");
+
+			Segment& segment = segments()[column];
+			// If the value doesn't fit in the segment's last page, add a new page to the segment
+			if(segment.lastPage == noPage || sizeof(SegmentPageHeader) + segmentHeader(page(segment.lastPage)).length + bytes.size() > pageSize) {
+				uint32_t number = allocatePage();
+				if(segment.lastPage == noPage)
+					segment.firstPage = number;
+				else {
+					segmentHeader(page(segment.lastPage)).next = number;
+					markDirty(segment.lastPage);
+				}
+				segment.lastPage = number;
+			}
+
+			char* data = page(segment.lastPage);
+			auto& header = segmentHeader(data);
+			std::memcpy(data + sizeof(SegmentPageHeader) + header.length, bytes.data(), bytes.size());
+			header.length += bytes.size();
+			header.valueCount++;
+			markDirty(segment.lastPage);
+		}
+
+		// Call the provided function with the number of values and a reader over the values of every page in a column's segment (columnar tables only)
+		template<typename F>
+		void forEachSegmentPage(size_t column, F&& func) {
+			for(uint32_t number = segments()[column].firstPage; number != noPage; ) {
+				if(number >= this->header.pageCount)
+					throw std::runtime_error("Page out of bounds");
+				auto data = fetch(number);
+				auto& header = segmentHeader(data.data());
+				if(sizeof(SegmentPageHeader) + header.length > pageSize)
+					throw std::runtime_error("Segment page is corrupted");
+				func(header.valueCount, Reader(data.data() + sizeof(SegmentPageHeader), data.data() + sizeof(SegmentPageHeader) + header.length));
+				number = header.next;
+			}
+		}
+
+		// Call the provided function with the record ID and bytes of every record in the file
+		template<typename F>
+		void forEachRecord(F&& func) {
+			for(uint32_t d = header.firstDirectoryPage; d != noPage; ) {
+				auto directory = fetch(d);
+				for(size_t e = 0; e < directoryHeader(directory.data()).entryCount; e++) {
+					uint32_t number = directoryEntries(directory.data())[e].page;
+					auto data = fetch(number);
+					for(uint16_t slot = 0; slot < pageHeader(data.data()).slotCount; slot++)
+						if(auto bytes = record(data.data(), slot); !bytes.empty())
+							func(RecordID{number, slot}, bytes);
+				}
+				d = directoryHeader(directory.data()).next;
+			}
+		}
+
+		// Call the provided function with the record ID and bytes of each of the provided records (which should be sorted by page), ensuring that the records exist
+		template<typename F>
+		void forEachRecord(const std::vector<RecordID>& rids, F&& func) {
+			BufferPool::Page data;
+			uint32_t current = noPage;
+			for(RecordID rid: rids) {
+				if(!rid.valid() || rid.page >= header.pageCount)
+					throw std::runtime_error("Record doesn't exist");
+				// Each page is only pinned while its records are read
+				if(current != rid.page) {
+					data = fetch(rid.page);
+					current = rid.page;
+				}
+				if(rid.slot >= pageHeader(data.data()).slotCount || slots(data.data())[rid.slot].length == 0)
+					throw std::runtime_error("Record doesn't exist");
+				func(rid, record(data.data(), rid.slot));
+			}
+		}
+
+		// Write all of the modified pages (and the header) back to disk, and unpin all of the pages
+		void flush() {
+			header.modification = newModification();
+
+			fileHeader(file.page(0)) = header;
+			file.flush(header.modification);
+		}
+	};
+
+
+	// --- Helpers ---
+
+
+	// Helper which encodes a tuple into a byte buffer
+	static std::vector<char> encode(const Tuple& tuple) {
+		std::vector<char> buffer;
+		buffer.reserve(encodedSize(tuple));
+		Writer out(buffer);
+		encodeTuple(out, tuple);
+		return buffer;
+	}
+
+	// Helper which encodes a single piece of data into a byte buffer (reusing the buffer's memory)
+	static void encode(const Data& data, std::vector<char>& buffer) {
+		buffer.clear();
+		Writer out(buffer);
+		encodeData(out, data);
+	}
+
+	// Helper which decodes the schema (and layout) stored in a table file's header page
+	static void decodeSchema(const FileHeader& header, const char* page, Table& table) {
+		if(sizeof(FileHeader) + header.schemaSize > pageSize)
+			throw std::runtime_error("Table schema is too large to fit in a page");
+		Reader in(page + sizeof(FileHeader), page + sizeof(FileHeader) + header.schemaSize);
+		decodeSchema(in, table);
+
+		table.layout = Table::Layout(header.layout);
+		if(table.layout != Table::Row && table.layout != Table::Columnar)
+			throw std::runtime_error("Unknown table layout");
+		if(table.layout == Table::Columnar && sizeof(FileHeader) + header.schemaSize + table.columns.size() * sizeof(Segment) > pageSize)
+			throw std::runtime_error("Table schema is too large to fit in a page");
+	}
+	static void decodeSchema(TableFile& file, Table& table) { decodeSchema(file.header, file.page(0), table); }
+
+	// Helper which checks if a table file stores its tuples in columns
+	static bool isColumnarTableFile(const std::filesystem::path& path) {
+		TableFile file(path, /*writable*/ false);
+		return file.header.layout == Table::Columnar;
+	}
+
+	// Helper which reads a table stored in the legacy format
+	static void readLegacyTable(const std::filesystem::path& path, Table& table) {
+		simple::file_istream<std::true_type> fin(path.c_str());
+		fin >> table;
+		fin.close();
+	}
+
+	// Helper which upgrades a legacy table file to the current format
+	static void upgradeLegacyTable(const std::filesystem::path& path) {
+		Table table;
+		readLegacyTable(path, table);
+		writeTable(path, table);
+	}
+
+
+	// --- Tables ---
+
+
+	bool isLegacyTableFile(const std::filesystem::path& path) {
+		std::ifstream fin(path, std::ios::binary);
+		char magic[tableMagic.size()];
+		fin.read(magic, sizeof(magic));
+		return size_t(fin.gcount()) != sizeof(magic) || std::string_view(magic, sizeof(magic)) != tableMagic;
+	}
+
+	// Helper which fills an empty (unlogged) table file with the tuples of a table
+	static void fillTable(const std::filesystem::path& path, const Table& table) {
+		TableFile file(path, /*writable*/ true, /*logged*/ false);
+		if(table.layout == Table::Columnar) {
+			// Columnar tables are filled one column at a time, so that each segment's pages are contiguous
+			std::vector<char> bytes;
+			for(size_t c = 0; c < table.columns.size(); c++)
+				for(const Tuple& tuple: table.tuples) {
+					encode(tuple[c], bytes);
+					file.appendValue(c, {bytes.data(), bytes.size()});
+					if(file.pinnedPages() > TableFile::flushThreshold)
+						file.flush();
+				}
+		} else
+			for(const Tuple& tuple: table.tuples) {
+				auto bytes = encode(tuple);
+				file.insert({bytes.data(), bytes.size()});
+				if(file.pinnedPages() > TableFile::flushThreshold)
+					file.flush();
+			}
+		file.header.tupleCount = table.tuples.size();
+		file.flush();
+	}
+
+	void writeTable(const std::filesystem::path& path, const Table& table) {
+		// Build the header page
+		std::vector<char> headerPage(pageSize, 0);
+		std::vector<char> schema;
+		Writer out(schema);
+		encodeSchema(out, table);
+		// Columnar tables also need space for their (initially empty) segments
+		size_t segmentsSize = table.layout == Table::Columnar ? table.columns.size() * sizeof(Segment) : 0;
+		if(sizeof(FileHeader) + schema.size() + segmentsSize > pageSize)
+			throw std::runtime_error("Table schema is too large to fit in a page");
+
+		FileHeader& header = fileHeader(headerPage.data());
+		std::memcpy(header.magic, tableMagic.data(), sizeof(header.magic));
+		header.version = formatVersion;
+		header.pageSize = pageSize;
+		header.pageCount = 1;
+		header.schemaSize = schema.size();
+		header.layout = table.layout;
+		header.modification = newModification();
+		std::memcpy(headerPage.data() + sizeof(FileHeader), schema.data(), schema.size());
+
+		// A shadow being replaced is rewritten in place (it no longer reads any of its pages from its table), any other file is
+		// built in a temporary file which is then renamed over it, so a crash leaves either the old table or the new one
+		Shadow* shadow = findShadow(path);
+		if(shadow) {
+			std::scoped_lock lock(shadowMutex);
+			shadow->rewritten = true;
+			shadow->pages.clear();
+		}
+		auto target = shadow ? path : PagedFile::temporary(path);
+		try {
+			PagedFile::replace(target, headerPage.data(), /*logged*/ false);
+			fillTable(target, table);
+			if(!shadow) PagedFile::rename(target, path);
+		} catch(...) {
+			if(!shadow) std::filesystem::remove(target);
+			throw;
+		}
+	}
+
+	void readTable(const std::filesystem::path& path, Table& table, const std::set<std::string>* columns /*= nullptr*/) {
+		if(isLegacyTableFile(path))
+			return readLegacyTable(path, table);
+
+		TableFile file(path, /*writable*/ false);
+		decodeSchema(file, table);
+		table.tuples.reserve(file.header.tupleCount);
+
+		// Columnar tables start with null tuples, then only the segments of the requested columns are decoded into them
+		if(table.layout == Table::Columnar) {
+			for(size_t i = 0; i < file.header.tupleCount; i++)
+				table.createEmptyTuple();
+
+			for(size_t c = 0; c < table.columns.size(); c++) {
+				if(columns && !columns->count(table.columns[c].name))
+					continue;
+
+				size_t row = 0;
+				file.forEachSegmentPage(c, [&](uint32_t count, Reader in) {
+					if(row + count > table.tuples.size())
+						throw std::runtime_error("Segment has too many values");
+					for(uint32_t i = 0; i < count; i++)
+						decodeData(in, table.tuples[row++][c]);
+				});
+				if(row != table.tuples.size())
+					throw std::runtime_error("Segment has too few values");
+			}
+			return;
+		}
+
+		file.forEachRecord([&](RecordID rid, std::string_view bytes) {
+			Tuple& tuple = table.createEmptyTuple();
+			tuple.rid = rid;
+			Reader in(bytes.data(), bytes.data() + bytes.size());
+			decodeTuple(in, tuple);
+		});
+	}
+
+	void readTuples(const std::filesystem::path& path, Table& table, std::vector<RecordID> rids) {
+		TableFile file(path, /*writable*/ false);
+		decodeSchema(file, table);
+		if(table.layout != Table::Row)
+			throw std::runtime_error("Only row tables can be read by record ID");
+
+		// Read the records in the order they are stored, so each page only needs to be read once
+		std::sort(rids.begin(), rids.end(), [](RecordID a, RecordID b){ return a.page < b.page || (a.page == b.page && a.slot < b.slot); });
+		rids.erase(std::unique(rids.begin(), rids.end(), [](RecordID a, RecordID b){ return a.page == b.page && a.slot == b.slot; }), rids.end());
+		table.tuples.reserve(rids.size());
+		file.forEachRecord(rids, [&](RecordID rid, std::string_view bytes) {
+			Tuple& tuple = table.createEmptyTuple();
+			tuple.rid = rid;
+			Reader in(bytes.data(), bytes.data() + bytes.size());
+			decodeTuple(in, tuple);
+		});
+	}
+
+	void readSchema(const std::filesystem::path& path, Table& table) {
+		// Legacy files have no header, so the whole file needs to be read
+		if(isLegacyTableFile(path)) {
+			readLegacyTable(path, table);
+			table.tuples.clear();
+			return;
+		}
+
+		TableFile file(path, /*writable*/ false);
+		decodeSchema(file, table);
+	}
+
+	void insertTuple(const std::filesystem::path& path, Tuple& tuple) {
+		// Legacy files are upgraded to the current format before they are modified
+		if(isLegacyTableFile(path))
+			upgradeLegacyTable(path);
+
+		TableFile file(path, /*writable*/ true);
+		// Columnar tables append each value to the end of its column's segment
+		if(file.header.layout == Table::Columnar) {
+			std::vector<char> bytes;
+			for(size_t c = 0; c < tuple.size(); c++) {
+				encode(tuple[c], bytes);
+				file.appendValue(c, {bytes.data(), bytes.size()});
+			}
+		} else {
+			auto bytes = encode(tuple);
+			tuple.rid = file.insert({bytes.data(), bytes.size()});
+		}
+		file.header.tupleCount++;
+		file.flush();
+	}
+
+	void updateTuples(const std::filesystem::path& path, Table& table, const std::vector<size_t>& selected) {
+		// Legacy tables don't have pages to update, so they are upgraded by rewriting the (already updated) table
+		// NOTE: Columnar tables are also rewritten, since their values are packed too tightly to be updated in place
+		if(isLegacyTableFile(path) || isColumnarTableFile(path))
+			return writeTable(path, table);
+
+		TableFile file(path, /*writable*/ true);
+		for(size_t i: selected) {
+			Tuple& tuple = table.tuples[i];
+			auto bytes = encode(tuple);
+			if(bytes.size() > maxRecordSize)
+				throw std::runtime_error("Record is too large to fit in a page");
+
+			char* page = file.recordPage(tuple.rid);
+			// If the tuple no longer fits in its page, move it to a page with more space
+			if(!updateRecord(page, tuple.rid.slot, {bytes.data(), bytes.size()})) {
+				eraseRecord(page, tuple.rid.slot);
+				file.syncDirectory(tuple.rid.page);
+				tuple.rid = file.insert({bytes.data(), bytes.size()});
+			} else
+				file.syncDirectory(tuple.rid.page);
+
+			if(file.pinnedPages() > TableFile::flushThreshold)
+				file.flush();
+		}
+		file.flush();
+	}
+
+	void deleteTuples(const std::filesystem::path& path, const Table& table, const std::vector<size_t>& selected) {
+		// Legacy tables don't have pages to delete from, so they are upgraded by rewriting the table without the selected tuples
+		// NOTE: Columnar tables are also rewritten, since deleting a row touches every segment
+		if(isLegacyTableFile(path) || isColumnarTableFile(path)) {
+			Table remaining;
+			remaining.name = table.name;
+			remaining.columns = table.columns;
+			remaining.layout = table.layout;
+			std::set<size_t> removed(selected.begin(), selected.end());
+			for(size_t i = 0; i < table.tuples.size(); i++)
+				if(!removed.count(i))
+					remaining.tuples.push_back(table.tuples[i]);
+			return writeTable(path, remaining);
+		}
+
+		TableFile file(path, /*writable*/ true);
+		for(size_t i: selected) {
+			RecordID rid = table.tuples[i].rid;
+			eraseRecord(file.recordPage(rid), rid.slot);
+			file.syncDirectory(rid.page);
+			if(file.pinnedPages() > TableFile::flushThreshold)
+				file.flush();
+		}
+		file.header.tupleCount -= selected.size();
+		file.flush();
+	}
+
+
+	// --- Shadows ---
+
+
+	// Helper which checks if a file on disk is an index file
+	static bool isIndexFile(const std::filesystem::path& path) {
+		std::ifstream fin(path, std::ios::binary);
+		char magic[indexMagic.size()];
+		fin.read(magic, sizeof(magic));
+		return size_t(fin.gcount()) == sizeof(magic) && std::string_view(magic, sizeof(magic)) == indexMagic;
+	}
+
+	void createShadow(const std::filesystem::path& shadow, const std::filesystem::path& table, bool rewrite /*= false*/) {
+		{
+			std::scoped_lock lock(shadowMutex);
+			shadows[shadow] = {table, {}, rewrite};
+		}
+		if(rewrite) return;
+
+		// Legacy tables don't have pages to share, so their shadows are rewritten in the current format (index files always have pages)
+		if(!isIndexFile(table) && isLegacyTableFile(table)) {
+			Table copy;
+			readLegacyTable(table, copy);
+			return writeTable(shadow, copy);
+		}
+
+		// Otherwise the shadow starts out holding only the table's header page
+		PagedFile original(table, /*writable*/ false);
+		PagedFile::replace(shadow, original.page(0), /*logged*/ false);
+	}
+
+	void commitShadows(const std::vector<std::filesystem::path>& paths) {
+		if(paths.empty()) return;
+		std::vector<std::pair<std::filesystem::path, Shadow>> committing;
+		{
+			std::scoped_lock lock(shadowMutex);
+			for(auto& path: paths) {
+				auto found = shadows.find(path);
+				if(found == shadows.end())
+					throw std::runtime_error("Not a shadow");
+				committing.emplace_back(path, found->second);
+			}
+		}
+
+		// NOTE: If the transaction can't be committed its shadows are still tracked, so the caller can discard them
+		std::optional<WriteAheadLog> log;
+		auto directory = committing.front().second.table.parent_path();
+		std::vector<std::vector<char>> data(committing.size());
+		std::vector<std::vector<LoggedPage>> pages(committing.size());
+		// Read the header and copied pages of each shadow which wasn't rewritten (rewritten shadows are instead synced, so they can be renamed over their tables)
+		for(size_t i = 0; i < committing.size(); i++) {
+			auto& [path, shadow] = committing[i];
+			int fd = open(path.c_str(), O_RDONLY);
+			if(fd < 0)
+				throw std::runtime_error("Failed to open " + path.string());
+			if(shadow.rewritten) {
+				bool synced = fsync(fd) == 0;
+				close(fd);
+				if(!synced)
+					throw std::runtime_error("Failed to sync " + path.string());
+				continue;
+			}
+
+			shadow.pages.insert(0);
+			data[i].resize(shadow.pages.size() * pageSize);
+			for(uint32_t number: shadow.pages) {
+				char* page = data[i].data() + pages[i].size() * pageSize;
+				if(pread(fd, page, pageSize, off_t(number) * pageSize) != pageSize) {
+					close(fd);
+					throw std::runtime_error("Premature end of file");
+				}
+				pages[i].push_back({number, page});
+			}
+			close(fd);
+		}
+
+		// Every shadow is logged as part of one transaction, the transaction is committed (and thus replayed after a crash) only once all of them have been logged
+		// NOTE: The log stays open until the changes have been applied, so it can't be checkpointed while they are half written
+		log.emplace(directory);
+		uint32_t transaction = WriteAheadLog::newTransaction();
+		for(size_t i = 0; i < committing.size(); i++) {
+			auto& [path, shadow] = committing[i];
+			if(shadow.rewritten) log->rename(path, shadow.table, transaction);
+			else log->append(WriteAheadLog::Pages, shadow.table, pages[i], transaction);
+		}
+		log->commit(transaction);
+
+		// Once the transaction has committed the shadows are needed to replay it, so they are no longer tracked (and can't be discarded)
+		{
+			std::scoped_lock lock(shadowMutex);
+			for(auto& [path, shadow]: committing)
+				shadows.erase(path);
+		}
+
+		// Then apply the changes, rewritten shadows replace their tables while the rest have their pages written over their table's
+		auto& pool = BufferPool::global();
+		std::vector<std::unique_ptr<VersionStore>> versions;
+		for(size_t i = 0; i < committing.size(); i++) {
+			auto& [path, shadow] = committing[i];
+			pool.invalidate(BufferPool::key(path));
+			if(exists(shadow.table))
+				pool.invalidate(BufferPool::key(shadow.table));
+			if(shadow.rewritten) continue;
+
+			// Snapshots of the table still need to read what the pages held before
+			auto& store = versions.emplace_back(std::make_unique<VersionStore>(shadow.table));
+			std::vector<uint32_t> numbers;
+			for(auto& page: pages[i])
+				numbers.push_back(page.number);
+			store->preserve(numbers);
+
+			int fd = open(shadow.table.c_str(), O_WRONLY);
+			if(fd < 0)
+				throw std::runtime_error("Failed to open " + shadow.table.string());
+			for(auto& page: pages[i])
+				if(pwrite(fd, page.data, pageSize, off_t(page.number) * pageSize) != pageSize) {
+					close(fd);
+					throw std::runtime_error("Failed to write " + shadow.table.string());
+				}
+			close(fd);
+		}
+
+		// Every table's new version is published (and every rewritten table replaced) at once, so readers never see only some of them changed
+		{
+			PublishLock publishing(directory, /*exclusive*/ true);
+			for(auto& [path, shadow]: committing)
+				if(shadow.rewritten)
+					std::filesystem::rename(path, shadow.table);
+			for(auto& store: versions)
+				store->publish();
+		}
+		for(auto& [path, shadow]: committing) {
+			if(!shadow.rewritten) std::filesystem::remove(path);
+			VersionStore::remove(path);
+		}
+		WriteAheadLog::syncDirectory(directory);
+	}
+
+	void discardShadow(const std::filesystem::path& path) {
+		{
+			std::scoped_lock lock(shadowMutex);
+			if(!shadows.erase(path)) return;
+		}
+		if(exists(path)) {
+			BufferPool::global().invalidate(BufferPool::key(path));
+			std::filesystem::remove(path);
+		}
+		VersionStore::remove(path);
+	}
+
+	bool isRewrittenShadow(const std::filesystem::path& path) {
+		std::scoped_lock lock(shadowMutex);
+		auto shadow = shadows.find(path);
+		return shadow != shadows.end() && shadow->second.rewritten;
+	}
+
+
+	// --- Mapped Tables ---
+
+
+	MappedTable::MappedTable(const std::filesystem::path& path, const std::set<std::string>* columns /*= nullptr*/) {
+		if(isLegacyTableFile(path))
+			throw std::runtime_error("Legacy table files can't be mapped");
+
+		// NOTE: The file the snapshot has open is mapped (which may have since been replaced)
+		snapshot = takeSnapshot(path);
+		fd = dup(snapshot->descriptor());
+		if(fd < 0)
+			throw std::runtime_error("Failed to open table file");
+
+		// NOTE: The destructor doesn't run if the constructor throws, so the descriptor (and mapping) are released before rethrowing
+		try {
+			struct stat info;
+			if(fstat(fd, &info) != 0)
+				throw std::runtime_error("Failed to read table file");
+			size = info.st_size;
+			if(size < pageSize)
+				throw std::runtime_error("Premature end of table file");
+			void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+			if(map == MAP_FAILED)
+				throw std::runtime_error("Failed to map table file");
+			mapping = (const char*) map;
+			// Tuples are read sequentially
+			madvise(map, size, MADV_SEQUENTIAL);
+
+			PageCopy headerCopy;
+			std::memcpy(headerCopy.data.get(), mapping, pageSize);
+			snapshot->restore(0, headerCopy.data.get());
+			std::memcpy(&header, headerCopy.data.get(), sizeof(FileHeader));
+			if(header.version != formatVersion || header.pageSize != pageSize)
+				throw std::runtime_error("Unsupported table file version");
+			if(size_t(header.pageCount) * pageSize > size)
+				throw std::runtime_error("Premature end of table file");
+			decodeSchema(header, headerCopy.data.get(), table);
+			current.resize(table.columns.size());
+
+			// Row tables walk the directory, while columnar tables walk the segments of the requested columns
+			directory = header.firstDirectoryPage;
+			if(table.layout == Table::Columnar) {
+				const Segment* segments = reinterpret_cast<const Segment*>(headerCopy.data.get() + sizeof(FileHeader) + header.schemaSize);
+				for(size_t c = 0; c < table.columns.size(); c++)
+					if(!columns || columns->count(table.columns[c].name))
+						cursors.push_back({c, segments[c].firstPage, 0, {nullptr, nullptr}, {}});
+			}
+		} catch(...) {
+			if(mapping) munmap((void*) mapping, size);
+			close(fd);
+			throw;
+		}
+	}
+
+	MappedTable::~MappedTable() {
+		if(mapping) munmap((void*) mapping, size);
+		if(fd >= 0) close(fd);
+	}
+
+	char* MappedTable::page(uint32_t number, PageCopy& copy) {
+		if(number == noPage || number >= header.pageCount)
+			throw std::runtime_error("Page out of bounds");
+		if(copy.number != number) {
+			std::memcpy(copy.data.get(), mapping + size_t(number) * pageSize, pageSize);
+			snapshot->restore(number, copy.data.get());
+			copy.number = number;
+		}
+		return copy.data.get();
+	}
+
+	bool MappedTable::next() {
+		if(table.layout == Table::Columnar) {
+			if(read == header.tupleCount)
+				return false;
+
+			for(Cursor& cursor: cursors) {
+				// Move to the next page in the segment once the current one has been exhausted
+				while(cursor.remaining == 0) {
+					if(cursor.page == noPage)
+						throw std::runtime_error("Segment has too few values");
+					char* data = page(cursor.page, cursor.copy);
+					auto& header = segmentHeader(data);
+					if(sizeof(SegmentPageHeader) + header.length > pageSize)
+						throw std::runtime_error("Segment page is corrupted");
+					cursor.remaining = header.valueCount;
+					cursor.in = {data + sizeof(SegmentPageHeader), data + sizeof(SegmentPageHeader) + header.length};
+					cursor.page = header.next;
+				}
+
+				decodeData(cursor.in, table.columns[cursor.column], current[cursor.column]);
+				cursor.remaining--;
+			}
+			read++;
+			return true;
+		}
+
+		while(true) {
+			// Decode the next record in the current data page
+			if(dataPage != noPage) {
+				char* data = page(dataPage, dataCopy);
+				while(slot < pageHeader(data).slotCount) {
+					Slot& s = slots(data)[slot++];
+					if(s.length == 0) continue;
+					if(size_t(s.offset) + s.length > pageSize)
+						throw std::runtime_error("Record is corrupted");
+
+					Reader in(data + s.offset, data + s.offset + s.length);
+					uint64_t count;
+					in >> count;
+					if(count != current.size())
+						throw std::runtime_error("Tuple doesn't match the table's schema");
+					for(size_t c = 0; c < current.size(); c++)
+						decodeData(in, table.columns[c], current[c]);
+					return true;
+				}
+				dataPage = noPage;
+			}
+
+			// Then move onto the next data page in the directory
+			if(directory == noPage)
+				return false;
+			char* entries = page(directory, directoryCopy);
+			if(entry < directoryHeader(entries).entryCount && entry < directoryEntriesPerPage) {
+				dataPage = directoryEntries(entries)[entry++].page;
+				slot = 0;
+			} else {
+				directory = directoryHeader(entries).next;
+				entry = 0;
+			}
+		}
+	}
+
+} // sql::storage
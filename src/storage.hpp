@@ -0,0 +1,350 @@
+/*------------------------------------------------------------
+ * Filename: storage.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides the on disk table file format. Table files are split into fixed size pages: a header page
+ * 				(holding the schema), directory pages (listing the data pages and their free space, so inserts can
+ * 				reuse the space freed by deleted tuples), and slotted data pages (holding the tuples), so that
+ * 				modifications only need to rewrite the pages they touch.
+ * 				Columnar tables instead store each column in its own chain of segment pages, so that readers
+ * 				only need to decode the columns they reference. Pages other than the header page are accessed
+ * 				through the buffer pool, alternatively read only queries can map the whole file into memory.
+ * 				Transactions modify copy-on-write shadows of table files, which only hold the pages the transaction
+ * 				has modified (the rest are read from the table) until they are committed.
+ *------------------------------------------------------------*/
+
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "SQL.hpp"
+#include "bufferpool.hpp"
+
+namespace sql::storage {
+
+	// Magic bytes identifying a table file (files without them are in the legacy SimpleBinStream format)
+	constexpr std::string_view tableMagic = "SQLTABLE";
+	// Version of the table file format
+	constexpr uint32_t formatVersion = 3;
+	// Size of a page in a table file
+	constexpr size_t pageSize = BufferPool::pageSize;
+	// Page number used to indicate that there is no page
+	constexpr uint32_t noPage = 0;
+
+	// Header found at the very start of the header page (page 0) of every table file, the schema immediately follows it
+	struct FileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t pageSize;
+		// The number of tuples stored in the file
+		uint64_t tupleCount;
+		// The number of pages in the file
+		uint32_t pageCount;
+		// The first and last directory pages
+		uint32_t firstDirectoryPage;
+		uint32_t lastDirectoryPage;
+		// The most recently allocated data page (new tuples are inserted here)
+		uint32_t lastDataPage;
+		// Size of the schema which immediately follows the header
+		uint32_t schemaSize;
+		// How the tuples are laid out (Table::Layout), columnar tables store an array of segments (one per column) after the schema
+		uint32_t layout;
+		// Random value regenerated every time the file is modified (used to detect when cached pages are out of date)
+		uint64_t modification;
+	};
+
+	// Header found at the start of every directory page, an array of entries (one per data page) follows it
+	struct DirectoryHeader {
+		// The next directory page in the chain
+		uint32_t next;
+		// The number of entries stored in this page
+		uint32_t entryCount;
+	};
+	// Entry in a directory page describing a data page
+	struct DirectoryEntry {
+		uint32_t page;
+		// The number of bytes that could be made available in the page
+		uint16_t freeSpace;
+		uint16_t reserved;
+	};
+	// The number of entries which fit in a directory page
+	constexpr size_t directoryEntriesPerPage = (pageSize - sizeof(DirectoryHeader)) / sizeof(DirectoryEntry);
+
+	// Header found at the start of every data page, the slot array follows it and the records are packed against the end of the page
+	struct PageHeader {
+		// The location of this page's entry in the directory
+		uint32_t directoryPage;
+		uint16_t directoryEntry;
+		// The number of slots in the slot array
+		uint16_t slotCount;
+		// Start of the record area
+		uint16_t recordStart;
+		// Bytes held by deleted or shrunken records (reclaimed when the page is compacted)
+		uint16_t fragmented;
+		uint32_t reserved;
+	};
+	// Slot describing where a record is stored in a data page (records with a length of 0 have been deleted)
+	struct Slot {
+		uint16_t offset;
+		uint16_t length;
+	};
+	// The largest encoded tuple that can be stored in a data page
+	constexpr size_t maxRecordSize = pageSize - sizeof(PageHeader) - sizeof(Slot);
+
+	// Entry (stored in the header page after the schema) locating the chain of pages storing a column of a columnar table
+	struct Segment {
+		uint32_t firstPage;
+		uint32_t lastPage;
+	};
+	// Header found at the start of every segment page, the column's encoded values are packed after it
+	struct SegmentPageHeader {
+		// The next page in the column's segment
+		uint32_t next;
+		// The number of values stored in this page
+		uint32_t valueCount;
+		// The number of bytes of values stored in this page
+		uint32_t length;
+		uint32_t reserved;
+	};
+
+	// Class which encodes values into a byte buffer (strings are length prefixed, everything else is stored raw)
+	struct Writer {
+		std::vector<char>& buffer;
+
+		Writer(std::vector<char>& buffer): buffer(buffer) {}
+
+		// Append raw bytes to the buffer
+		void write(const void* data, size_t size) {
+			const char* bytes = (const char*) data;
+			buffer.insert(buffer.end(), bytes, bytes + size);
+		}
+
+		template<typename T>
+		Writer& operator<<(const T& value) {
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be written raw");
+			write(&value, sizeof(T));
+			return *this;
+		}
+		Writer& operator<<(std::string_view str) {
+			*this << uint32_t(str.size());
+			write(str.data(), str.size());
+			return *this;
+		}
+		Writer& operator<<(const std::string& str) { return *this << std::string_view(str); }
+	};
+
+	// Class which decodes values from a byte buffer (throws if the buffer ends prematurely)
+	struct Reader {
+		const char* current;
+		const char* end;
+
+		Reader(const char* begin, const char* end): current(begin), end(end) {}
+		Reader(const std::vector<char>& buffer): current(buffer.data()), end(buffer.data() + buffer.size()) {}
+
+		// Number of bytes left to read
+		size_t remaining() const { return end - current; }
+
+		// Copy raw bytes out of the buffer
+		void read(void* data, size_t size) {
+			if(remaining() < size)
+				throw std::runtime_error("Premature end of table data");
+			std::memcpy(data, current, size);
+			current += size;
+		}
+
+		template<typename T>
+		Reader& operator>>(T& value) {
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read raw");
+			read(&value, sizeof(T));
+			return *this;
+		}
+		Reader& operator>>(std::string& str) {
+			std::string_view view;
+			*this >> view;
+			str = view;
+			return *this;
+		}
+		// NOTE: The view points into the buffer being read
+		Reader& operator>>(std::string_view& str) {
+			uint32_t size;
+			*this >> size;
+			if(remaining() < size)
+				throw std::runtime_error("Premature end of table data");
+			str = {current, size};
+			current += size;
+			return *this;
+		}
+	};
+
+	// View of a piece of data (strings point into the buffer the data was decoded from, rather than being copied)
+	// NOTE: The alternatives are in the same order as Data::Variant, so views compare the same way as the data they view
+	using DataView = std::variant<std::monostate, bool, int64_t, double, std::string_view>;
+	// Function which creates a view of a piece of data
+	inline DataView view(const Data::Variant& data) {
+		return std::visit([](const auto& value) -> DataView { return value; }, data);
+	}
+
+	// Functions which de/encode the pieces of a table
+	void encodeData(Writer& out, const Data& data);
+	void decodeData(Reader& in, Data& data);
+	void decodeData(Reader& in, const Column& column, DataView& data);
+	void encodeTuple(Writer& out, const Tuple& tuple);
+	void decodeTuple(Reader& in, Tuple& tuple);
+	void encodeSchema(Writer& out, const Table& table);
+	void decodeSchema(Reader& in, Table& table);
+
+	// Function which calculates the size of a tuple once it has been encoded
+	size_t encodedSize(const Tuple& tuple);
+	// Function which checks if a tuple is small enough to be stored in a data page
+	inline bool fitsInPage(const Tuple& tuple) { return encodedSize(tuple) <= maxRecordSize; }
+
+	// Function which generates a new (random) modification marker for a file
+	uint64_t newModification();
+
+	// Function which checks if a file on disk is a table file written in the legacy (whole file SimpleBinStream) format
+	bool isLegacyTableFile(const std::filesystem::path& path);
+
+	// Function which writes a whole table (schema and tuples) to disk, replacing the file
+	void writeTable(const std::filesystem::path& path, const Table& table);
+	// Function which reads a whole table (schema and tuples) from disk (throws std::runtime_error if the file is corrupted)
+	// NOTE: If a set of column names is provided, columnar tables only decode those columns (the rest are left null)
+	// NOTE: The record IDs of the loaded (row) tuples are set so they can later be updated or deleted in place
+	void readTable(const std::filesystem::path& path, Table& table, const std::set<std::string>* columns = nullptr);
+	// Function which reads a table's schema and only the tuples stored at the provided record IDs (throws std::runtime_error if any of the records don't exist)
+	// NOTE: Only row tables can be read this way, the tuples are loaded in the order they are stored rather than the order of the record IDs
+	void readTuples(const std::filesystem::path& path, Table& table, std::vector<RecordID> rids);
+	// Function which only reads a table's schema from disk, leaving its tuples empty
+	void readSchema(const std::filesystem::path& path, Table& table);
+
+	// Function which inserts a single tuple into a table file, only the pages it touches are rewritten (the tuple's record ID is updated)
+	// NOTE: The tuple is expected to have already been validated against the table's schema
+	void insertTuple(const std::filesystem::path& path, Tuple& tuple);
+	// Function which rewrites the selected (previously loaded) tuples of a table in place, tuples which no longer fit in their page are moved
+	// NOTE: Columnar tables are instead rewritten in full
+	void updateTuples(const std::filesystem::path& path, Table& table, const std::vector<size_t>& selected);
+	// Function which removes the selected (previously loaded) tuples of a table from its file
+	// NOTE: Columnar tables are instead rewritten in full
+	void deleteTuples(const std::filesystem::path& path, const Table& table, const std::vector<size_t>& selected);
+
+	// Function which creates a copy-on-write shadow of a table, the shadow can be read and modified like any other table file but only
+	// the pages which are modified are copied into it (they are stored at the same offsets, so the shadow is a sparse file)
+	// NOTE: If <rewrite> is true the shadow doesn't copy anything (the table doesn't even need to exist), it must be filled with writeTable
+	// NOTE: Shadows are tracked by the process that created them and aren't recorded in the write-ahead log, they don't survive the process
+	void createShadow(const std::filesystem::path& shadow, const std::filesystem::path& table, bool rewrite = false);
+	// Function which replaces several tables (in the same database) with their shadows then removes the shadows, the shadows are committed
+	// as one transaction in the write-ahead log so a crash leaves either all of the tables or none of them changed (and their new versions are
+	// published at once, see PublishLock). Only a shadow's pages are written unless it was rewritten, in which case it is renamed over its table
+	// NOTE: If the transaction fails before it is committed, the shadows are left in place and should be discarded by the caller
+	void commitShadows(const std::vector<std::filesystem::path>& shadows);
+	// Function which removes a shadow, leaving its table unchanged (shadows which have already been committed are left alone)
+	void discardShadow(const std::filesystem::path& shadow);
+	// Function which checks if a shadow was rewritten (rather than only holding the pages which were modified)
+	bool isRewrittenShadow(const std::filesystem::path& shadow);
+
+	// Struct tracking a copy-on-write shadow (defined in storage.cpp)
+	struct Shadow;
+
+	// Class which provides page level access to a file which may be a copy-on-write shadow, the pages are held in the buffer pool (pinned until the file is flushed)
+	// NOTE: If the file is a shadow, pages which haven't been copied into it are read from the file it is a copy of (and copied into the shadow once they are modified)
+	class ShadowedFile {
+		Shadow* shadow;
+		PagedFile file;
+		// The file a shadow is a copy of (unless the shadow was rewritten), and the pages copied into the shadow since it was last flushed
+		std::optional<PagedFile> original;
+		std::set<uint32_t> copied;
+
+		// Check if a page should be read from the file a shadow is a copy of (rather than from the shadow)
+		bool inOriginal(uint32_t number) const;
+
+	public:
+		// NOTE: Shadows (and files opened with <logged> false) aren't recorded in the write-ahead log, shadows are only logged once they are committed
+		ShadowedFile(const std::filesystem::path& path, bool writable, bool logged = true);
+
+		// The header page of the file a shadow is a copy of (null unless the file is a shadow which still reads pages from it)
+		char* originalHeader() { return original ? original->page(0) : nullptr; }
+		// Start caching the pages of the file (and of the file a shadow is a copy of), any pages cached from a different version are discarded
+		void attach(uint64_t version, uint64_t originalVersion = 0);
+
+		// Get a page (pinning it in the buffer pool until the file is flushed)
+		char* page(uint32_t number);
+		// Pin a page only until the returned handle is destroyed
+		BufferPool::Page fetch(uint32_t number) { return inOriginal(number) ? original->fetch(number) : file.fetch(number); }
+		// Pin a new zeroed page
+		char* create(uint32_t number);
+		// Mark a page as needing to be written back to disk
+		void markDirty(uint32_t number) { file.markDirty(number); }
+		// The number of pages currently pinned by this file
+		size_t pinnedPages() { return file.pinnedPages(); }
+
+		// Write all of the modified pages back to disk (recording the version of the file they now represent), and unpin all of the pages
+		void flush(uint64_t version);
+	};
+
+	// Class which memory maps a table file so that its tuples can be iterated without copying any of their data (each page is copied out of the
+	// mapping once, so it can be checked against the snapshot the table is read through)
+	// NOTE: The file is read directly, so any changes to it must have been flushed from the buffer pool
+	class MappedTable {
+		int fd = -1;
+		const char* mapping = nullptr;
+		size_t size = 0;
+		FileHeader header;
+		std::shared_ptr<Snapshot> snapshot;
+
+		// Copy of one of the pages currently being read
+		struct PageCopy {
+			uint32_t number = noPage;
+			std::unique_ptr<char[]> data = std::make_unique<char[]>(pageSize);
+		};
+
+		// Position in the directory, and copies of the current directory and data pages (row tables)
+		uint32_t directory = noPage, entry = 0, dataPage = noPage;
+		uint16_t slot = 0;
+		PageCopy directoryCopy, dataCopy;
+		// Position in each of the requested columns' segments (columnar tables)
+		struct Cursor {
+			size_t column;
+			uint32_t page;
+			uint32_t remaining;
+			Reader in;
+			PageCopy copy;
+		};
+		std::vector<Cursor> cursors;
+		uint64_t read = 0;
+
+		// Get a page of the mapping as it was when the snapshot was taken (ensuring it exists), the page is copied into <copy> unless it is already there
+		char* page(uint32_t number, PageCopy& copy);
+
+	public:
+		// The table's schema (its tuples are never loaded)
+		Table table;
+		// Views of the current tuple's data, only valid until the next tuple is read
+		std::vector<DataView> current;
+
+		// Map a table file (throws std::runtime_error if the file can't be mapped or is corrupted)
+		// NOTE: The table is read through the snapshot of it in the current thread's snapshot set (or a new snapshot if there isn't a set)
+		// NOTE: If a set of column names is provided, columnar tables only decode those columns (the rest are left null)
+		MappedTable(const std::filesystem::path& path, const std::set<std::string>* columns = nullptr);
+		MappedTable(const MappedTable&) = delete;
+		~MappedTable();
+
+		// Advance to the next tuple, returns false once every tuple has been read
+		bool next();
+	};
+
+} // sql::storage
+
+#endif // STORAGE_HPP
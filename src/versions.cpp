@@ -0,0 +1,302 @@
+/*------------------------------------------------------------
+ * Filename: versions.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the saving of overwritten pages in version stores, and the reading of files through snapshots.
+ *------------------------------------------------------------*/
+
+#include "versions.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include "bufferpool.hpp"
+
+namespace sql::storage {
+
+	constexpr size_t pageSize = BufferPool::pageSize;
+
+	// Header found at the start of every version store
+	struct StoreHeader {
+		char magic[8];
+		// The file the store's version belongs to
+		uint64_t device, inode;
+		// The most recently published version of the file
+		uint64_t version;
+	};
+	constexpr std::string_view storeMagic = "SQLVERSN";
+
+	// Header found before each saved page in a version store (the page's contents follow it)
+	struct SavedPage {
+		uint64_t device, inode;
+		// The version of the file which overwrote the page
+		uint64_t version;
+		uint32_t number;
+		uint32_t reserved;
+	};
+	constexpr size_t savedPageSize = sizeof(SavedPage) + pageSize;
+
+	thread_local SnapshotSet* SnapshotSet::activeSet = nullptr;
+
+
+	// --- Version Stores ---
+
+
+	VersionStore::VersionStore(const std::filesystem::path& file): path(storePath(file)) {
+		this->file = open(file.c_str(), O_RDONLY);
+		if(this->file < 0)
+			throw std::runtime_error("Failed to open " + file.string());
+		struct stat info;
+		fstat(this->file, &info);
+		device = info.st_dev;
+		inode = info.st_ino;
+
+		fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if(fd < 0) {
+			close(this->file);
+			throw std::runtime_error("Failed to open " + path.string());
+		}
+		fstat(fd, &info);
+		end = info.st_size;
+
+		// If the store belongs to a different file (or is new), the file's versions start over
+		StoreHeader header;
+		if(pread(fd, &header, sizeof(header), 0) == sizeof(header) && std::string_view(header.magic, sizeof(header.magic)) == storeMagic
+		  && header.device == device && header.inode == inode)
+			version = header.version;
+		else {
+			std::memcpy(header.magic, storeMagic.data(), sizeof(header.magic));
+			header.device = device;
+			header.inode = inode;
+			header.version = version = 0;
+			if(pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+				close(fd);
+				close(this->file);
+				throw std::runtime_error("Failed to write " + path.string());
+			}
+			end = std::max<uint64_t>(end, sizeof(header));
+		}
+	}
+
+	VersionStore::~VersionStore() {
+		close(fd);
+		close(file);
+	}
+
+	void VersionStore::preserve(const std::vector<uint32_t>& pages) {
+		// Every page is saved with a single write, stamped with the version which is about to overwrite it
+		std::vector<char> records;
+		for(uint32_t number: pages) {
+			if(saved.count(number)) continue;
+			size_t offset = records.size();
+			records.resize(offset + savedPageSize);
+			SavedPage record{device, inode, version + 1, number, 0};
+			std::memcpy(records.data() + offset, &record, sizeof(record));
+			// Pages which don't exist yet can't be read by any snapshot
+			if(pread(file, records.data() + offset + sizeof(SavedPage), pageSize, off_t(number) * pageSize) != pageSize) {
+				records.resize(offset);
+				continue;
+			}
+			saved.insert(number);
+		}
+		if(records.empty()) return;
+
+		if(pwrite(fd, records.data(), records.size(), end) != ssize_t(records.size()))
+			throw std::runtime_error("Failed to write " + path.string());
+		end += records.size();
+	}
+
+	void VersionStore::publish() {
+		if(saved.empty()) return;
+		saved.clear();
+
+		// NOTE: Errors are ignored, if the version isn't published the next writer saves its pages under the same version (which snapshots read the first of)
+		version++;
+		pwrite(fd, &version, sizeof(version), offsetof(StoreHeader, version));
+
+		// If no snapshots are being read, none of the saved pages will ever be read
+		if(end > sizeof(StoreHeader) && flock(fd, LOCK_EX | LOCK_NB) == 0) {
+			if(ftruncate(fd, sizeof(StoreHeader)) == 0)
+				end = sizeof(StoreHeader);
+			flock(fd, LOCK_UN);
+		}
+	}
+
+	std::filesystem::path VersionStore::storePath(const std::filesystem::path& file) {
+		return file.string() + std::string(extension);
+	}
+
+	void VersionStore::remove(const std::filesystem::path& file) {
+		std::error_code ignored;
+		std::filesystem::remove(storePath(file), ignored);
+	}
+
+	void VersionStore::recover(const std::filesystem::path& directory) {
+		for(auto& entry: std::filesystem::directory_iterator(directory)) {
+			if(entry.path().extension() != extension) continue;
+			int fd = open(entry.path().c_str(), O_RDWR);
+			if(fd < 0) continue;
+
+			// Find the newest version any page was saved for, if it was never published the writer which saved it crashed
+			StoreHeader header;
+			if(pread(fd, &header, sizeof(header), 0) == sizeof(header) && std::string_view(header.magic, sizeof(header.magic)) == storeMagic) {
+				uint64_t newest = header.version;
+				SavedPage record;
+				for(off_t offset = sizeof(StoreHeader); pread(fd, &record, sizeof(record), offset) == sizeof(record); offset += savedPageSize)
+					if(record.device == header.device && record.inode == header.inode)
+						newest = std::max(newest, record.version);
+
+				// NOTE: Errors are ignored, the worst that can happen is that snapshots taken later read some of the crashed writer's pages as they were before it
+				if(newest > header.version)
+					pwrite(fd, &newest, sizeof(newest), offsetof(StoreHeader, version));
+			}
+			close(fd);
+		}
+	}
+
+
+	// --- Publish Locks ---
+
+
+	PublishLock::PublishLock(const std::filesystem::path& directory, bool exclusive) {
+		fd = open((directory / fileName).c_str(), O_RDWR | O_CREAT, 0644);
+		if(fd >= 0 && flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	PublishLock::~PublishLock() {
+		if(fd >= 0) close(fd);
+	}
+
+
+	// --- Snapshots ---
+
+
+	Snapshot::Snapshot(const std::filesystem::path& file): path(file) {
+		fd = open(file.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw std::runtime_error("Failed to open " + file.string());
+		struct stat info;
+		fstat(fd, &info);
+		device = info.st_dev;
+		inode = info.st_ino;
+
+		// NOTE: If the store can't be opened (or locked) the file is read directly
+		store = open(VersionStore::storePath(file).c_str(), O_RDWR | O_CREAT, 0644);
+		if(store >= 0 && flock(store, LOCK_SH) != 0) {
+			close(store);
+			store = -1;
+		}
+
+		// If the store belongs to a different file, this file hasn't been modified since it was created (or has been replaced and will never be modified again)
+		StoreHeader header;
+		if(store >= 0 && pread(store, &header, sizeof(header), 0) == sizeof(header) && std::string_view(header.magic, sizeof(header.magic)) == storeMagic
+		  && header.device == device && header.inode == inode)
+			version = header.version;
+		// NOTE: Pages saved by a writer which is still writing the next version are needed, so the whole store is scanned
+		scanned = sizeof(StoreHeader);
+	}
+
+	Snapshot::~Snapshot() {
+		if(store >= 0) close(store);
+		close(fd);
+	}
+
+	void Snapshot::refresh() {
+		if(store < 0) return;
+		struct stat info;
+		if(fstat(store, &info) != 0) return;
+
+		// The first page saved (by a version newer than the snapshot) is the page as it was when the snapshot was taken
+		SavedPage record;
+		for(; scanned + savedPageSize <= uint64_t(info.st_size); scanned += savedPageSize) {
+			if(pread(store, &record, sizeof(record), scanned) != sizeof(record)) break;
+			if(record.device == device && record.inode == inode && record.version > version && !saved.count(record.number))
+				saved[record.number] = scanned + sizeof(SavedPage);
+		}
+	}
+
+	bool Snapshot::current() {
+		struct stat info;
+		if(stat(path.c_str(), &info) != 0 || uint64_t(info.st_dev) != device || uint64_t(info.st_ino) != inode)
+			return false;
+		if(store < 0) return true;
+
+		StoreHeader header;
+		if(pread(store, &header, sizeof(header), 0) != sizeof(header) || header.device != device || header.inode != inode)
+			return version == 0;
+		return header.version == version;
+	}
+
+	bool Snapshot::restore(uint32_t number, char* page) {
+		std::scoped_lock lock(mutex);
+		refresh();
+		auto found = saved.find(number);
+		if(found == saved.end()) return false;
+
+		if(pread(store, page, pageSize, found->second) != pageSize)
+			throw std::runtime_error("Failed to read " + VersionStore::storePath(path).string());
+		return true;
+	}
+
+	bool Snapshot::overwritten(uint32_t number) {
+		std::scoped_lock lock(mutex);
+		refresh();
+		return saved.count(number);
+	}
+
+	bool Snapshot::read(uint32_t number, char* page) {
+		bool complete = pread(fd, page, pageSize, off_t(number) * pageSize) == pageSize;
+		bool restored = restore(number, page);
+		if(!restored && !complete)
+			throw std::runtime_error("Premature end of file");
+		return restored;
+	}
+
+
+	// --- Snapshot Sets ---
+
+
+	std::shared_ptr<Snapshot> SnapshotSet::get(const std::filesystem::path& file) {
+		std::scoped_lock lock(mutex);
+		auto& snapshot = snapshots[file];
+		if(!snapshot) {
+			try {
+				snapshot = std::make_shared<Snapshot>(file);
+			} catch(std::runtime_error&) {
+				snapshots.erase(file);
+				throw;
+			}
+		}
+		return snapshot;
+	}
+
+	bool SnapshotSet::current(const std::filesystem::path& file) {
+		std::shared_ptr<Snapshot> snapshot;
+		{
+			std::scoped_lock lock(mutex);
+			auto found = snapshots.find(file);
+			if(found == snapshots.end()) return true;
+			snapshot = found->second;
+		}
+		return snapshot->current();
+	}
+
+	std::shared_ptr<Snapshot> takeSnapshot(const std::filesystem::path& file) {
+		if(SnapshotSet* set = SnapshotSet::active())
+			return set->get(file);
+		return std::make_shared<Snapshot>(file);
+	}
+
+} // sql::storage
@@ -0,0 +1,155 @@
+/*------------------------------------------------------------
+ * Filename: versions.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides multi-version reads of table and index files. Before a writer overwrites any of a file's pages it
+ * 				saves their current contents (stamped with the version of the file which is about to replace them) in the
+ * 				file's version store, then publishes the new version once all of its pages have been written. Readers take
+ * 				a snapshot of the version which was published when they started, and whenever they read a page which has
+ * 				since been overwritten they read its saved contents instead, so readers never wait on (or see part of) a
+ * 				writer's changes. Saved pages are discarded once no snapshot is left which could read them. Commits which
+ * 				change several files (such as a table and its indexes) publish them all at once under the directory's publish
+ * 				lock, so readers which take their snapshots under it never see only some of the files changed.
+ *------------------------------------------------------------*/
+
+#ifndef VERSIONS_HPP
+#define VERSIONS_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string_view>
+#include <vector>
+
+namespace sql::storage {
+
+	// Class which saves the pages of a file a writer is about to overwrite, then publishes the file's new version once they have been written
+	// NOTE: Only one writer should modify a file at a time
+	class VersionStore {
+		int fd = -1, file = -1;
+		std::filesystem::path path;
+		// The device and inode of the file (a new file created at the same path starts its versions over)
+		uint64_t device, inode;
+		// The version currently published, and the end of the store
+		uint64_t version;
+		uint64_t end;
+		// The pages saved for the next version
+		std::set<uint32_t> saved;
+
+	public:
+		// Extension added to a file's path to get the path of its version store
+		static constexpr std::string_view extension = ".versions";
+
+		// Open (creating if nessicary) the version store of a file
+		explicit VersionStore(const std::filesystem::path& file);
+		VersionStore(const VersionStore&) = delete;
+		~VersionStore();
+
+		// Save the current contents of some of the file's pages before they are overwritten by the next version (pages which have already been saved, or are past the end of the file, are skipped)
+		void preserve(const std::vector<uint32_t>& pages);
+		// Publish the next version once all of its pages have been written, the saved pages are discarded if there aren't any snapshots which could read them
+		// NOTE: Does nothing if no pages were saved
+		void publish();
+
+		// Get the path of a file's version store
+		static std::filesystem::path storePath(const std::filesystem::path& file);
+		// Remove a file's version store (once the file itself has been removed)
+		static void remove(const std::filesystem::path& file);
+		// Publish the versions left unpublished by writers which crashed (once the write-ahead log has replayed their changes, snapshots taken afterwards shouldn't read the pages they saved)
+		// NOTE: The stores are left in place, since snapshots (in other processes) may still be reading them
+		static void recover(const std::filesystem::path& directory);
+	};
+
+	// Class which locks a directory's publish lock until it is destroyed, a writer publishing the new versions of several files at once holds it exclusively
+	// while readers which need to see those files as they were at the same time hold it (shared) while they take their snapshots
+	// NOTE: If the lock file can't be opened (or locked) nothing is locked
+	class PublishLock {
+		int fd = -1;
+
+	public:
+		// Name of the lock file within the directory
+		static constexpr std::string_view fileName = "versions.publish";
+
+		PublishLock(const std::filesystem::path& directory, bool exclusive);
+		PublishLock(const PublishLock&) = delete;
+		~PublishLock();
+	};
+
+	// Class representing a snapshot of a file, pages read through the snapshot are read as they were when it was taken
+	// NOTE: The snapshot keeps the file open, so even if the file is replaced (renamed over) the snapshot still reads the original file
+	class Snapshot {
+		int fd = -1, store = -1;
+		std::filesystem::path path;
+		uint64_t device, inode;
+		// The version of the file which was published when the snapshot was taken
+		uint64_t version = 0;
+		// Where the saved contents of each of the pages overwritten since the snapshot was taken are found in the store, and how much of the store has been scanned
+		std::mutex mutex;
+		std::map<uint32_t, uint64_t> saved;
+		uint64_t scanned;
+
+		// Find the pages saved since the store was last scanned
+		void refresh();
+
+	public:
+		// Take a snapshot of a file (throws std::runtime_error if the file can't be opened)
+		// NOTE: The file's version store is share locked while the snapshot exists, so the pages it could read aren't discarded
+		explicit Snapshot(const std::filesystem::path& file);
+		Snapshot(const Snapshot&) = delete;
+		~Snapshot();
+
+		// The (open) file the snapshot reads
+		int descriptor() const { return fd; }
+		const std::filesystem::path& getPath() const { return path; }
+
+		// Check if the file hasn't been modified (or replaced) since the snapshot was taken
+		bool current();
+		// Replace a page which was just read from the file with its contents when the snapshot was taken (if it has been overwritten since), returns true if it was replaced
+		// NOTE: The page must be read before it is restored, a writer saves a page before overwriting it so any change the read saw will be found
+		bool restore(uint32_t number, char* page);
+		// Check if a page has been overwritten since the snapshot was taken
+		bool overwritten(uint32_t number);
+		// Read a page of the file as it was when the snapshot was taken, returns true if the page has since been overwritten
+		bool read(uint32_t number, char* page);
+	};
+
+	// Class holding the snapshots of the files read by a statement (or transaction), each file is read as it was when it was first read through the set
+	class SnapshotSet {
+		std::mutex mutex;
+		std::map<std::filesystem::path, std::shared_ptr<Snapshot>> snapshots;
+		// The set reads on the current thread go through
+		static thread_local SnapshotSet* activeSet;
+
+	public:
+		SnapshotSet() = default;
+		SnapshotSet(const SnapshotSet&) = delete;
+
+		// Get the snapshot of a file, taking one if the file hasn't been read through the set yet
+		std::shared_ptr<Snapshot> get(const std::filesystem::path& file);
+		// Check if a file hasn't been modified since it was first read through the set (files which haven't been read through it are always current)
+		bool current(const std::filesystem::path& file);
+
+		// The set reads on the current thread go through (null if every read takes its own snapshot)
+		static SnapshotSet* active() { return activeSet; }
+
+		// Class which makes reads on the current thread go through a set until it is destroyed
+		class Scope {
+			SnapshotSet* previous;
+		public:
+			Scope(SnapshotSet& set): previous(activeSet) { activeSet = &set; }
+			Scope(const Scope&) = delete;
+			~Scope() { activeSet = previous; }
+		};
+	};
+
+	// Function which gets a snapshot of a file from the set active on the current thread (or takes a new snapshot if no set is active)
+	std::shared_ptr<Snapshot> takeSnapshot(const std::filesystem::path& file);
+
+} // sql::storage
+
+#endif // VERSIONS_HPP
@@ -0,0 +1,326 @@
+/*------------------------------------------------------------
+ * Filename: wal.cpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Implements the appending (and group syncing) of checksummed groups to the write-ahead log, and their replay and checkpointing.
+ *------------------------------------------------------------*/
+
+#include "wal.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "bufferpool.hpp"
+#include "locks.hpp"
+#include "versions.hpp"
+
+namespace sql::storage {
+
+	constexpr size_t pageSize = BufferPool::pageSize;
+
+	// Header found at the start of every group in the log, the name of the file the group changes follows it (then for renames the name of the
+	// file renamed over it) and then each page (its number followed by its contents)
+	struct GroupHeader {
+		char magic[4];
+		uint32_t type;
+		// The transaction the group belongs to (0 if it doesn't belong to one)
+		uint32_t transaction;
+		uint32_t nameSize, sourceSize;
+		uint32_t pageCount;
+		// Checksum of the rest of the group (used to detect groups torn by a crash)
+		uint64_t checksum;
+
+		// Checksum of the header's fields (which the rest of the group's checksum continues from)
+		uint64_t fieldChecksum() const;
+		// The size of the rest of the group
+		size_t bodySize() const { return nameSize + sourceSize + size_t(pageCount) * (sizeof(uint32_t) + pageSize); }
+	};
+	constexpr std::string_view groupMagic = "WLOG";
+
+	// Counters backing the log's statistics
+	static std::atomic<uint64_t> appendedGroups = 0, logSyncs = 0;
+
+	// Helper which calculates the (FNV-1a) checksum of some bytes, continuing from a previous checksum
+	static uint64_t checksum(const char* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+		for(size_t i = 0; i < size; i++)
+			hash = (hash ^ uint8_t(data[i])) * 1099511628211ull;
+		return hash;
+	}
+
+	uint64_t GroupHeader::fieldChecksum() const { return storage::checksum((const char*) &type, sizeof(uint32_t) * 5); }
+
+	// Helper which opens and locks a directory's log
+	static int openLog(const std::filesystem::path& directory, int lock) {
+		int fd = open((directory / WriteAheadLog::fileName).c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+		if(fd < 0)
+			throw std::runtime_error("Failed to open the write-ahead log in " + directory.string());
+		if(flock(fd, lock) != 0) {
+			close(fd);
+			throw std::runtime_error("Failed to lock the write-ahead log in " + directory.string());
+		}
+		return fd;
+	}
+
+	// Helper which syncs every file in a directory then empties its (exclusively locked) log
+	static void checkpointLog(int fd, const std::filesystem::path& directory) {
+		for(auto& entry: std::filesystem::directory_iterator(directory)) {
+			auto name = entry.path().filename();
+			// NOTE: Version stores (and the lock table) are only read by running processes, so they never need to be durable
+			if(!entry.is_regular_file() || name == WriteAheadLog::fileName || name == WriteAheadLog::syncFileName || name == LockManager::fileName
+			  || entry.path().extension() == VersionStore::extension) continue;
+			int file = open(entry.path().c_str(), O_RDONLY);
+			if(file < 0) continue;
+			fsync(file);
+			close(file);
+		}
+
+		// NOTE: The durable size is (durably) reset before the log is emptied, so it can never claim that appends to the emptied log are durable
+		uint64_t synced = 0;
+		int syncFd = open((directory / WriteAheadLog::syncFileName).c_str(), O_RDWR | O_CREAT, 0644);
+		bool reset = syncFd >= 0 && pwrite(syncFd, &synced, sizeof(synced), 0) == sizeof(synced) && fsync(syncFd) == 0;
+		if(syncFd >= 0) close(syncFd);
+
+		if(!reset || ftruncate(fd, 0) != 0 || fsync(fd) != 0)
+			throw std::runtime_error("Failed to checkpoint the write-ahead log in " + directory.string());
+		WriteAheadLog::syncDirectory(directory);
+	}
+
+	WriteAheadLog::WriteAheadLog(std::filesystem::path directory): directory(std::move(directory)) {
+		fd = openLog(this->directory, LOCK_SH);
+		syncFd = open((this->directory / syncFileName).c_str(), O_RDWR | O_CREAT, 0644);
+		if(syncFd < 0) {
+			close(fd);
+			throw std::runtime_error("Failed to open the write-ahead log in " + this->directory.string());
+		}
+	}
+
+	WriteAheadLog::~WriteAheadLog() {
+		struct stat info;
+		bool full = fstat(fd, &info) == 0 && size_t(info.st_size) > checkpointSize;
+		flock(fd, LOCK_UN);
+
+		// If the log has grown too large it is checkpointed (unless someone else is using it, in which case they will checkpoint it)
+		if(full && flock(fd, LOCK_EX | LOCK_NB) == 0)
+			try {
+				checkpointLog(fd, directory);
+			} catch(std::runtime_error&) {}
+		close(syncFd);
+		close(fd);
+	}
+
+	void WriteAheadLog::sync(uint64_t end) {
+		// NOTE: Only one writer syncs the log at a time, the rest wait here and usually find their groups were included in its sync
+		if(flock(syncFd, LOCK_EX) != 0)
+			throw std::runtime_error("Failed to lock the write-ahead log in " + directory.string());
+
+		uint64_t synced = 0;
+		if(pread(syncFd, &synced, sizeof(synced), 0) != sizeof(synced))
+			synced = 0;
+
+		bool failed = false;
+		if(synced < end) {
+			// If other writers are appending, give them a chance to append their groups so they can be synced together
+			struct stat info;
+			if(fstat(fd, &info) == 0 && uint64_t(info.st_size) > end) {
+				auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(commitDelay);
+				while(uint64_t(info.st_size) - synced < commitBytes && std::chrono::steady_clock::now() < deadline && fstat(fd, &info) == 0)
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+
+			// Everything appended before the sync starts is durable once it finishes
+			failed = fstat(fd, &info) != 0;
+			synced = info.st_size;
+			failed = failed || fdatasync(fd) != 0 || pwrite(syncFd, &synced, sizeof(synced), 0) != sizeof(synced);
+			logSyncs++;
+		}
+
+		flock(syncFd, LOCK_UN);
+		if(failed)
+			throw std::runtime_error("Failed to sync the write-ahead log in " + directory.string());
+	}
+
+	uint64_t WriteAheadLog::write(GroupType type, uint32_t transaction, const std::string& name, const std::string& source, const std::vector<LoggedPage>& pages) {
+		GroupHeader header;
+		std::memcpy(header.magic, groupMagic.data(), sizeof(header.magic));
+		header.type = type;
+		header.transaction = transaction;
+		header.nameSize = name.size();
+		header.sourceSize = source.size();
+		header.pageCount = pages.size();
+
+		// The whole group is built in memory so that it is appended in a single write
+		std::vector<char> group(sizeof(GroupHeader) + header.bodySize());
+		char* out = group.data() + sizeof(GroupHeader);
+		std::memcpy(out, name.data(), name.size());
+		out += name.size();
+		std::memcpy(out, source.data(), source.size());
+		out += source.size();
+		for(auto& page: pages) {
+			std::memcpy(out, &page.number, sizeof(uint32_t));
+			std::memcpy(out + sizeof(uint32_t), page.data, pageSize);
+			out += sizeof(uint32_t) + pageSize;
+		}
+		header.checksum = checksum(group.data() + sizeof(GroupHeader), group.size() - sizeof(GroupHeader), header.fieldChecksum());
+		std::memcpy(group.data(), &header, sizeof(GroupHeader));
+
+		// NOTE: The log is opened for appending, so after the write the offset is the end of this group (even if other writers have appended since)
+		if(::write(fd, group.data(), group.size()) != ssize_t(group.size()))
+			throw std::runtime_error("Failed to write to the write-ahead log in " + directory.string());
+		off_t end = lseek(fd, 0, SEEK_CUR);
+		if(end < 0)
+			throw std::runtime_error("Failed to write to the write-ahead log in " + directory.string());
+		appendedGroups++;
+		return end;
+	}
+
+	void WriteAheadLog::append(GroupType type, const std::filesystem::path& file, const std::vector<LoggedPage>& pages /*= {}*/, uint32_t transaction /*= 0*/) {
+		uint64_t end = write(type, transaction, file.filename().string(), {}, pages);
+		// Groups which belong to a transaction are synced once the transaction commits
+		if(transaction == 0) sync(end);
+	}
+
+	void WriteAheadLog::rename(const std::filesystem::path& source, const std::filesystem::path& file, uint32_t transaction /*= 0*/) {
+		uint64_t end = write(Rename, transaction, file.filename().string(), source.filename().string(), {});
+		if(transaction == 0) sync(end);
+	}
+
+	void WriteAheadLog::commit(uint32_t transaction) {
+		sync(write(Commit, transaction, {}, {}, {}));
+	}
+
+	uint32_t WriteAheadLog::newTransaction() {
+		static thread_local std::mt19937 random{std::random_device{}()};
+		uint32_t transaction;
+		do transaction = random(); while(transaction == 0);
+		return transaction;
+	}
+
+	void WriteAheadLog::syncDirectory(const std::filesystem::path& directory) {
+		int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+		bool synced = fd >= 0 && fsync(fd) == 0;
+		if(fd >= 0) close(fd);
+		if(!synced)
+			throw std::runtime_error("Failed to sync " + directory.string());
+	}
+
+	size_t WriteAheadLog::recover(const std::filesystem::path& directory) {
+		if(!exists(directory / fileName))
+			return 0;
+		int fd = openLog(directory, LOCK_EX);
+		// An empty log has nothing to replay (and doesn't need checkpointing)
+		struct stat info;
+		if(fstat(fd, &info) == 0 && info.st_size == 0) {
+			close(fd);
+			return 0;
+		}
+
+		// Find every complete group (stopping at the first group which was torn by a crash), and the transactions which committed
+		struct Group {
+			GroupHeader header;
+			off_t offset;
+			std::string name, source;
+		};
+		std::vector<Group> groups;
+		std::set<uint32_t> committed;
+		std::vector<char> body;
+		off_t offset = 0;
+		GroupHeader header;
+		while(pread(fd, &header, sizeof(header), offset) == sizeof(header) && std::string_view(header.magic, sizeof(header.magic)) == groupMagic) {
+			body.resize(header.bodySize());
+			if(pread(fd, body.data(), body.size(), offset + sizeof(header)) != ssize_t(body.size())
+			  || checksum(body.data(), body.size(), header.fieldChecksum()) != header.checksum)
+				break;
+			groups.push_back({header, offset, std::string(body.data(), header.nameSize), std::string(body.data() + header.nameSize, header.sourceSize)});
+			if(header.type == Commit)
+				committed.insert(header.transaction);
+			offset += sizeof(header) + body.size();
+		}
+		// Groups are only replayed if they don't belong to a transaction, or their transaction committed
+		auto replayable = [&](const GroupHeader& header) { return header.transaction == 0 || committed.count(header.transaction); };
+
+		// A rename which already happened (its source no longer exists) replaced its file with a complete (synced) file, so none of the groups before it apply to the file
+		std::map<std::string, size_t> replacedAt;
+		for(size_t i = 0; i < groups.size(); i++)
+			if(groups[i].header.type == Rename && replayable(groups[i].header) && !exists(directory / groups[i].source))
+				replacedAt[groups[i].name] = i;
+
+		// Replay the groups in order
+		size_t replayed = 0;
+		for(size_t i = 0; i < groups.size(); i++) {
+			auto& [header, offset, name, source] = groups[i];
+			if(header.type == Commit || !replayable(header)) continue;
+			if(auto replaced = replacedAt.find(name); replaced != replacedAt.end() && i <= replaced->second) continue;
+
+			auto path = directory / name;
+			if(header.type == Remove)
+				std::filesystem::remove(path);
+			else if(header.type == Rename) {
+				std::filesystem::rename(directory / source, path);
+				BufferPool::global().invalidate(BufferPool::key(path));
+			} else {
+				// Pages are only replayed into files which still exist (unless the group replaces the file)
+				int file = header.type == Replace ? open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(path.c_str(), O_WRONLY);
+				if(file >= 0) {
+					body.resize(header.bodySize());
+					bool written = pread(fd, body.data(), body.size(), offset + sizeof(header)) == ssize_t(body.size());
+					const char* page = body.data() + header.nameSize + header.sourceSize;
+					for(uint32_t p = 0; p < header.pageCount && written; p++, page += sizeof(uint32_t) + pageSize) {
+						uint32_t number;
+						std::memcpy(&number, page, sizeof(uint32_t));
+						written = pwrite(file, page + sizeof(uint32_t), pageSize, off_t(number) * pageSize) == pageSize;
+					}
+					close(file);
+					if(!written) {
+						close(fd);
+						throw std::runtime_error("Failed to replay the write-ahead log into " + path.string());
+					}
+
+					// Any of the file's cached pages may no longer match it
+					BufferPool::global().invalidate(BufferPool::key(path));
+				}
+			}
+			replayed++;
+		}
+		// The versions written by replayed groups may never have been published
+		if(replayed > 0)
+			VersionStore::recover(directory);
+
+		try {
+			checkpointLog(fd, directory);
+		} catch(std::runtime_error&) {
+			close(fd);
+			throw;
+		}
+		close(fd);
+		return replayed;
+	}
+
+	void WriteAheadLog::checkpoint(const std::filesystem::path& directory) {
+		int fd = openLog(directory, LOCK_EX);
+		try {
+			checkpointLog(fd, directory);
+		} catch(std::runtime_error&) {
+			close(fd);
+			throw;
+		}
+		close(fd);
+	}
+
+	WriteAheadLog::Statistics WriteAheadLog::statistics() {
+		return {appendedGroups, logSyncs};
+	}
+
+} // sql::storage
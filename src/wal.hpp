@@ -0,0 +1,114 @@
+/*------------------------------------------------------------
+ * Filename: wal.hpp
+ * Author: Joshua Dahl
+ * Email: joshuadahl@nevada.unr.edu
+ * Created: 10/16/26
+ * Modified: 10/16/26
+ * Description: Provides the write-ahead log kept in each database directory. Before any of a file's pages are written
+ * 				their new contents are appended to the log (and the log is synced), so that after a crash every file
+ * 				can be repaired by replaying the log. The files themselves are only synced when the log is checkpointed.
+ * 				Appends from concurrent writers (in any process) are synced together: whichever writer takes the log's sync
+ * 				lock first syncs everything appended so far, and the writers waiting behind it find their groups already durable.
+ * 				Groups can belong to a transaction, in which case they are only replayed if the transaction's commit group
+ * 				was logged as well (letting changes to several files be committed all or nothing).
+ *------------------------------------------------------------*/
+
+#ifndef WAL_HPP
+#define WAL_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sql::storage {
+
+	// Struct describing the new contents of one of a file's pages
+	struct LoggedPage {
+		uint32_t number;
+		const char* data;
+	};
+
+	// Class which appends groups of changes to a directory's write-ahead log, each group is replayed in full or (if it was torn by a crash) not at all
+	// NOTE: The log is share locked while it is open, recovery and checkpoints lock it exclusively so they never run while a logged group's pages are being written
+	class WriteAheadLog {
+		int fd = -1;
+		// File holding how much of the log is known to be durable (locked by the writer currently syncing the log)
+		int syncFd = -1;
+		std::filesystem::path directory;
+
+		// Wait until the log is durable up to (at least) <end>, syncing it if no other writer already has
+		void sync(uint64_t end);
+
+	public:
+		// The types of group which can be logged
+		enum GroupType : uint32_t {
+			// New contents of some of a file's pages
+			Pages,
+			// The file was replaced by one holding only the group's pages
+			Replace,
+			// The file was removed
+			Remove,
+			// Another (synced) file was renamed over the file
+			Rename,
+			// All of the groups of the group's transaction have been logged
+			Commit,
+		};
+
+	private:
+		// Append a group to the log (without syncing it), returns the offset of the end of the group
+		uint64_t write(GroupType type, uint32_t transaction, const std::string& name, const std::string& source, const std::vector<LoggedPage>& pages);
+
+	public:
+
+		// Name of the log file within the directory
+		static constexpr std::string_view fileName = "wal.log";
+		// Name of the file holding how much of the log is durable
+		static constexpr std::string_view syncFileName = "wal.sync";
+		// Size the log can grow to before it is checkpointed
+		static constexpr size_t checkpointSize = 64 * 1024 * 1024;
+
+		// Counters describing how well appends are being grouped
+		struct Statistics {
+			uint64_t groups = 0;
+			uint64_t syncs = 0;
+		};
+
+		// How long (in microseconds) a writer syncing the log waits for other writers to append their groups (it only waits if other writers are appending)
+		static inline std::atomic<size_t> commitDelay = 1000;
+		// The number of unsynced bytes after which the log is synced without waiting any longer
+		static inline std::atomic<size_t> commitBytes = 1024 * 1024;
+
+		// Open (creating if nessicary) the log of a directory
+		explicit WriteAheadLog(std::filesystem::path directory);
+		WriteAheadLog(const WriteAheadLog&) = delete;
+		// NOTE: Closing the log checkpoints it if it has grown too large
+		~WriteAheadLog();
+
+		// Durably append a group of changes to one of the directory's files (returns once the group has been synced, possibly by another writer)
+		// NOTE: If a transaction is provided the group isn't synced (or replayed after a crash) until the transaction commits
+		void append(GroupType type, const std::filesystem::path& file, const std::vector<LoggedPage>& pages = {}, uint32_t transaction = 0);
+		// Durably log that <source> (which must already be synced) is about to be renamed over <file>
+		// NOTE: Once the rename has happened, none of the groups logged for <file> before it are replayed
+		void rename(const std::filesystem::path& source, const std::filesystem::path& file, uint32_t transaction = 0);
+		// Durably commit a transaction, once this returns all of the transaction's groups will be replayed after a crash
+		void commit(uint32_t transaction);
+		// Generate a new (random, non-zero) transaction identifier
+		static uint32_t newTransaction();
+
+		// Replay every complete group in a directory's log, then checkpoint it, returns the number of groups replayed
+		static size_t recover(const std::filesystem::path& directory);
+		// Sync every file in a directory (making all of the logged changes durable), then empty its log
+		static void checkpoint(const std::filesystem::path& directory);
+		// Sync a directory (making the creation, removal, and renaming of its files durable)
+		static void syncDirectory(const std::filesystem::path& directory);
+
+		// Get the number of groups this process has appended, and the number of times it has synced the log
+		static Statistics statistics();
+	};
+
+} // sql::storage
+
+#endif // WAL_HPP